@@ -21,6 +21,7 @@
 //#include "FogOfWarDisplayComponent.h"
 #include "FocusComponent.h"
 #include "FogOfWarSubsystem.h"
+#include "TeamVisibilitySubsystem.h"
 
 //When a TScriptInterface<> refers to an object that implements the interface purely in blueprint, the IInterface pointer inside it must always be null.
 //This is because the interface address doesn't actually exist in the compiled program, it is purely a BP construct.
@@ -197,32 +198,42 @@ bool ABaseUnit::IsFogOfWarVisible_Implementation(const UFogOfWarVisionComponent*
 	return Component->CanSeePoint(GetActorLocation());
 }
 
-void ABaseUnit::SetFogOfWarVisionVisibility_Implementation(UFogOfWarVisionComponent* Component, bool bIsVisible)
+bool ABaseUnit::IsFogOfWarVisibleAtActorLocation() const
 {
-	if (!IsValid(Component))
-		return;
+	//Unless a blueprint has replaced the location test with its own
+	return !GetClass()->IsFunctionImplementedInScript(GET_FUNCTION_NAME_CHECKED(IFogOfWarActor, IsFogOfWarVisible));
+}
+
+void ABaseUnit::SetFogOfWarVisionVisibility_Implementation(FGenericTeamId Team, bool bIsVisible)
+{
+	if (bIsVisible)
+		FogOfWarVisionTeams.AddUnique(Team);
+	else
+		FogOfWarVisionTeams.RemoveSingleSwap(Team);
 
 	//Just route directly to show/hide since there's only one player at the moment
+	bool bNewVisibleToPlayer = IsFogOfWarVisibleToPlayer();
 
+	if (bNewVisibleToPlayer == bFogOfWarVisibleToPlayer)
+		return;
 
-	auto Pawn = Component->GetOwner()->GetOwner<APawn>();
+	bFogOfWarVisibleToPlayer = bNewVisibleToPlayer;
 
-	if (!IsValid(Pawn) || !Pawn->IsPlayerControlled())
-		return;
+	SetFogOfWarVisibility(bNewVisibleToPlayer);
+}
 
-	//Make sure nothing went wrong with ref count, would lead to permanent invisible/visible units
-	check(FogOfWarVisionRefCount >= 0);
+bool ABaseUnit::IsFogOfWarVisibleToPlayer() const
+{
+	auto TeamVisibility = GetWorld()->GetSubsystem<UTeamVisibilitySubsystem>();
 
-	if (bIsVisible)
-	{
-		if (FogOfWarVisionRefCount++ == 0)
-			SetFogOfWarVisibility(true);
-	}
-	else
-	{
-		if (--FogOfWarVisionRefCount == 0)
-			SetFogOfWarVisibility(false);
-	}
+	if (!TeamVisibility)
+		return false;
+
+	for (auto Team : FogOfWarVisionTeams)
+		if (TeamVisibility->HasPlayerVision(Team))
+			return true;
+
+	return false;
 }
 
 void ABaseUnit::SetFogOfWarDisplayVisibility_Implementation(UFogOfWarDisplayComponent* Component, bool bIsVisible)
@@ -2,4 +2,333 @@
 
 
 #include "FogOfWarCommon.h"
+#include "Algo/Rotate.h"
 
+//Appends the points of a polyline to keep after Douglas-Peucker simplification, except for the last point
+static void SimplifyPolyline(TArrayView<const FVector2D> Points, double Tolerance, TArray<FVector2D>& OutPoints)
+{
+	check(Points.Num() >= 2);
+
+	TBitArray<> Keep{ false, Points.Num() };
+
+	Keep[0] = true;
+
+	Keep[Points.Num() - 1] = true;
+
+	TArray<TPair<int32, int32>, TInlineAllocator<32>> Ranges{ { 0, Points.Num() - 1 } };
+
+	while (Ranges.Num() > 0)
+	{
+		auto [First, Last] = Ranges.Pop(false);
+
+		int32 Furthest = INDEX_NONE;
+
+		double FurthestDistSqr = FMath::Square(Tolerance);
+
+		//Distance to the segment rather than the line, so that runs which double back on themselves are kept
+		for (int32 Index = First + 1; Index < Last; ++Index)
+		{
+			double DistSqr = FVector2D::DistSquared(Points[Index], FMath::ClosestPointOnSegment2D(Points[Index], Points[First], Points[Last]));
+
+			if (DistSqr > FurthestDistSqr)
+			{
+				Furthest = Index;
+				FurthestDistSqr = DistSqr;
+			}
+		}
+
+		if (Furthest == INDEX_NONE)
+			continue;
+
+		Keep[Furthest] = true;
+
+		Ranges.Add({ First, Furthest });
+		Ranges.Add({ Furthest, Last });
+	}
+
+	for (int32 Index = 0; Index < Points.Num() - 1; ++Index)
+		if (Keep[Index])
+			OutPoints.Add(Points[Index]);
+}
+
+void FFogOfWarOccluderMesh::SimplifyShadowEdges(double Tolerance)
+{
+	//Vertices closer than this to the line between their neighbours are treated as being on it
+	static constexpr double CollinearTolerance = 0.01;
+
+	Tolerance = FMath::Max(Tolerance, CollinearTolerance);
+
+	TMultiMap<FVector2D, int32> EdgesByStart;
+
+	TSet<FVector2D> EdgeEnds;
+
+	for (int32 Index = 0; Index < ShadowEdges.Num(); ++Index)
+	{
+		EdgesByStart.Add(ShadowEdges[Index].Key, Index);
+
+		EdgeEnds.Add(ShadowEdges[Index].Value);
+	}
+
+	TBitArray<> UsedEdges{ false, ShadowEdges.Num() };
+
+	TArray<TPair<FVector2D, FVector2D>> NewShadowEdges;
+
+	TArray<FVector2D> Chain;
+
+	TArray<FVector2D> Simplified;
+
+	auto FindNextEdge = [&](const FVector2D& From)
+	{
+		for (auto It = EdgesByStart.CreateConstKeyIterator(From); It; ++It)
+			if (!UsedEdges[It.Value()])
+				return It.Value();
+
+		return int32(INDEX_NONE);
+	};
+
+	auto AddChain = [&](int32 FirstEdge)
+	{
+		Chain.Reset();
+
+		Chain.Add(ShadowEdges[FirstEdge].Key);
+
+		for (int32 Edge = FirstEdge; Edge != INDEX_NONE; Edge = FindNextEdge(Chain.Last()))
+		{
+			UsedEdges[Edge] = true;
+
+			Chain.Add(ShadowEdges[Edge].Value);
+		}
+
+		Simplified.Reset();
+
+		bool bIsLoop = Chain.Num() > 3 && Chain.Last() == Chain[0];
+
+		if (bIsLoop)
+		{
+			//The ends of each half are always kept, so start from the lowest vertex which is a corner of the convex hull, rather than wherever the walk began
+			Chain.Pop(false);
+
+			int32 Lowest = 0;
+
+			for (int32 Index = 1; Index < Chain.Num(); ++Index)
+				if (Chain[Index].X < Chain[Lowest].X || (Chain[Index].X == Chain[Lowest].X && Chain[Index].Y < Chain[Lowest].Y))
+					Lowest = Index;
+
+			Algo::Rotate(Chain, Lowest);
+
+			Chain.Add(Chain[0]);
+
+			//Douglas-Peucker needs two fixed ends, so split the loop at the vertex furthest from the start, which is also on the hull
+			int32 Split = 1;
+
+			for (int32 Index = 2; Index < Chain.Num() - 1; ++Index)
+				if (FVector2D::DistSquared(Chain[Index], Chain[0]) > FVector2D::DistSquared(Chain[Split], Chain[0]))
+					Split = Index;
+
+			SimplifyPolyline(MakeArrayView(Chain.GetData(), Split + 1), Tolerance, Simplified);
+
+			SimplifyPolyline(MakeArrayView(Chain.GetData() + Split, Chain.Num() - Split), Tolerance, Simplified);
+
+			//Simplified too far to enclose anything, so keep it as it was
+			if (Simplified.Num() < 3)
+			{
+				Simplified = Chain;
+				Simplified.Pop(false);
+			}
+
+			Simplified.Add(Simplified[0]);
+		}
+		else
+		{
+			SimplifyPolyline(Chain, Tolerance, Simplified);
+
+			Simplified.Add(Chain.Last());
+		}
+
+		for (int32 Index = 1; Index < Simplified.Num(); ++Index)
+			NewShadowEdges.Add({ Simplified[Index - 1], Simplified[Index] });
+	};
+
+	//Start open runs from their first edge, so that they aren't split in two
+	for (int32 Index = 0; Index < ShadowEdges.Num(); ++Index)
+		if (!UsedEdges[Index] && !EdgeEnds.Contains(ShadowEdges[Index].Key))
+			AddChain(Index);
+
+	//Everything left is part of a loop
+	for (int32 Index = 0; Index < ShadowEdges.Num(); ++Index)
+		if (!UsedEdges[Index])
+			AddChain(Index);
+
+	ShadowEdges = MoveTemp(NewShadowEdges);
+}
+
+void FFogOfWarOccluderMesh::UpdateBounds()
+{
+	Bounds.Init();
+
+	for (auto& [From, To] : ShadowEdges)
+	{
+		Bounds += From;
+		Bounds += To;
+	}
+}
+
+bool FFogOfWarViewer::IsInVisionCone(const FVector2D& Point) const
+{
+	auto VisionToPoint = Point - Location;
+
+	auto PointDistSqr = VisionToPoint.SizeSquared();
+
+	if (PointDistSqr > FMath::Square(VisionRadius))
+		return false;
+
+	if (PointDistSqr <= FMath::Square(SelfVisionRadius) || PointDistSqr < KINDA_SMALL_NUMBER)
+		return true;
+
+	//If point is further than the 360 degree self vision, check against the fov cone
+	return ((VisionToPoint * FMath::InvSqrtEst(PointDistSqr)) | Forward) >= CosHalfFOV;
+}
+
+void FFogOfWarEdgeBuffer::Reset()
+{
+	X0.Reset();
+	Y0.Reset();
+	X1.Reset();
+	Y1.Reset();
+}
+
+void FFogOfWarEdgeBuffer::Reserve(int32 NumEdges)
+{
+	X0.Reserve(NumEdges);
+	Y0.Reserve(NumEdges);
+	X1.Reserve(NumEdges);
+	Y1.Reserve(NumEdges);
+}
+
+void FFogOfWarEdgeBuffer::AddOccluder(FFogOfWarOccluderInstance& Occluder)
+{
+	if (!Occluder.OccluderMesh)
+		return;
+
+	Occluder.FirstWorldEdge = Num();
+
+	Occluder.NumWorldEdges = Occluder.OccluderMesh->ShadowEdges.Num();
+
+	AppendOccluderEdges(Occluder);
+}
+
+void FFogOfWarEdgeBuffer::AppendOccluderEdges(const FFogOfWarOccluderInstance& Occluder)
+{
+	if (!Occluder.OccluderMesh)
+		return;
+
+	//No reserve here, since reserving exactly what one occluder needs would reallocate on every call. Callers that know the total use Reserve.
+	auto& ShadowEdges = Occluder.OccluderMesh->ShadowEdges;
+
+	for (auto& [From, To] : ShadowEdges)
+	{
+		FVector FromWS = Occluder.Transform.TransformPosition(FVector{ From, 0.0 });
+		FVector ToWS = Occluder.Transform.TransformPosition(FVector{ To, 0.0 });
+
+		X0.Add(float(FromWS.X));
+		Y0.Add(float(FromWS.Y));
+		X1.Add(float(ToWS.X));
+		Y1.Add(float(ToWS.Y));
+	}
+}
+
+void FFogOfWarEdgeBuffer::AppendEdges(const FFogOfWarEdgeBuffer& Source, int32 First, int32 Count)
+{
+	check(First >= 0 && First + Count <= Source.Num());
+
+	X0.Append(Source.X0.GetData() + First, Count);
+	Y0.Append(Source.Y0.GetData() + First, Count);
+	X1.Append(Source.X1.GetData() + First, Count);
+	Y1.Append(Source.Y1.GetData() + First, Count);
+}
+
+int32 FFogOfWarEdgeBuffer::FindIntersectingEdge(int32 First, int32 Count, const FVector2D& From, const FVector2D& To) const
+{
+	check(First >= 0 && First + Count <= Num());
+
+	const float PX = float(From.X);
+	const float PY = float(From.Y);
+	const float RX = float(To.X - From.X);
+	const float RY = float(To.Y - From.Y);
+
+	const int32 End = First + Count;
+
+	int32 Index = First;
+
+	//Same test as the scalar loop below, for 4 edges at once
+	const VectorRegister4Float VectorPX = VectorSetFloat1(PX);
+	const VectorRegister4Float VectorPY = VectorSetFloat1(PY);
+	const VectorRegister4Float VectorRX = VectorSetFloat1(RX);
+	const VectorRegister4Float VectorRY = VectorSetFloat1(RY);
+	const VectorRegister4Float Zero = VectorZeroFloat();
+
+	for (; Index + 4 <= End; Index += 4)
+	{
+		VectorRegister4Float EdgeX0 = VectorLoad(X0.GetData() + Index);
+		VectorRegister4Float EdgeY0 = VectorLoad(Y0.GetData() + Index);
+
+		VectorRegister4Float SX = VectorSubtract(VectorLoad(X1.GetData() + Index), EdgeX0);
+		VectorRegister4Float SY = VectorSubtract(VectorLoad(Y1.GetData() + Index), EdgeY0);
+
+		VectorRegister4Float QX = VectorSubtract(EdgeX0, VectorPX);
+		VectorRegister4Float QY = VectorSubtract(EdgeY0, VectorPY);
+
+		VectorRegister4Float Denom = VectorSubtract(VectorMultiply(VectorRX, SY), VectorMultiply(VectorRY, SX));
+		VectorRegister4Float T = VectorSubtract(VectorMultiply(QX, SY), VectorMultiply(QY, SX));
+		VectorRegister4Float U = VectorSubtract(VectorMultiply(QX, VectorRY), VectorMultiply(QY, VectorRX));
+
+		VectorRegister4Float Negative = VectorCompareLT(Denom, Zero);
+
+		Denom = VectorAbs(Denom);
+		T = VectorSelect(Negative, VectorNegate(T), T);
+		U = VectorSelect(Negative, VectorNegate(U), U);
+
+		VectorRegister4Float Hit = VectorBitwiseAnd(VectorCompareGT(Denom, Zero), VectorCompareGE(T, Zero));
+		Hit = VectorBitwiseAnd(Hit, VectorCompareLE(T, Denom));
+		Hit = VectorBitwiseAnd(Hit, VectorCompareGE(U, Zero));
+		Hit = VectorBitwiseAnd(Hit, VectorCompareLE(U, Denom));
+
+		if (int32 HitMask = VectorMaskBits(Hit))
+			return Index + FMath::CountTrailingZeros(uint32(HitMask));
+	}
+
+	for (; Index < End; ++Index)
+	{
+		float SX = X1[Index] - X0[Index];
+		float SY = Y1[Index] - Y0[Index];
+
+		float QX = X0[Index] - PX;
+		float QY = Y0[Index] - PY;
+
+		//Both segments cross where From + R * T / Denom == Edge.From + S * U / Denom
+		float Denom = RX * SY - RY * SX;
+		float T = QX * SY - QY * SX;
+		float U = QX * RY - QY * RX;
+
+		//Flip the signs so that both ratios only need comparing against a positive denominator
+		if (Denom < 0.f)
+		{
+			Denom = -Denom;
+			T = -T;
+			U = -U;
+		}
+
+		if (Denom > 0.f && T >= 0.f && T <= Denom && U >= 0.f && U <= Denom)
+			return Index;
+	}
+
+	return INDEX_NONE;
+}
+
+void FFogOfWarEdgeBuffer::FindVisiblePoints(const FVector2D& From, TArrayView<const FVector2D> Targets, TBitArray<>& OutVisible) const
+{
+	OutVisible.Init(false, Targets.Num());
+
+	for (int32 Index = 0; Index < Targets.Num(); ++Index)
+		OutVisible[Index] = FindIntersectingEdge(0, Num(), From, Targets[Index]) == INDEX_NONE;
+}
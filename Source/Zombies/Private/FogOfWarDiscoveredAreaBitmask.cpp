@@ -0,0 +1,182 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "FogOfWarDiscoveredAreaBitmask.h"
+
+void FFogOfWarDiscoveredAreaBitmask::Init(int32 InResolution)
+{
+	check(InResolution > 0);
+
+	Resolution = InResolution;
+
+	WordsPerRow = FMath::DivideAndRoundUp(Resolution, 64);
+
+	NumSetTexels = 0;
+
+	Words.Init(0, WordsPerRow * Resolution);
+
+	SubTileCounts.Init(0, WordsPerRow * WordsPerRow);
+
+	ClearDirty();
+}
+
+bool FFogOfWarDiscoveredAreaBitmask::IsSet(int32 X, int32 Y) const
+{
+	check(X >= 0 && X < Resolution && Y >= 0 && Y < Resolution);
+
+	if (IsFull())
+		return true;
+
+	return (Words[Y * WordsPerRow + X / 64] >> (X % 64)) & 1;
+}
+
+bool FFogOfWarDiscoveredAreaBitmask::IsRectComplete(const FIntRect& TexelRect) const
+{
+	if (IsFull())
+		return true;
+
+	int32 MinX = FMath::Max(TexelRect.Min.X, 0);
+	int32 MinY = FMath::Max(TexelRect.Min.Y, 0);
+	int32 MaxX = FMath::Min(TexelRect.Max.X, Resolution);
+	int32 MaxY = FMath::Min(TexelRect.Max.Y, Resolution);
+
+	if (MinX >= MaxX || MinY >= MaxY)
+		return true;
+
+	for (int32 SubTileY = MinY / SubTileSize; SubTileY <= (MaxY - 1) / SubTileSize; ++SubTileY)
+		for (int32 SubTileX = MinX / SubTileSize; SubTileX <= (MaxX - 1) / SubTileSize; ++SubTileX)
+			if (SubTileCounts[SubTileY * WordsPerRow + SubTileX] < GetSubTileArea(SubTileX, SubTileY))
+				return false;
+
+	return true;
+}
+
+int32 FFogOfWarDiscoveredAreaBitmask::GetSubTileArea(int32 SubTileX, int32 SubTileY) const
+{
+	//Sub tiles on the far edges are cut short if the resolution isn't a multiple of the sub tile size
+	return FMath::Min(SubTileSize, Resolution - SubTileX * SubTileSize) * FMath::Min(SubTileSize, Resolution - SubTileY * SubTileSize);
+}
+
+void FFogOfWarDiscoveredAreaBitmask::FillTriangle(const FVector2D& A, const FVector2D& B, const FVector2D& C)
+{
+	if (IsFull())
+		return;
+
+	double MinY = FMath::Min3(A.Y, B.Y, C.Y);
+	double MaxY = FMath::Max3(A.Y, B.Y, C.Y);
+
+	//Rows whose centres are inside the triangles vertical range
+	int32 FirstRow = FMath::Max(FMath::CeilToInt32(MinY - 0.5), 0);
+	int32 EndRow = FMath::Min(FMath::FloorToInt32(MaxY - 0.5) + 1, Resolution);
+
+	const FVector2D Vertices[3] = { A, B, C };
+
+	for (int32 Y = FirstRow; Y < EndRow; ++Y)
+	{
+		double RowCentre = Y + 0.5;
+
+		double MinX = TNumericLimits<double>::Max();
+		double MaxX = TNumericLimits<double>::Lowest();
+
+		//Where the row centre crosses each edge. Edges are half open in Y, so a row through a vertex isn't counted twice.
+		for (int32 Index = 0; Index < 3; ++Index)
+		{
+			const auto& From = Vertices[Index];
+			const auto& To = Vertices[(Index + 1) % 3];
+
+			if ((RowCentre < From.Y) == (RowCentre < To.Y))
+				continue;
+
+			double X = From.X + (RowCentre - From.Y) * (To.X - From.X) / (To.Y - From.Y);
+
+			MinX = FMath::Min(MinX, X);
+			MaxX = FMath::Max(MaxX, X);
+		}
+
+		if (MinX > MaxX)
+			continue;
+
+		FillSpan(Y, FMath::Max(FMath::CeilToInt32(MinX - 0.5), 0), FMath::Min(FMath::FloorToInt32(MaxX - 0.5) + 1, Resolution));
+	}
+}
+
+void FFogOfWarDiscoveredAreaBitmask::FillTriangleFan(const FVector2D& Centre, TArrayView<const FVector2D> Vertices)
+{
+	for (int32 Index = 1; Index < Vertices.Num() && !IsFull(); ++Index)
+		FillTriangle(Centre, Vertices[Index - 1], Vertices[Index]);
+}
+
+void FFogOfWarDiscoveredAreaBitmask::FillSpan(int32 Y, int32 X0, int32 X1)
+{
+	if (X0 >= X1)
+		return;
+
+	uint64* Row = Words.GetData() + Y * WordsPerRow;
+
+	int32* RowSubTileCounts = SubTileCounts.GetData() + (Y / SubTileSize) * WordsPerRow;
+
+	int32 LastWord = (X1 - 1) / 64;
+
+	int32 NewTexels = 0;
+
+	for (int32 Word = X0 / 64; Word <= LastWord; ++Word)
+	{
+		int32 Start = FMath::Max(X0 - Word * 64, 0);
+		int32 End = FMath::Min(X1 - Word * 64, 64);
+
+		//Bits Start -> End (exclusive) of this word
+		uint64 Mask = (End == 64 ? ~uint64(0) : (uint64(1) << End) - 1) & ~((uint64(1) << Start) - 1);
+
+		uint64 NewBits = Mask & ~Row[Word];
+
+		if (!NewBits)
+			continue;
+
+		int32 NewWordTexels = FMath::CountBits(NewBits);
+
+		NewTexels += NewWordTexels;
+
+		RowSubTileCounts[Word] += NewWordTexels;
+
+		Row[Word] |= NewBits;
+	}
+
+	if (NewTexels == 0)
+		return;
+
+	NumSetTexels += NewTexels;
+
+	FIntRect SpanRect{ X0, Y, X1, Y + 1 };
+
+	if (IsDirty())
+		DirtyRect.Union(SpanRect);
+	else
+		DirtyRect = SpanRect;
+
+	//Nothing more can change, so only the count is needed from now on
+	if (IsFull())
+	{
+		Words.Empty();
+
+		SubTileCounts.Empty();
+	}
+}
+
+void FFogOfWarDiscoveredAreaBitmask::ExpandRect(const FIntRect& Rect, uint8* OutTexels) const
+{
+	check(Rect.Min.X >= 0 && Rect.Min.Y >= 0 && Rect.Max.X <= Resolution && Rect.Max.Y <= Resolution);
+
+	if (IsFull())
+	{
+		FMemory::Memset(OutTexels, 255, Rect.Area());
+		return;
+	}
+
+	for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; ++Y)
+	{
+		const uint64* Row = Words.GetData() + Y * WordsPerRow;
+
+		for (int32 X = Rect.Min.X; X < Rect.Max.X; ++X)
+			*OutTexels++ = ((Row[X / 64] >> (X % 64)) & 1) ? 255 : 0;
+	}
+}
@@ -10,6 +10,10 @@
 #include "FogOfWarUtils.h"
 #include "Kismet/KismetRenderingLibrary.h"
 #include "FogOfWarActor.h"
+#include "Engine/Texture2D.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Discovered Area Texels Uploaded"), STAT_FogOfWarDiscoveredAreaTexelsUploaded, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Discovered Area Complete Skips"), STAT_FogOfWarDiscoveredAreaCompleteSkips, STATGROUP_FogOfWar);
 
 static TAutoConsoleVariable<float> FogOfWarOpacity
 (
@@ -44,32 +48,60 @@ void UFogOfWarDisplayComponent::TickComponent(float DeltaTime, ELevelTick TickTy
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	UpdateFogOfWar(DeltaTime);
-}
+	TimeSinceDisplayUpdate += DeltaTime;
 
-void UFogOfWarDisplayComponent::UpdateFogOfWar(float DeltaTime)
-{
 	if (!GetOwner()->HasActiveCameraComponent())
 		//Don't do any rendering if there is no active camera component to see it
 		return;
 
+	float UpdateInterval = DisplayUpdateRate > 0.f ? 1.f / DisplayUpdateRate : 0.f;
+
+	if (TimeSinceDisplayUpdate >= UpdateInterval)
+	{
+		UpdateFogOfWar(TimeSinceDisplayUpdate);
+
+		TimeSinceDisplayUpdate = 0.f;
+	}
+
+	ApplyPostProcessMaterialParameters();
+}
+
+void UFogOfWarDisplayComponent::UpdateFogOfWar(float DeltaTime)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(UpdateFogOfWar);
+
 	//Src now contains previous frames update, which can now be used for temporal fading.
 	Swap(DisplaySrc, DisplayDest);
 
+	//The last final display becomes the one the material blends from
+	Swap(PreviousDisplayRenderTarget, BlurPassYRenderTarget);
+
+	PreviousDisplayCanvasTransform = PreviousCanvasTransform;
+
 	auto DisplayCanvasTransform = GetDisplayCanvasTransform();
 
 	auto DisplayCanvasBounds = FogOfWarUtils::GetCanvasBounds(DisplayCanvasTransform);
 
-	auto DisplayCanvas = FogOfWarUtils::BeginDrawingCanvas(GetWorld(), DisplayCanvasTransform, DisplayDest);
+	bool bDrawVisionAtlas = bUseCompositorAtlas && UFogOfWarVisionComponent::IsVisibilityPolygonEnabled();
+
+	//Atlas tiles stay valid until the next batch, so composites can be deferred and flushed once per batch instead of once per vision component
+	bDeferDiscoveredAreaDrawing = bDrawVisionAtlas;
+
+	auto DisplayCanvas = FogOfWarUtils::BeginDrawingCanvas(GetWorld(), DisplayCanvasTransform, DisplayDest, bDrawVisionAtlas ? FCanvas::CDM_DeferDrawing : FCanvas::CDM_ImmediateDrawing);
 
 	DisplayCanvas.Clear(FLinearColor::Black);
 
-	for (auto VisionComponent : VisionComponents)
-		VisionComponent->DrawVision(this, DisplayCanvas);
+	if (bDrawVisionAtlas)
+		DrawVisionAtlas(DisplayCanvas);
+	else
+		for (auto VisionComponent : VisionComponents)
+			VisionComponent->DrawVision(this, DisplayCanvas);
 
 	//If any vision components rendered to discovered areas, end their canvases so we can render the result to the display
 	EndDrawDiscoveredAreas();
 
+	UpdateDiscoveredAreaTextures(WorldToDiscoveredAreas(DisplayCanvasBounds));
+
 	if (bForceAllDiscovered)
 		FogOfWarUtils::DrawColoredQuad(DisplayCanvas, DisplayCanvasTransform, FLinearColor::White * DiscoveredAreasOpacity, SE_BLEND_Additive);
 	else
@@ -82,7 +114,20 @@ void UFogOfWarDisplayComponent::UpdateFogOfWar(float DeltaTime)
 				//Nothing there, defaults to black
 				return;
 
-			FogOfWarUtils::DrawTexturedQuad(DisplayCanvas, GetDiscoveredAreasCanvasTransform(Cell), DiscoveredArea->RenderTarget, FLinearColor::White * DiscoveredAreasOpacity, SE_BLEND_Additive);
+			auto CellTransform = GetDiscoveredAreasCanvasTransform(Cell);
+
+			if (DiscoveredArea->Bitmask && DiscoveredArea->Bitmask->IsFull())
+			{
+				//Fully discovered cells don't keep a texture
+				FogOfWarUtils::DrawColoredQuad(DisplayCanvas, CellTransform, FLinearColor::White * DiscoveredAreasOpacity, SE_BLEND_Additive);
+				return;
+			}
+
+			if (DiscoveredArea->RenderTarget)
+				FogOfWarUtils::DrawTexturedQuad(DisplayCanvas, CellTransform, DiscoveredArea->RenderTarget, FLinearColor::White * DiscoveredAreasOpacity, SE_BLEND_Additive);
+
+			if (DiscoveredArea->Texture)
+				FogOfWarUtils::DrawTexturedQuad(DisplayCanvas, CellTransform, DiscoveredArea->Texture, FLinearColor::White * DiscoveredAreasOpacity, SE_BLEND_Additive);
 		};
 
 		ForEachDiscoveredArea(WorldToDiscoveredAreas(DisplayCanvasBounds), DrawDiscoveredAreas);
@@ -100,11 +145,141 @@ void UFogOfWarDisplayComponent::UpdateFogOfWar(float DeltaTime)
 	DrawBlurPass();
 
 	PreviousCanvasTransform = DisplayCanvasTransform;
-
-	ApplyPostProcessMaterialParameters();
 }
 
 
+void UFogOfWarDisplayComponent::DrawVisionAtlas(FCanvas& DisplayCanvas)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(DrawVisionAtlas);
+
+	TArray<UFogOfWarVisionComponent*, TInlineAllocator<64>> DrawingComponents;
+
+	for (auto VisionComponent : VisionComponents)
+		if (IsValid(VisionComponent))
+			DrawingComponents.Add(VisionComponent);
+
+	if (DrawingComponents.Num() == 0)
+		return;
+
+	int32 MaxTilesPerSide = FMath::Max(1, MaxCompositorAtlasResolution / CompositorResolution);
+
+	int32 TilesPerSide = FMath::Min(FMath::CeilToInt32(FMath::Sqrt(double(DrawingComponents.Num()))), MaxTilesPerSide);
+
+	//Only ever grows, so that the number of vision components going up and down doesn't keep recreating it
+	if (!CompositorAtlasRenderTarget || CompositorAtlasRenderTarget->SizeX < TilesPerSide * CompositorResolution)
+	{
+		CompositorAtlasRenderTarget = FogOfWarUtils::CreateRenderTarget(this, TilesPerSide * CompositorResolution);
+
+		CompositorAtlasTiles.Reset();
+	}
+
+	TilesPerSide = CompositorAtlasRenderTarget->SizeX / CompositorResolution;
+
+	int32 TilesPerBatch = TilesPerSide * TilesPerSide;
+
+	if (DrawingComponents.Num() > TilesPerBatch)
+	{
+		//Not enough room for everyone to keep their own tile, so nothing drawn in the atlas survives to the next frame
+		CompositorAtlasTiles.Reset();
+
+		for (int32 BatchStart = 0; BatchStart < DrawingComponents.Num(); BatchStart += TilesPerBatch)
+		{
+			int32 BatchEnd = FMath::Min(BatchStart + TilesPerBatch, DrawingComponents.Num());
+
+			auto GetTile = [&](int32 Index) { return FIntPoint{ (Index - BatchStart) % TilesPerSide, (Index - BatchStart) / TilesPerSide }; };
+
+			auto AtlasCanvas = FogOfWarUtils::BeginDrawingCanvas(GetWorld(), CompositorAtlasRenderTarget, FCanvas::CDM_DeferDrawing);
+
+			AtlasCanvas.Clear(FLinearColor::Black);
+
+			for (int32 Index = BatchStart; Index < BatchEnd; ++Index)
+			{
+				auto VisionComponent = DrawingComponents[Index];
+
+				//Each component gets its own base transform, but every tile is still drawn by the one flush at the end
+				AtlasCanvas.SetBaseTransform(VisionComponent->GetVisionCanvasTransform().ToInverseMatrixWithScale() * FogOfWarUtils::GetAtlasTileMatrix(GetTile(Index), TilesPerSide, CompositorResolution));
+
+				VisionComponent->DrawVisionArea(AtlasCanvas);
+			}
+
+			FogOfWarUtils::EndDrawingCanvas(AtlasCanvas, CompositorAtlasRenderTarget);
+
+			for (int32 Index = BatchStart; Index < BatchEnd; ++Index)
+				DrawingComponents[Index]->CompositeVision(this, DisplayCanvas, CompositorAtlasRenderTarget, FogOfWarUtils::GetAtlasTileUVs(GetTile(Index), TilesPerSide, CompositorResolution));
+
+			//The next batch draws over the atlas, so everything reading from this batch has to be flushed first
+			DisplayCanvas.Flush_GameThread();
+
+			EndDrawDiscoveredAreas();
+		}
+
+		return;
+	}
+
+	//Free the tiles of components that are no longer drawn, so they can be handed out again
+	TBitArray<> UsedTiles{ false, TilesPerBatch };
+
+	for (auto It = CompositorAtlasTiles.CreateIterator(); It; ++It)
+	{
+		auto VisionComponent = It->Key.Get();
+
+		if (!VisionComponent || !DrawingComponents.Contains(VisionComponent))
+			It.RemoveCurrent();
+		else
+			UsedTiles[It->Value.Tile.X + It->Value.Tile.Y * TilesPerSide] = true;
+	}
+
+	TArray<UFogOfWarVisionComponent*, TInlineAllocator<64>> RedrawingComponents;
+
+	for (auto VisionComponent : DrawingComponents)
+	{
+		auto& Tile = CompositorAtlasTiles.FindOrAdd(VisionComponent);
+
+		if (Tile.Tile == FIntPoint::NoneValue)
+		{
+			int32 FreeTile = UsedTiles.FindAndSetFirstZeroBit();
+
+			check(FreeTile != INDEX_NONE);
+
+			Tile.Tile = FIntPoint{ FreeTile % TilesPerSide, FreeTile / TilesPerSide };
+		}
+
+		VisionComponent->UpdateVisibilityPolygon();
+
+		if (Tile.VisionCacheVersion != VisionComponent->GetVisionCacheVersion())
+			RedrawingComponents.Add(VisionComponent);
+	}
+
+	//Stationary components with nothing changing around them keep what was drawn last frame, so often nothing needs drawing at all
+	if (RedrawingComponents.Num() > 0)
+	{
+		auto AtlasCanvas = FogOfWarUtils::BeginDrawingCanvas(GetWorld(), CompositorAtlasRenderTarget, FCanvas::CDM_DeferDrawing);
+
+		for (auto VisionComponent : RedrawingComponents)
+		{
+			auto& Tile = CompositorAtlasTiles.FindChecked(VisionComponent);
+
+			auto TileMatrix = FogOfWarUtils::GetAtlasTileMatrix(Tile.Tile, TilesPerSide, CompositorResolution);
+
+			//Clear only this tile, leaving the gutters and every other tile alone
+			AtlasCanvas.SetBaseTransform(TileMatrix);
+
+			FogOfWarUtils::DrawColoredQuad(AtlasCanvas, FTransform::Identity, FLinearColor::Black, SE_BLEND_Opaque);
+
+			AtlasCanvas.SetBaseTransform(VisionComponent->GetVisionCanvasTransform().ToInverseMatrixWithScale() * TileMatrix);
+
+			VisionComponent->DrawVisionArea(AtlasCanvas);
+
+			Tile.VisionCacheVersion = VisionComponent->GetVisionCacheVersion();
+		}
+
+		FogOfWarUtils::EndDrawingCanvas(AtlasCanvas, CompositorAtlasRenderTarget);
+	}
+
+	for (auto VisionComponent : DrawingComponents)
+		VisionComponent->CompositeVision(this, DisplayCanvas, CompositorAtlasRenderTarget, FogOfWarUtils::GetAtlasTileUVs(CompositorAtlasTiles.FindChecked(VisionComponent).Tile, TilesPerSide, CompositorResolution));
+}
+
 UTextureRenderTarget2D* UFogOfWarDisplayComponent::GetCompositorRenderTarget()
 {
 	return CompositorRenderTarget;
@@ -132,6 +307,8 @@ void UFogOfWarDisplayComponent::RemoveVisionComponent(UFogOfWarVisionComponent*
 		return;
 
 	VisionComponents.Remove(Component);
+
+	DiscoveredVisionVersions.Remove(Component);
 }
 
 FTransform UFogOfWarDisplayComponent::GetDisplayCanvasTransform() const
@@ -175,7 +352,9 @@ FCanvas& UFogOfWarDisplayComponent::BeginDrawDiscoveredArea(FIntPoint Cell)
 	if (!DiscoveredArea.RenderTarget)
 		DiscoveredArea.RenderTarget = FogOfWarUtils::CreateRenderTarget(this, DiscoveredAreaResolution);
 
-	DiscoveredArea.Canvas = MakeShared<FCanvas>(FogOfWarUtils::BeginDrawingCanvas(GetWorld(), GetDiscoveredAreasCanvasTransform(Cell), DiscoveredArea.RenderTarget));
+	auto DrawMode = bDeferDiscoveredAreaDrawing ? FCanvas::CDM_DeferDrawing : FCanvas::CDM_ImmediateDrawing;
+
+	DiscoveredArea.Canvas = MakeShared<FCanvas>(FogOfWarUtils::BeginDrawingCanvas(GetWorld(), GetDiscoveredAreasCanvasTransform(Cell), DiscoveredArea.RenderTarget, DrawMode));
 
 	return *DiscoveredArea.Canvas;
 }
@@ -188,10 +367,184 @@ void UFogOfWarDisplayComponent::EndDrawDiscoveredAreas()
 			continue;
 
 		FogOfWarUtils::EndDrawingCanvas(*DiscoveredArea.Canvas, DiscoveredArea.RenderTarget);
+
+		//Started again on the next draw, so that it picks up the current draw mode
+		DiscoveredArea.Canvas.Reset();
 	}
 }
 
+bool UFogOfWarDisplayComponent::IsUsingDiscoveredAreaBitmasks() const
+{
+	return bUseDiscoveredAreaBitmasks && UFogOfWarVisionComponent::IsVisibilityPolygonEnabled();
+}
+
+void UFogOfWarDisplayComponent::DiscoverVisionArea(UFogOfWarVisionComponent* Component, TArray<FIntPoint, TInlineAllocator<16>>& OutDiscoveredCells)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(DiscoverVisionArea);
+
+	Component->UpdateVisibilityPolygon();
+
+	auto& DiscoveredVersion = DiscoveredVisionVersions.FindOrAdd(Component);
+
+	if (DiscoveredVersion == Component->GetVisionCacheVersion())
+		//Nothing new can be discovered from the same vision
+		return;
+
+	DiscoveredVersion = Component->GetVisionCacheVersion();
+
+	const auto& Boundary = Component->GetVisibilityBoundary();
+
+	if (Boundary.Num() < 2)
+		return;
+
+	auto Centre = Component->GetVisibilityPolygon().GetCentre();
+
+	auto VisionBounds = Component->GetVisionCanvasBounds();
+
+	double InvTexelSize = 1.0 / DiscoveredAreaTexelSize;
+
+	TArray<FVector2D, TInlineAllocator<256>> TexelBoundary;
+
+	auto DiscoverCell = [&](FIntPoint Cell)
+	{
+		auto& DiscoveredArea = DiscoveredAreas.FindOrAdd(Cell);
+
+		if (!DiscoveredArea.Bitmask)
+		{
+			DiscoveredArea.Bitmask = MakeShared<FFogOfWarDiscoveredAreaBitmask>();
+
+			DiscoveredArea.Bitmask->Init(DiscoveredAreaResolution);
+		}
+
+		if (DiscoveredArea.Bitmask->IsFull())
+			return;
 
+		//Row 0 is at the top of the cell, the same as the cells render target
+		FVector2D TexelOrigin{ DiscoveredAreasToWorld(Cell).X, DiscoveredAreasToWorld(Cell + FIntPoint{ 0, 1 }).Y };
+
+		auto WorldToTexel = [&](const FVector2D& Position)
+		{
+			return FVector2D{ (Position.X - TexelOrigin.X) * InvTexelSize, (TexelOrigin.Y - Position.Y) * InvTexelSize };
+		};
+
+		auto TexelMin = WorldToTexel(FVector2D{ VisionBounds.Min.X, VisionBounds.Max.Y });
+		auto TexelMax = WorldToTexel(FVector2D{ VisionBounds.Max.X, VisionBounds.Min.Y });
+
+		FIntRect VisionTexels{ FMath::FloorToInt32(TexelMin.X), FMath::FloorToInt32(TexelMin.Y), FMath::CeilToInt32(TexelMax.X), FMath::CeilToInt32(TexelMax.Y) };
+
+		//Units patrolling explored ground stop here without rasterizing anything
+		if (DiscoveredArea.Bitmask->IsRectComplete(VisionTexels))
+		{
+			INC_DWORD_STAT(STAT_FogOfWarDiscoveredAreaCompleteSkips);
+			return;
+		}
+
+		TexelBoundary.Reset();
+
+		for (auto& Vertex : Boundary)
+			TexelBoundary.Add(WorldToTexel(Vertex));
+
+		int32 NumDiscovered = DiscoveredArea.Bitmask->NumSet();
+
+		DiscoveredArea.Bitmask->FillTriangleFan(WorldToTexel(Centre), TexelBoundary);
+
+		if (DiscoveredArea.Bitmask->NumSet() > NumDiscovered)
+			OutDiscoveredCells.Add(Cell);
+	};
+
+	ForEachDiscoveredArea(WorldToDiscoveredAreas(VisionBounds), DiscoverCell);
+}
+
+bool UFogOfWarDisplayComponent::IsDiscoveredAreaComplete(FIntPoint Cell) const
+{
+	auto DiscoveredArea = DiscoveredAreas.Find(Cell);
+
+	return DiscoveredArea && DiscoveredArea->Bitmask && DiscoveredArea->Bitmask->IsFull();
+}
+
+void UFogOfWarDisplayComponent::UpdateDiscoveredAreaTextures(const FIntRect& VisibleCells)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(UpdateDiscoveredAreaTextures);
+
+	for (auto& [Cell, DiscoveredArea] : DiscoveredAreas)
+	{
+		if (!DiscoveredArea.Bitmask)
+			continue;
+
+		auto& Bitmask = *DiscoveredArea.Bitmask;
+
+		auto DirtyRect = Bitmask.GetDirtyRect();
+
+		Bitmask.ClearDirty();
+
+		if (Bitmask.IsFull())
+		{
+			//Drawn as a solid quad from now on
+			ReleaseDiscoveredAreaTexture(DiscoveredArea);
+
+			DiscoveredArea.RenderTarget = nullptr;
+
+			continue;
+		}
+
+		//Render targets have the vision drawn into them instead
+		if (!IsUsingDiscoveredAreaBitmasks())
+			continue;
+
+		//The bitmask is the record of what was discovered, so cells off the display don't need a texture until they come back onto it
+		if (!VisibleCells.Contains(Cell))
+		{
+			ReleaseDiscoveredAreaTexture(DiscoveredArea);
+			continue;
+		}
+
+		if (!DiscoveredArea.Texture)
+		{
+			while (FreeDiscoveredAreaTextures.Num() > 0 && !DiscoveredArea.Texture)
+			{
+				auto Texture = FreeDiscoveredAreaTextures.Pop(false);
+
+				if (IsValid(Texture) && Texture->GetSizeX() == Bitmask.GetResolution())
+					DiscoveredArea.Texture = Texture;
+			}
+
+			if (!DiscoveredArea.Texture)
+				DiscoveredArea.Texture = FogOfWarUtils::CreateTexture(Bitmask.GetResolution());
+
+			//A new or reused texture doesn't hold this cell, so the first upload covers all of it
+			DirtyRect = FIntRect{ 0, 0, Bitmask.GetResolution(), Bitmask.GetResolution() };
+		}
+
+		if (DirtyRect.Area() <= 0)
+			continue;
+
+		//Both are freed by the render thread once the upload is done
+		auto Region = new FUpdateTextureRegion2D{ uint32(DirtyRect.Min.X), uint32(DirtyRect.Min.Y), 0, 0, uint32(DirtyRect.Width()), uint32(DirtyRect.Height()) };
+
+		auto Texels = (uint8*)FMemory::Malloc(DirtyRect.Area());
+
+		Bitmask.ExpandRect(DirtyRect, Texels);
+
+		DiscoveredArea.Texture->UpdateTextureRegions(0, 1, Region, DirtyRect.Width(), 1, Texels,
+			[](uint8* SrcData, const FUpdateTextureRegion2D* Regions)
+			{
+				FMemory::Free(SrcData);
+				delete Regions;
+			});
+
+		INC_DWORD_STAT_BY(STAT_FogOfWarDiscoveredAreaTexelsUploaded, DirtyRect.Area());
+	}
+}
+
+void UFogOfWarDisplayComponent::ReleaseDiscoveredAreaTexture(FDiscoveredAreasCell& DiscoveredArea)
+{
+	if (!DiscoveredArea.Texture)
+		return;
+
+	FreeDiscoveredAreaTextures.Add(DiscoveredArea.Texture);
+
+	DiscoveredArea.Texture = nullptr;
+}
 
 void UFogOfWarDisplayComponent::UpdateDiscoveredAreaCellSize()
 {
@@ -218,6 +571,8 @@ void UFogOfWarDisplayComponent::InitializeBlurPassResources()
 
 	BlurPassYRenderTarget = FogOfWarUtils::CreateRenderTarget(this, DisplayResolution);
 
+	PreviousDisplayRenderTarget = FogOfWarUtils::CreateRenderTarget(this, DisplayResolution);
+
 	//Half of a symmetric 7 sample gaussian kernel
 	FVector4 KernelWeights
 	{
@@ -293,16 +648,29 @@ void UFogOfWarDisplayComponent::ApplyPostProcessMaterialParameters()
 {
 	//Remap canvas transform from -1 -> 1 to 0 -> 1
 	//Saves a tiny bit of math for every pixel on screen so might as well do it here.
-	auto CanvasTransform = GetDisplayCanvasTransform();
+	auto GetVisionBasis = [](FTransform CanvasTransform, FVector4& OutInvScale, FVector4& OutTranslation)
+	{
+		CanvasTransform.AddToTranslation(CanvasTransform.GetScale3D() * FVector { -1.f, 1.f, 0.f });
+
+		//Flip Y again to match world space
+		CanvasTransform.MultiplyScale3D(FVector{ 2.f, -2.f, 1.f });
+
+		OutInvScale = CanvasTransform.GetScale3D().Reciprocal();
+
+		OutTranslation = CanvasTransform.GetLocation();
+	};
+
+	//Each texture is mapped through the transform it was drawn with, so it stays fixed in the world while the display moves between updates
+	FVector4 VisionBasisInvScale, VisionBasisTranslation;
 
-	CanvasTransform.AddToTranslation(CanvasTransform.GetScale3D() * FVector { -1.f, 1.f, 0.f });
+	GetVisionBasis(PreviousCanvasTransform, VisionBasisInvScale, VisionBasisTranslation);
 
-	//Flip Y again to match world space
-	CanvasTransform.MultiplyScale3D(FVector{ 2.f, -2.f, 1.f });
+	FVector4 PreviousVisionBasisInvScale, PreviousVisionBasisTranslation;
 
-	FVector4 VisionBasisInvScale = CanvasTransform.GetScale3D().Reciprocal();
+	GetVisionBasis(PreviousDisplayCanvasTransform, PreviousVisionBasisInvScale, PreviousVisionBasisTranslation);
 
-	FVector4 VisionBasisTranslation = CanvasTransform.GetLocation();
+	//0 shows the previous display, 1 the latest. Reaches the latest just as the next update is due, which delays the display by one update interval.
+	float VisionBlendAlpha = DisplayUpdateRate > 0.f ? FMath::Clamp(TimeSinceDisplayUpdate * DisplayUpdateRate, 0.f, 1.f) : 1.f;
 
 	for (const auto& Component : GetOwner()->GetComponents())
 	{
@@ -340,6 +708,10 @@ void UFogOfWarDisplayComponent::ApplyPostProcessMaterialParameters()
 			DynamicInstance->SetVectorParameterValue("VisionBasisInvScale", VisionBasisInvScale);
 			DynamicInstance->SetVectorParameterValue("VisionBasisTranslation", VisionBasisTranslation);
 			DynamicInstance->SetTextureParameterValue("VisionTexture", BlurPassYRenderTarget);
+			DynamicInstance->SetVectorParameterValue("PreviousVisionBasisInvScale", PreviousVisionBasisInvScale);
+			DynamicInstance->SetVectorParameterValue("PreviousVisionBasisTranslation", PreviousVisionBasisTranslation);
+			DynamicInstance->SetTextureParameterValue("PreviousVisionTexture", PreviousDisplayRenderTarget);
+			DynamicInstance->SetScalarParameterValue("VisionBlendAlpha", VisionBlendAlpha);
 			DynamicInstance->SetScalarParameterValue("FogOfWarOpacity", FogOfWarOpacity.GetValueOnGameThread());
 
 		}
@@ -141,6 +141,13 @@ FTransform AFogOfWarManager::GetDiscoveredAreaCanvasTransform() const
 	return FogOfWarUtils::GetCanvasTransform(DiscoveredAreaBounds);
 }
 
+FBox2D AFogOfWarManager::GetDiscoveredAreaWorldBounds() const
+{
+	auto Box = DiscoveredAreaBounds->Bounds.GetBox();
+
+	return FBox2D{ FVector2D{ Box.Min }, FVector2D{ Box.Max } };
+}
+
 void AFogOfWarManager::RegisterVisionComponent(UFogOfWarVisionComponent* Component)
 {
 	if (!Component)
@@ -0,0 +1,123 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "FogOfWarOccluderCommandlet.h"
+#include "FogOfWarOccluderUserData.h"
+#include "FogOfWarOccluderComponent.h"
+#include "CollisionChannels.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "UObject/SavePackage.h"
+
+UFogOfWarOccluderCommandlet::UFogOfWarOccluderCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UFogOfWarOccluderCommandlet::Main(const FString& Params)
+{
+#if WITH_EDITOR
+	auto& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>("AssetRegistry").Get();
+
+	AssetRegistry.SearchAllAssets(true);
+
+	TArray<FAssetData> Maps;
+
+	AssetRegistry.GetAssetsByClass(UWorld::StaticClass()->GetClassPathName(), Maps);
+
+	TSet<UStaticMesh*> OccluderMeshes;
+
+	for (auto& Map : Maps)
+	{
+		if (!Map.PackageName.ToString().StartsWith(TEXT("/Game/")))
+			continue;
+
+		auto World = Cast<UWorld>(Map.GetAsset());
+
+		if (!World || !World->PersistentLevel)
+			continue;
+
+		//Same test that UFogOfWarSubsystem uses to gather static occluders, plus the meshes that dynamic occluders cast shadows from
+		for (auto Actor : World->PersistentLevel->Actors)
+		{
+			if (!IsValid(Actor))
+				continue;
+
+			for (auto Component : Actor->GetComponents())
+			{
+				if (auto OccluderComponent = Cast<UFogOfWarOccluderComponent>(Component))
+				{
+					if (OccluderComponent->GetOccluderMesh())
+						OccluderMeshes.Add(OccluderComponent->GetOccluderMesh());
+				}
+				else if (auto StaticMeshComponent = Cast<UStaticMeshComponent>(Component))
+				{
+					if (StaticMeshComponent->GetStaticMesh() && StaticMeshComponent->GetCollisionResponseToChannel(ECC_FogOfWar) != ECollisionResponse::ECR_Ignore)
+						OccluderMeshes.Add(StaticMeshComponent->GetStaticMesh());
+				}
+			}
+		}
+	}
+
+	int32 NumSaved = 0;
+
+	int32 NumFailed = 0;
+
+	for (auto StaticMesh : OccluderMeshes)
+	{
+		auto Package = StaticMesh->GetPackage();
+
+		if (!Package->GetName().StartsWith(TEXT("/Game/")))
+		{
+			if (!StaticMesh->bAllowCPUAccess)
+				UE_LOG(LogTemp, Warning, TEXT("Fog of war occluder %s is not project content, so its edges can't be cooked. Use a copy of it in the project, or enable bAllowCPUAccess."), *Package->GetName());
+
+			continue;
+		}
+
+		auto UserData = StaticMesh->GetAssetUserData<UFogOfWarOccluderUserData>();
+
+		bool bAddedUserData = !UserData;
+
+		if (bAddedUserData)
+		{
+			UserData = NewObject<UFogOfWarOccluderUserData>(StaticMesh, NAME_None, RF_Transactional);
+
+			StaticMesh->AddAssetUserData(UserData);
+		}
+
+		//Meshes whose edges are already up to date are left unsaved
+		if (!UserData->CookShadowEdges() && !bAddedUserData)
+			continue;
+
+		FString Filename = FPackageName::LongPackageNameToFilename(Package->GetName(), FPackageName::GetAssetPackageExtension());
+
+		FSavePackageArgs SaveArgs;
+
+		SaveArgs.TopLevelFlags = RF_Standalone;
+
+		if (UPackage::SavePackage(Package, nullptr, *Filename, SaveArgs))
+		{
+			UE_LOG(LogTemp, Display, TEXT("Cooked fog of war occluder edges into %s"), *Package->GetName());
+
+			++NumSaved;
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to save fog of war occluder %s"), *Filename);
+
+			++NumFailed;
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("Found %d fog of war occluder meshes in %d maps, saved %d"), OccluderMeshes.Num(), Maps.Num(), NumSaved);
+
+	return NumFailed > 0 ? 1 : 0;
+#else
+	return 1;
+#endif
+}
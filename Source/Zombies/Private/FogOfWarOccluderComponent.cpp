@@ -0,0 +1,88 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "FogOfWarOccluderComponent.h"
+#include "FogOfWarSubsystem.h"
+#include "FogOfWarOccluderSubsystem.h"
+
+UFogOfWarOccluderComponent::UFogOfWarOccluderComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	//Moves are pushed to the subsystem as they happen, instead of it polling every occluder each frame
+	bWantsOnUpdateTransform = true;
+}
+
+void UFogOfWarOccluderComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	RegisterOccluder();
+}
+
+void UFogOfWarOccluderComponent::EndPlay(EEndPlayReason::Type Reason)
+{
+	Super::EndPlay(Reason);
+
+	UnregisterOccluder();
+}
+
+void UFogOfWarOccluderComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+
+	if (OccluderID == INDEX_NONE)
+		return;
+
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+		Subsystem->MoveDynamicOccluder(OccluderID, GetComponentTransform());
+}
+
+void UFogOfWarOccluderComponent::SetOccluderMesh(UStaticMesh* NewOccluderMesh)
+{
+	if (OccluderMesh == NewOccluderMesh)
+		return;
+
+	OccluderMesh = NewOccluderMesh;
+
+	if (!HasBegunPlay())
+		return;
+
+	UnregisterOccluder();
+
+	RegisterOccluder();
+}
+
+void UFogOfWarOccluderComponent::RegisterOccluder()
+{
+	if (OccluderID != INDEX_NONE || !OccluderMesh)
+		return;
+
+	auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>();
+
+	auto GI = GetWorld()->GetGameInstance();
+
+	auto OccluderSubsystem = GI ? GI->GetSubsystem<UFogOfWarOccluderSubsystem>() : nullptr;
+
+	if (!Subsystem || !OccluderSubsystem)
+		return;
+
+	FFogOfWarOccluderInstance Instance;
+
+	Instance.Transform = GetComponentTransform();
+
+	Instance.OccluderMesh = OccluderSubsystem->GetOccluderMesh(OccluderMesh);
+
+	OccluderID = Subsystem->AddDynamicOccluder(MoveTemp(Instance));
+}
+
+void UFogOfWarOccluderComponent::UnregisterOccluder()
+{
+	if (OccluderID == INDEX_NONE)
+		return;
+
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+		Subsystem->RemoveDynamicOccluder(OccluderID);
+
+	OccluderID = INDEX_NONE;
+}
@@ -2,6 +2,7 @@
 
 
 #include "FogOfWarOccluderSubsystem.h"
+#include "FogOfWarOccluderUserData.h"
 
 TFogOfWarSharedPtr<FFogOfWarOccluderMesh> UFogOfWarOccluderSubsystem::GetOccluderMesh(UStaticMesh* StaticMesh)
 {
@@ -11,21 +12,53 @@ TFogOfWarSharedPtr<FFogOfWarOccluderMesh> UFogOfWarOccluderSubsystem::GetOcclude
 	if (auto OccluderMesh = OccluderMeshes.Find(StaticMesh))
 		return *OccluderMesh;
 
-	if (!StaticMesh->bAllowCPUAccess)
+	auto OccluderMesh = MakeShared<FFogOfWarOccluderMesh, FogOfWarSPMode>();
+
+	auto UserData = StaticMesh->GetAssetUserData<UFogOfWarOccluderUserData>();
+
+	if (UserData && UserData->HasCookedShadowEdges())
+		//Saved with the mesh, so the render data doesn't need to be read at all
+		UserData->GetCookedShadowEdges(OccluderMesh->ShadowEdges);
+	else
 	{
-		FMessageLog("AssetCheck").Error(FText::FromString(FString::Printf(TEXT("Static Mesh asset %s is used as fog of war shadow occluder but does not have bAllowCPUAccess flag enabled"), *StaticMesh->GetPackage()->GetPathName())));
+		if (!StaticMesh->bAllowCPUAccess)
+		{
+#if WITH_EDITOR
+			//In editor, the mesh data is always available even if not allowing CPU access, so the edges are built for this session only and the asset is left alone.
+			//Still warn, so that we can see this mesh won't work before we package it. The FogOfWarOccluder commandlet cooks the edges into the mesh.
+			FMessageLog("AssetCheck").Warning(FText::FromString(FString::Printf(TEXT("Static Mesh asset %s is used as fog of war shadow occluder but has neither cooked shadow edges in a Fog Of War Occluder asset user data, nor the bAllowCPUAccess flag enabled. Run the FogOfWarOccluder commandlet to cook its edges before packaging."), *StaticMesh->GetPackage()->GetPathName())));
+#else
+			FMessageLog("AssetCheck").Error(FText::FromString(FString::Printf(TEXT("Static Mesh asset %s is used as fog of war shadow occluder but has neither cooked shadow edges in a Fog Of War Occluder asset user data, nor the bAllowCPUAccess flag enabled"), *StaticMesh->GetPackage()->GetPathName())));
+
+			return {};
+#endif
+		}
 
-		//In editor, the mesh data is always available even if not allowing CPU access.
-		//However, we still want to reject it so that we can see this mesh doesn't work before we package it and CPU access flag becomes relevant.
-		return {};
+		BuildShadowEdges(StaticMesh, *OccluderMesh);
 	}
 
-	auto OccluderMesh = MakeShared<FFogOfWarOccluderMesh, FogOfWarSPMode>();
+	OccluderMesh->UpdateBounds();
+
+	if (OccluderMesh->ShadowEdges.Num() > 0)
+	{
+		OccluderMeshes.Add(StaticMesh, OccluderMesh);
+
+		return OccluderMesh;
+	}
+	else
+		return nullptr;
+}
+
+int32 UFogOfWarOccluderSubsystem::BuildShadowEdges(UStaticMesh* StaticMesh, FFogOfWarOccluderMesh& OutOccluderMesh)
+{
+	check(StaticMesh);
+
+	OutOccluderMesh.ShadowEdges.Reset();
 
 	auto RenderData = StaticMesh->GetRenderData();
 
 	if (!RenderData || RenderData->LODResources.Num() == 0)
-		return OccluderMesh;
+		return 0;
 
 	//Cast shadows using LOD 0
 	auto& LODResource = RenderData->LODResources[0];
@@ -86,21 +119,27 @@ TFogOfWarSharedPtr<FFogOfWarOccluderMesh> UFogOfWarOccluderSubsystem::GetOcclude
 		if (Edges.Contains({ To, From }))
 			continue;
 
-		OccluderMesh->ShadowEdges.Add({ From,To });
-
-		OccluderMesh->Bounds += From;
-		OccluderMesh->Bounds += To;
+		OutOccluderMesh.ShadowEdges.Add({ From,To });
 
 		//DrawDebugDirectionalArrow(GetWorld(), FVector{ From, 100.f }, FVector{ To, 100.f }, 10.f, Edges.Contains({ To, From }) ? FColor::Red : FColor::Green, true);
 
 	}
 
-	if (OccluderMesh->ShadowEdges.Num() > 0)
+	int32 NumTriangleEdges = OutOccluderMesh.ShadowEdges.Num();
+
+	auto UserData = StaticMesh->GetAssetUserData<UFogOfWarOccluderUserData>();
+
+	bool bMergeCollinearEdges = UserData ? UserData->bMergeCollinearEdges : true;
+
+	double SimplifyTolerance = UserData ? UserData->SimplifyTolerance : 0.0;
+
+	//Every shadow edge is two shadow triangles per vision component, so tessellated walls are worth joining back up
+	if (bMergeCollinearEdges || SimplifyTolerance > 0.0)
 	{
-		OccluderMeshes.Add(StaticMesh, OccluderMesh);
+		OutOccluderMesh.SimplifyShadowEdges(SimplifyTolerance);
 
-		return OccluderMesh;
+		UE_LOG(LogTemp, Log, TEXT("Fog of war occluder %s simplified from %d to %d shadow edges"), *StaticMesh->GetName(), NumTriangleEdges, OutOccluderMesh.ShadowEdges.Num());
 	}
-	else
-		return nullptr;
+
+	return NumTriangleEdges;
 }
@@ -0,0 +1,80 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "FogOfWarOccluderUserData.h"
+#include "FogOfWarOccluderSubsystem.h"
+#include "Engine/StaticMesh.h"
+#include "UObject/ObjectSaveContext.h"
+
+#if WITH_EDITOR
+#include "StaticMeshCompiler.h"
+#endif
+
+void UFogOfWarOccluderUserData::GetCookedShadowEdges(TArray<TPair<FVector2D, FVector2D>>& OutShadowEdges) const
+{
+	OutShadowEdges.Reset(CookedShadowEdges.Num() / 2);
+
+	for (int32 Index = 0; Index + 1 < CookedShadowEdges.Num(); Index += 2)
+		OutShadowEdges.Add({ CookedShadowEdges[Index], CookedShadowEdges[Index + 1] });
+}
+
+#if WITH_EDITOR
+
+void UFogOfWarOccluderUserData::PreSave(FObjectPreSaveContext ObjectSaveContext)
+{
+	Super::PreSave(ObjectSaveContext);
+
+	//Saved with the mesh, including when it is cooked, so the edges always match the mesh they were saved with
+	CookShadowEdges();
+}
+
+void UFogOfWarOccluderUserData::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	CookShadowEdges();
+}
+
+void UFogOfWarOccluderUserData::PostEditChangeOwner()
+{
+	Super::PostEditChangeOwner();
+
+	CookShadowEdges();
+}
+
+bool UFogOfWarOccluderUserData::CookShadowEdges()
+{
+	auto StaticMesh = Cast<UStaticMesh>(GetOuter());
+
+	if (!StaticMesh)
+		return false;
+
+	//A reimport rebuilds the render data asynchronously, and the edges have to come from the new data
+	if (StaticMesh->IsCompiling())
+		FStaticMeshCompilingManager::Get().FinishCompilation({ StaticMesh });
+
+	FFogOfWarOccluderMesh OccluderMesh;
+
+	int32 NewNumSourceShadowEdges = UFogOfWarOccluderSubsystem::BuildShadowEdges(StaticMesh, OccluderMesh);
+
+	TArray<FVector2D> NewCookedShadowEdges;
+
+	NewCookedShadowEdges.Reserve(OccluderMesh.ShadowEdges.Num() * 2);
+
+	for (auto& [From, To] : OccluderMesh.ShadowEdges)
+	{
+		NewCookedShadowEdges.Add(From);
+		NewCookedShadowEdges.Add(To);
+	}
+
+	if (NewCookedShadowEdges == CookedShadowEdges && NewNumSourceShadowEdges == NumSourceShadowEdges)
+		return false;
+
+	CookedShadowEdges = MoveTemp(NewCookedShadowEdges);
+
+	NumSourceShadowEdges = NewNumSourceShadowEdges;
+
+	return true;
+}
+
+#endif
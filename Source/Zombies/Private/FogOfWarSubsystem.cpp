@@ -7,6 +7,53 @@
 #include "EngineUtils.h"
 #include "FogOfWarUtils.h"
 #include "CollisionChannels.h"
+#include "FogOfWarManager.h"
+#include "FogOfWarVisionComponent.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/LevelBounds.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Fog Of War Actors Cells"), STAT_FogOfWarActorsCells, STATGROUP_SpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Fog Of War Actors Max Per Cell"), STAT_FogOfWarActorsMaxPerCell, STATGROUP_SpatialHash);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Fog Of War Actors Mean Per Cell"), STAT_FogOfWarActorsMeanPerCell, STATGROUP_SpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Static Occluders Cells"), STAT_StaticOccludersCells, STATGROUP_SpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Static Occluders Max Per Cell"), STAT_StaticOccludersMaxPerCell, STATGROUP_SpatialHash);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Static Occluders Mean Per Cell"), STAT_StaticOccludersMeanPerCell, STATGROUP_SpatialHash);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vision Components Updated"), STAT_FogOfWarVisionComponentsUpdated, STATGROUP_FogOfWar);
+
+static TAutoConsoleVariable<bool> FogOfWarVisionAsync
+(
+	TEXT("FogOfWar.Vision.Async"),
+	true,
+	TEXT("Find the actors that vision components can see on worker threads, applying the results on the next frame. Actors that are visible at their location are tested at their position in the fog of war actors map, other actors still go through IsFogOfWarVisible when the results are applied.")
+);
+
+static TAutoConsoleVariable<int32> FogOfWarVisionMaxUpdatesPerFrame
+(
+	TEXT("FogOfWar.Vision.MaxUpdatesPerFrame"),
+	0,
+	TEXT("Most vision components that update their visible actors each frame, or 0 for no limit. Components over the limit wait for a later frame.")
+);
+
+static TAutoConsoleVariable<float> FogOfWarOccludersGatherBudgetMs
+(
+	TEXT("FogOfWar.Occluders.GatherBudgetMs"),
+	2.f,
+	TEXT("Milliseconds per frame spent gathering static occluders from newly streamed in levels and publishing them once gathered. At least one actor is gathered each frame. 0 gathers and publishes every queued level at once.")
+);
+
+static FAutoConsoleCommandWithWorldAndArgs FogOfWarSpatialHashStatsCommand
+(
+	TEXT("FogOfWar.SpatialHashStats"),
+	TEXT("Logs the cell occupancy of the fog of war spatial hash maps, and suggests cell sizes for the fog of war manager. Optional argument is the target number of elements per cell, default 8."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		double TargetOccupancy = Args.Num() > 0 ? FCString::Atod(*Args[0]) : 8.0;
+
+		if (auto Subsystem = World ? World->GetSubsystem<UFogOfWarSubsystem>() : nullptr)
+			Subsystem->LogSpatialHashStats(TargetOccupancy > 0.0 ? TargetOccupancy : 8.0);
+	})
+);
 
 UFogOfWarSubsystem::UFogOfWarSubsystem()
 {
@@ -17,15 +64,62 @@ void UFogOfWarSubsystem::OnWorldBeginPlay(UWorld& InWorld)
 {
 	Super::OnWorldBeginPlay(InWorld);
 
-	//Allow any begin play construction to run first so it can be considered in static occluders
-	InWorld.GetTimerManager().SetTimerForNextTick(this, &UFogOfWarSubsystem::GatherStaticOccluders);
+	//Runs before any actor begin play, so no fog of war actors are registered yet
+	InitSpatialGrids();
+
+	//Gathered from the first tick, so that any begin play construction is considered in static occluders
+	for (auto Level : InWorld.GetLevels())
+		if (Level && Level->bIsVisible)
+			AddStaticOccluderLevel(Level);
+
+	LevelAddedToWorldHandle = FWorldDelegates::LevelAddedToWorld.AddUObject(this, &UFogOfWarSubsystem::OnLevelAddedToWorld);
+
+	LevelRemovedFromWorldHandle = FWorldDelegates::LevelRemovedFromWorld.AddUObject(this, &UFogOfWarSubsystem::OnLevelRemovedFromWorld);
+}
+
+void UFogOfWarSubsystem::Deinitialize()
+{
+	if (VisionQueriesTask.IsValid())
+		VisionQueriesTask.Wait();
+
+	VisionQueries.Empty();
+
+	VisionQueriesActorsSnapshot.Reset();
+
+	VisionQueriesOccludersSnapshot.Reset();
+
+	VisionQueriesOccluderEdges.Reset();
+
+	VisionQueriesDynamicOccludersSnapshot.Reset();
+
+	FWorldDelegates::LevelAddedToWorld.Remove(LevelAddedToWorldHandle);
+
+	FWorldDelegates::LevelRemovedFromWorld.Remove(LevelRemovedFromWorldHandle);
+
+	Super::Deinitialize();
 }
 
 void UFogOfWarSubsystem::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+	//Applied before the actors snapshot is published, so that the queries have let go of it and it can be reused
+	ApplyVisionQueries();
+
+	GatherPendingStaticOccluders();
+
+	PublishDynamicOccludersSnapshot();
+
 	UpdateFogOfWarActors();
+
+	PublishFogOfWarActorsSnapshot();
+
+	UpdateVisionComponents();
+
+#if STATS
+	if (FThreadStats::IsCollectingData())
+		UpdateSpatialHashStats();
+#endif
 }
 
 void UFogOfWarSubsystem::RegisterFogOfWarActor(AActor* Actor)
@@ -39,6 +133,8 @@ void UFogOfWarSubsystem::RegisterFogOfWarActor(AActor* Actor)
 	auto ID = FogOfWarActors.AddElementWorldSpace(FVector2D{ Actor->GetActorLocation() }, Actor);
 
 	IFogOfWarActor::Execute_SetFogOfWarActorID(Actor, ID);
+
+	bFogOfWarActorsChanged = true;
 }
 
 void UFogOfWarSubsystem::UnregisterFogOfWarActor(AActor* Actor)
@@ -48,77 +144,841 @@ void UFogOfWarSubsystem::UnregisterFogOfWarActor(AActor* Actor)
 
 	auto ID = IFogOfWarActor::Execute_GetFogOfWarActorID(Actor);
 
-	FogOfWarActors.RemoveElement(ID);
+	if (FogOfWarActors.RemoveElement(ID))
+		bFogOfWarActorsChanged = true;
 
 	IFogOfWarActor::Execute_SetFogOfWarActorID(Actor, -1);
 }
 
 void UFogOfWarSubsystem::UpdateFogOfWarActors()
 {
-	//Safe to modify position while iterating elements (but not cells)
+	UpdatedActorIDs.Reset();
+	UpdatedActorPositions.Reset();
+
 	for (auto It = FogOfWarActors.GetElements().CreateConstIterator(); It; ++It)
-		if (It->Value.IsValid())
-			FogOfWarActors.MoveElementWorldSpace(It.GetIndex(), FVector2D{ It->Value->GetActorLocation() });
-	
+	{
+		if (!It->Value.IsValid())
+			continue;
+
+		FVector2D Position{ It->Value->GetActorLocation() };
+
+		//Actors standing still are left out, so that a tick where nothing moved does not rebuild the snapshot
+		if (FogOfWarActors.WorldToLocal(Position) == It->Geometry)
+			continue;
+
+		UpdatedActorIDs.Add(It.GetIndex());
+		UpdatedActorPositions.Add(Position);
+	}
+
+	if (UpdatedActorIDs.Num() == 0)
+		return;
+
+	bFogOfWarActorsChanged = true;
+
+	//Move everything in one batch, so that actors changing cells are grouped by cell instead of being moved one at a time
+	FogOfWarActors.MoveElementsWorldSpace(UpdatedActorIDs, UpdatedActorPositions);
 }
 
-void UFogOfWarSubsystem::GatherStaticOccluders()
+void UFogOfWarSubsystem::InitSpatialGrids()
 {
-	StaticOccluders.Empty();
+	FVector2D StaticOccluderCellSize = StaticOccluders.GetCellSize();
 
-	auto DrawBox = [&](FBox2D Box, double Z, FColor Color)
+	FVector2D FogOfWarActorCellSize = FogOfWarActors.GetCellSize();
+
+	bSpatialGridsFromLevelBounds = true;
+
+	for (TActorIterator<AFogOfWarManager> It(GetWorld()); It; ++It)
 	{
+		if (!IsValid(*It))
+			continue;
+
+		SpatialGridsBounds = It->GetDiscoveredAreaWorldBounds();
+		StaticOccluderCellSize = It->StaticOccluderCellSize.ComponentMax(FVector2D::One());
+		FogOfWarActorCellSize = It->FogOfWarActorCellSize.ComponentMax(FVector2D::One());
+		bSpatialGridsFromLevelBounds = false;
+		break;
+	}
+
+	if (bSpatialGridsFromLevelBounds)
+	{
+		//Without a fog of war manager, cover the levels that are loaded now.
+		//Anything outside of the bounds, like levels streamed in later, still works, it just piles up in the border cells.
+		FBox LevelsBounds{ ForceInit };
+
+		for (auto Level : GetWorld()->GetLevels())
+			if (Level)
+				LevelsBounds += ALevelBounds::CalculateLevelBounds(Level);
+
+		if (!LevelsBounds.IsValid)
+			LevelsBounds = FBox{ FVector::ZeroVector, FVector::ZeroVector };
+
+		SpatialGridsBounds = FBox2D{ FVector2D{ LevelsBounds.Min }, FVector2D{ LevelsBounds.Max } };
+
+		//Huge actors like sky spheres can make the levels much bigger than where anything happens, so grow the cells rather than allocating that many
+		constexpr double MaxCellsPerAxis = 512.0;
+
+		FVector2D MinCellSize = SpatialGridsBounds.GetSize() / MaxCellsPerAxis;
+
+		StaticOccluderCellSize = StaticOccluderCellSize.ComponentMax(MinCellSize);
+
+		FogOfWarActorCellSize = FogOfWarActorCellSize.ComponentMax(MinCellSize);
+
+		UE_LOG(LogTemp, Log, TEXT("UFogOfWarSubsystem: No AFogOfWarManager in %s, sizing fog of war grids to the loaded levels %s"), *GetWorld()->GetName(), *SpatialGridsBounds.ToString());
+	}
+
+	StaticOccluders.SetBounds(SpatialGridsBounds, StaticOccluderCellSize);
 
-		FVector2D Center, Extent;
+	DynamicOccluders.SetBounds(SpatialGridsBounds, StaticOccluderCellSize);
+
+	FogOfWarActors.SetBounds(SpatialGridsBounds, FogOfWarActorCellSize);
+}
+
+void UFogOfWarSubsystem::LogSpatialHashStats(double TargetOccupancy) const
+{
+	auto LogMap = [&](const TCHAR* Name, const auto& Map)
+	{
+		auto Stats = Map.GetStats();
 
-		Box.GetCenterAndExtents(Center, Extent);
+		auto Suggested = Stats.SuggestCellSize(Map.GetCellSize(), TargetOccupancy);
 
-		DrawDebugBox(GetWorld(), FVector{ Center, Z }, FVector{ Extent, 0.0 }, Color, true);
+		UE_LOG(LogTemp, Display, TEXT("%s: cell size %s, %s\nSuggested cell size for %.1f per cell: %s"), Name, *Map.GetCellSize().ToString(), *Stats.ToString(), TargetOccupancy, *Suggested.ToString());
 	};
 
-	auto GI = GetWorld()->GetGameInstance();
+	LogMap(TEXT("Static occluders"), StaticOccluders);
 
-	if (!GI)
+	LogMap(TEXT("Fog of war actors"), FogOfWarActors);
+}
+
+void UFogOfWarSubsystem::UpdateSpatialHashStats() const
+{
+	auto ActorStats = FogOfWarActors.GetStats();
+
+	SET_DWORD_STAT(STAT_FogOfWarActorsCells, ActorStats.NumCells);
+	SET_DWORD_STAT(STAT_FogOfWarActorsMaxPerCell, ActorStats.MaxElementsPerCell);
+	SET_FLOAT_STAT(STAT_FogOfWarActorsMeanPerCell, ActorStats.GetMeanElementsPerCell());
+
+	auto OccluderStats = StaticOccluders.GetStats();
+
+	SET_DWORD_STAT(STAT_StaticOccludersCells, OccluderStats.NumCells);
+	SET_DWORD_STAT(STAT_StaticOccludersMaxPerCell, OccluderStats.MaxElementsPerCell);
+	SET_FLOAT_STAT(STAT_StaticOccludersMeanPerCell, OccluderStats.GetMeanElementsPerCell());
+}
+
+void UFogOfWarSubsystem::PublishFogOfWarActorsSnapshot()
+{
+	//The last snapshot still matches the map, and nothing ever writes to a published one
+	if (FogOfWarActorsSnapshot.IsValid() && !bFogOfWarActorsChanged)
 		return;
 
-	auto Subsystem = GI->GetSubsystem<UFogOfWarOccluderSubsystem>();
+	QUICK_SCOPE_CYCLE_COUNTER(PublishFogOfWarActorsSnapshot);
 
-	if (!Subsystem)
+	bFogOfWarActorsChanged = false;
+
+	if (!FogOfWarActorsSnapshot.IsValid() || !FogOfWarActorsSnapshot.IsUnique())
+		FogOfWarActorsSnapshot = MakeShared<FFogOfWarActorsSnapshot, ESPMode::ThreadSafe>();
+
+	FogOfWarActorsSnapshot->Build(FogOfWarActors);
+}
+
+void UFogOfWarSubsystem::RegisterVisionComponent(UFogOfWarVisionComponent* Component)
+{
+	if (!Component)
+		return;
+
+	VisionComponents.AddUnique(Component);
+}
+
+void UFogOfWarSubsystem::UnregisterVisionComponent(UFogOfWarVisionComponent* Component)
+{
+	VisionComponents.Remove(Component);
+}
+
+void UFogOfWarSubsystem::UpdateVisionComponents()
+{
+	QUICK_SCOPE_CYCLE_COUNTER(UpdateVisionComponents);
+
+	if (!FogOfWarActorsSnapshot.IsValid())
+		return;
+
+	//Also a copy, since updating can end play on other components and unregister them
+	TArray<UFogOfWarVisionComponent*, TInlineAllocator<64>> UpdatingComponents;
+
+	GatherDueVisionComponents(UpdatingComponents);
+
+	if (UpdatingComponents.Num() == 0)
+		return;
+
+	INC_DWORD_STAT_BY(STAT_FogOfWarVisionComponentsUpdated, UpdatingComponents.Num());
+
+	if (FogOfWarVisionAsync.GetValueOnGameThread())
+	{
+		LaunchVisionQueries(UpdatingComponents);
+		return;
+	}
+
+	TArray<FBox2D, TInlineAllocator<64>> QueryBounds;
+
+	for (auto Component : UpdatingComponents)
+		QueryBounds.Add(IsValid(Component) ? Component->GetVisionCanvasBounds() : FBox2D{ ForceInit });
+
+	VisionCandidates.SetNum(UpdatingComponents.Num());
+
+	const auto& Snapshot = *FogOfWarActorsSnapshot;
+
+	//Only the spatial queries run in parallel. Visibility is decided through the fog of war actor interface, so that stays on the game thread.
+	ParallelFor(UpdatingComponents.Num(), [&](int32 Index)
+	{
+		auto& Candidates = VisionCandidates[Index];
+
+		Candidates.Reset();
+
+		if (!QueryBounds[Index].bIsValid)
+			return;
+
+		for (auto It = Snapshot.WorldBoxQuery(QueryBounds[Index]); It; ++It)
+			Candidates.Add(*It);
+	});
+
+	for (int32 Index = 0; Index < UpdatingComponents.Num(); ++Index)
+		if (IsValid(UpdatingComponents[Index]) && UpdatingComponents[Index]->HasBegunPlay())
+			UpdatingComponents[Index]->UpdateVisionOverlaps(VisionCandidates[Index]);
+}
+
+void UFogOfWarSubsystem::GatherDueVisionComponents(TArray<UFogOfWarVisionComponent*, TInlineAllocator<64>>& OutComponents)
+{
+	double Now = GetWorld()->GetTimeSeconds();
+
+	int32 MaxUpdates = FogOfWarVisionMaxUpdatesPerFrame.GetValueOnGameThread();
+
+	int32 NumComponents = VisionComponents.Num();
+
+	for (int32 Offset = 0; Offset < NumComponents; ++Offset)
+	{
+		int32 Index = (NextDueVisionComponent + Offset) % NumComponents;
+
+		auto Component = VisionComponents[Index];
+
+		if (!IsValid(Component) || !Component->HasBegunPlay() || Component->NextVisibleActorsUpdateTime > Now)
+			continue;
+
+		if (MaxUpdates > 0 && OutComponents.Num() >= MaxUpdates)
+		{
+			NextDueVisionComponent = Index;
+			return;
+		}
+
+		//Keep the stagger unless the component has fallen a whole interval behind
+		Component->NextVisibleActorsUpdateTime += Component->VisionActorsUpdateFrequency;
+
+		if (Component->NextVisibleActorsUpdateTime <= Now)
+			Component->NextVisibleActorsUpdateTime = Now + Component->VisionActorsUpdateFrequency;
+
+		OutComponents.Add(Component);
+	}
+}
+
+//Finds the actors a viewer can see, only reading the snapshots so that it can run on any thread.
+//Occluder instances are only read through references, since their meshes are not thread safe shared pointers.
+static void RunVisionQuery(FFogOfWarVisionQuery& Query, const FFogOfWarActorsSnapshot& Actors, const FStaticOccludersSnapshot* Occluders, const FFogOfWarEdgeBuffer* OccluderEdges, const FDynamicOccludersSnapshot* DynamicOccluders)
+{
+	Query.Targets.Reset();
+
+	Query.OutOfConeTargets.Reset();
+
+	Query.TargetPositions.Reset();
+
+	for (auto It = Actors.WorldBoxQuery(Query.Bounds); It; ++It)
+	{
+		auto Position = It.GetWorldGeometry();
+
+		if (!Query.Viewer.IsInVisionCone(Position))
+		{
+			Query.OutOfConeTargets.Add(*It);
+			continue;
+		}
+
+		Query.Targets.Add(*It);
+
+		Query.TargetPositions.Add(Position);
+	}
+
+	if (Query.Targets.Num() == 0)
+		return;
+
+	//Gather the edges around the viewer once, so that every target is tested against one contiguous set
+	Query.Edges.Reset();
+
+	if (Occluders && OccluderEdges)
+		for (auto It = Occluders->WorldBoxQuery(Query.Bounds); It; ++It)
+			if (It->HasWorldEdges())
+				Query.Edges.AppendEdges(*OccluderEdges, It->FirstWorldEdge, It->NumWorldEdges);
+
+	if (DynamicOccluders)
+		for (auto It = DynamicOccluders->WorldBoxQuery(Query.Bounds); It; ++It)
+			Query.Edges.AppendOccluderEdges(*It);
+
+	Query.Edges.FindVisiblePoints(Query.Viewer.Location, Query.TargetPositions, Query.TargetsVisible);
+}
+
+//True if the worker's test at the actor's position decides its visibility, otherwise IsFogOfWarVisible has to be called on the game thread
+static bool IsFogOfWarVisibleAtActorLocation(AActor* Actor)
+{
+	auto FogOfWarActor = Cast<IFogOfWarActor>(Actor);
+
+	return FogOfWarActor && FogOfWarActor->IsFogOfWarVisibleAtActorLocation();
+}
+
+void UFogOfWarSubsystem::LaunchVisionQueries(TArrayView<UFogOfWarVisionComponent* const> Components)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(LaunchVisionQueries);
+
+	check(!VisionQueriesTask.IsValid());
+
+	VisionQueries.SetNum(Components.Num());
+
+	for (int32 Index = 0; Index < Components.Num(); ++Index)
+	{
+		auto& Query = VisionQueries[Index];
+
+		Query.Component = Components[Index];
+
+		Query.Viewer = Components[Index]->GetViewer();
+
+		Query.Bounds = Components[Index]->GetVisionCanvasBounds();
+	}
+
+	VisionQueriesActorsSnapshot = FogOfWarActorsSnapshot;
+
+	VisionQueriesOccludersSnapshot = StaticOccludersSnapshot;
+
+	VisionQueriesOccluderEdges = StaticOccluderEdges;
+
+	VisionQueriesDynamicOccludersSnapshot = DynamicOccludersSnapshot;
+
+	VisionQueriesTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+	{
+		const auto& Actors = *VisionQueriesActorsSnapshot;
+
+		auto Occluders = VisionQueriesOccludersSnapshot.Get();
+
+		auto OccluderEdges = VisionQueriesOccluderEdges.Get();
+
+		auto DynamicOccluders = VisionQueriesDynamicOccludersSnapshot.Get();
+
+		ParallelFor(VisionQueries.Num(), [&](int32 Index)
+		{
+			RunVisionQuery(VisionQueries[Index], Actors, Occluders, OccluderEdges, DynamicOccluders);
+		});
+	});
+}
+
+void UFogOfWarSubsystem::ApplyVisionQueries()
+{
+	if (!VisionQueriesTask.IsValid())
 		return;
 
-	for (TActorIterator<AActor> It(GetWorld()); It; ++It)
+	QUICK_SCOPE_CYCLE_COUNTER(ApplyVisionQueries);
+
+	//Launched a frame ago, so this should rarely have to wait
+	VisionQueriesTask.Wait();
+
+	VisionQueriesTask = UE::Tasks::FTask{};
+
+	for (auto& Query : VisionQueries)
 	{
-		if (It->GetRootComponent() && It->GetRootComponent()->Mobility == EComponentMobility::Movable)
+		auto Component = Query.Component.Get();
+
+		//Components that ended play while their query was running have already cleared their visible actors
+		if (!IsValid(Component) || !VisionComponents.Contains(Component))
 			continue;
 
-		for (auto Component : It->GetComponents())
+		TSet<AActor*> NewVisibleActors;
+
+		for (int32 Index = 0; Index < Query.Targets.Num(); ++Index)
 		{
-			auto StaticMeshComponent = Cast<UStaticMeshComponent>(Component);
+			auto Actor = Query.Targets[Index].Get();
 
-			if (!StaticMeshComponent || !StaticMeshComponent->GetStaticMesh())
+			if (!Actor)
 				continue;
 
-			if (StaticMeshComponent->GetCollisionResponseToChannel(ECollisionChannel::ECC_FogOfWar) == ECollisionResponse::ECR_Ignore)
-				continue;
-			
-			auto OccluderMesh = Subsystem->GetOccluderMesh(StaticMeshComponent->GetStaticMesh());
+			if (IsFogOfWarVisibleAtActorLocation(Actor) ? Query.TargetsVisible[Index] : IFogOfWarActor::Execute_IsFogOfWarVisible(Actor, Component))
+				NewVisibleActors.Add(Actor);
+		}
+
+		for (auto& Target : Query.OutOfConeTargets)
+		{
+			auto Actor = Target.Get();
+
+			if (Actor && !IsFogOfWarVisibleAtActorLocation(Actor) && IFogOfWarActor::Execute_IsFogOfWarVisible(Actor, Component))
+				NewVisibleActors.Add(Actor);
+		}
+
+		Component->SetVisibleActors(MoveTemp(NewVisibleActors));
+	}
+
+	VisionQueriesActorsSnapshot.Reset();
+
+	VisionQueriesOccludersSnapshot.Reset();
+
+	VisionQueriesOccluderEdges.Reset();
+
+	VisionQueriesDynamicOccludersSnapshot.Reset();
+}
+
+int32 UFogOfWarSubsystem::AddDynamicOccluder(FFogOfWarOccluderInstance&& Instance)
+{
+	if (!Instance.OccluderMesh)
+		return INDEX_NONE;
+
+	//Dynamic occluders never point into the static occluder edges
+	Instance.FirstWorldEdge = INDEX_NONE;
+
+	FBox2D WorldBounds = FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds);
+
+	MarkOccludersChanged(WorldBounds);
+
+	bDynamicOccludersChanged = true;
+
+	bDynamicOccludersAddedOrRemoved = true;
+
+	return DynamicOccluders.AddElementWorldSpace(WorldBounds, MoveTemp(Instance));
+}
+
+void UFogOfWarSubsystem::MoveDynamicOccluder(int32 OccluderID, const FTransform& NewTransform)
+{
+	if (!DynamicOccluders.GetElements().IsValidIndex(OccluderID))
+		return;
 
-			if (!OccluderMesh)
+	auto& Instance = DynamicOccluders.GetValue(OccluderID);
+
+	if (Instance.Transform.Equals(NewTransform, 0.0))
+		return;
+
+	MarkOccludersChanged(FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds));
+
+	Instance.Transform = NewTransform;
+
+	FBox2D WorldBounds = FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds);
+
+	MarkOccludersChanged(WorldBounds);
+
+	DynamicOccluders.MoveElementWorldSpace(OccluderID, WorldBounds);
+
+	MovedDynamicOccluderIDs.Add(OccluderID);
+
+	bDynamicOccludersChanged = true;
+}
+
+void UFogOfWarSubsystem::RemoveDynamicOccluder(int32 OccluderID)
+{
+	if (!DynamicOccluders.GetElements().IsValidIndex(OccluderID))
+		return;
+
+	auto& Instance = DynamicOccluders.GetValue(OccluderID);
+
+	MarkOccludersChanged(FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds));
+
+	DynamicOccluders.RemoveElement(OccluderID);
+
+	bDynamicOccludersChanged = true;
+
+	bDynamicOccludersAddedOrRemoved = true;
+}
+
+void UFogOfWarSubsystem::PublishDynamicOccludersSnapshot()
+{
+	if (!bDynamicOccludersChanged)
+		return;
+
+	QUICK_SCOPE_CYCLE_COUNTER(PublishDynamicOccludersSnapshot);
+
+	bDynamicOccludersChanged = false;
+
+	bool bCanPatch = !bDynamicOccludersAddedOrRemoved && DynamicOccludersSnapshot.IsValid() && DynamicOccludersSnapshot.IsUnique();
+
+	bDynamicOccludersAddedOrRemoved = false;
+
+	//Nobody else is reading the snapshot and occluders only moved, so patch the moved ones in place as long as they stayed in their cells
+	for (int32 Index = 0; bCanPatch && Index < MovedDynamicOccluderIDs.Num(); ++Index)
+	{
+		int32 OccluderID = MovedDynamicOccluderIDs[Index];
+
+		bCanPatch = DynamicOccludersSnapshot->PatchElement(OccluderID, DynamicOccluders.GetElements()[OccluderID]);
+	}
+
+	MovedDynamicOccluderIDs.Reset();
+
+	if (bCanPatch)
+		return;
+
+	if (!DynamicOccludersSnapshot.IsValid() || !DynamicOccludersSnapshot.IsUnique())
+		DynamicOccludersSnapshot = MakeShared<FDynamicOccludersSnapshot, ESPMode::ThreadSafe>();
+
+	DynamicOccludersSnapshot->Build(DynamicOccluders);
+}
+
+void UFogOfWarSubsystem::MarkOccludersChanged(const FBox2D& WorldBounds)
+{
+	auto CellRect = StaticOccluders.GetCellGeometry(StaticOccluders.WorldToLocal(WorldBounds));
+
+	for (int32 Y = CellRect.Min.Y; Y < CellRect.Max.Y; ++Y)
+		for (int32 X = CellRect.Min.X; X < CellRect.Max.X; ++X)
+			++OccluderCellVersions.FindOrAdd(FIntPoint{ X, Y });
+}
+
+uint32 UFogOfWarSubsystem::GetOccludersVersion(const FBox2D& WorldBounds) const
+{
+	//Versions only ever go up, so the sum changes whenever any of the cells do
+	uint32 Version = StaticOccludersVersion;
+
+	if (OccluderCellVersions.Num() == 0)
+		return Version;
+
+	auto CellRect = StaticOccluders.GetCellGeometry(StaticOccluders.WorldToLocal(WorldBounds));
+
+	for (int32 Y = CellRect.Min.Y; Y < CellRect.Max.Y; ++Y)
+		for (int32 X = CellRect.Min.X; X < CellRect.Max.X; ++X)
+			if (auto CellVersion = OccluderCellVersions.Find(FIntPoint{ X, Y }))
+				Version += *CellVersion;
+
+	return Version;
+}
+
+void UFogOfWarSubsystem::AddStaticOccluderLevel(ULevel* Level)
+{
+	if (!Level || StaticOccluderLevels.Contains(Level))
+		return;
+
+	StaticOccluderLevels.Add(Level);
+
+	PendingStaticOccluderLevels.Add({ Level });
+}
+
+void UFogOfWarSubsystem::RemoveStaticOccluderLevel(ULevel* Level)
+{
+	TArray<int32> ElementIDs;
+
+	if (!StaticOccluderLevels.RemoveAndCopyValue(Level, ElementIDs))
+		return;
+
+	PendingStaticOccluderLevels.RemoveAll([&](const FPendingStaticOccluderLevel& Pending) { return Pending.Level == Level; });
+
+	//Before the first publish nothing has been cached from these occluders, so there are no cells to invalidate
+	bool bMarkChanged = StaticOccludersSnapshot.IsValid();
+
+	for (int32 ElementID : ElementIDs)
+	{
+		if (!StaticOccluders.GetElements().IsValidIndex(ElementID))
+			continue;
+
+		if (bMarkChanged)
+		{
+			auto& Instance = StaticOccluders.GetValue(ElementID);
+
+			MarkOccludersChanged(FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds));
+		}
+
+		StaticOccluders.RemoveElement(ElementID);
+	}
+
+	if (ElementIDs.Num() > 0)
+	{
+		bStaticOccludersChanged = true;
+
+		RestartStaticOccludersPublish();
+	}
+}
+
+void UFogOfWarSubsystem::OnLevelAddedToWorld(ULevel* Level, UWorld* World)
+{
+	if (World != GetWorld())
+		return;
+
+	if (bSpatialGridsFromLevelBounds && Level)
+	{
+		FBox LevelBounds = ALevelBounds::CalculateLevelBounds(Level);
+
+		if (LevelBounds.IsValid && !SpatialGridsBounds.IsInside(FBox2D{ FVector2D{ LevelBounds.Min }, FVector2D{ LevelBounds.Max } }))
+			UE_LOG(LogTemp, Warning, TEXT("UFogOfWarSubsystem: Streamed in level %s reaches outside of the fog of war grids, which were sized to the levels loaded at begin play. Place an AFogOfWarManager to set the bounds."), *Level->GetOuter()->GetName());
+	}
+
+	AddStaticOccluderLevel(Level);
+}
+
+void UFogOfWarSubsystem::OnLevelRemovedFromWorld(ULevel* Level, UWorld* World)
+{
+	//A null level means the whole world is going away, which Deinitialize takes care of
+	if (World == GetWorld() && Level)
+		RemoveStaticOccluderLevel(Level);
+}
+
+void UFogOfWarSubsystem::GatherPendingStaticOccluders()
+{
+	if (PendingStaticOccluderLevels.Num() == 0 && !bStaticOccludersChanged)
+		return;
+
+	double BudgetSeconds = FogOfWarOccludersGatherBudgetMs.GetValueOnGameThread() / 1000.0;
+
+	double EndTime = BudgetSeconds > 0.0 ? FPlatformTime::Seconds() + BudgetSeconds : TNumericLimits<double>::Max();
+
+	if (PendingStaticOccluderLevels.Num() > 0)
+	{
+		QUICK_SCOPE_CYCLE_COUNTER(GatherPendingStaticOccluders);
+
+		bool bBudgetSpent = false;
+
+		while (PendingStaticOccluderLevels.Num() > 0 && !bBudgetSpent)
+		{
+			auto& Pending = PendingStaticOccluderLevels[0];
+
+			auto Level = Pending.Level.Get();
+
+			auto ElementIDs = Level ? StaticOccluderLevels.Find(Level) : nullptr;
+
+			if (!ElementIDs)
+			{
+				PendingStaticOccluderLevels.RemoveAt(0);
 				continue;
+			}
+
+			int32 NumElementIDs = ElementIDs->Num();
+
+			//Instances of an actor's instanced meshes are added before moving on to the next actor, so that the budget is checked within large instanced meshes too
+			while (!bBudgetSpent)
+			{
+				if (Pending.InstancedComponents.Num() > 0)
+				{
+					auto Component = Pending.InstancedComponents[0].Get();
 
-			FFogOfWarOccluderInstance Instance;
+					if (!Component || GatherStaticOccluderInstances(Component, Pending.NextInstance, *ElementIDs, EndTime))
+					{
+						Pending.InstancedComponents.RemoveAt(0);
 
-			Instance.Transform = StaticMeshComponent->GetComponentTransform();
+						Pending.NextInstance = 0;
+					}
+				}
+				else if (Pending.NextActor < Level->Actors.Num())
+					GatherStaticOccluders(Level->Actors[Pending.NextActor++], *ElementIDs, Pending.InstancedComponents);
+				else
+					break;
 
-			Instance.OccluderMesh = OccluderMesh;
+				bBudgetSpent = FPlatformTime::Seconds() >= EndTime;
+			}
 
-			auto& Bounds = Instance.OccluderMesh->Bounds;
+			if (ElementIDs->Num() > NumElementIDs)
+			{
+				bStaticOccludersChanged = true;
 
-			FBox2D WorldBounds = FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds);
+				RestartStaticOccludersPublish();
+			}
 
-			StaticOccluders.AddElementWorldSpace(WorldBounds, MoveTemp(Instance));
+			if (Pending.NextActor >= Level->Actors.Num() && Pending.InstancedComponents.Num() == 0)
+				PendingStaticOccluderLevels.RemoveAt(0);
 		}
 	}
 
+	//Published once every queued level is done, so that a level streaming in over several ticks is only copied into a new snapshot once.
+	//Until then the game thread sees the new occluders in the static occluders map, transforming their mesh edges when it needs them.
+	if (bStaticOccludersChanged && PendingStaticOccluderLevels.Num() == 0 && FPlatformTime::Seconds() < EndTime)
+		PublishStaticOccluders(EndTime);
 }
 
+void UFogOfWarSubsystem::GatherStaticOccluders(AActor* Actor, TArray<int32>& OutElementIDs, TArray<TWeakObjectPtr<UInstancedStaticMeshComponent>>& OutInstancedComponents)
+{
+	if (!IsValid(Actor))
+		return;
+
+	if (Actor->GetRootComponent() && Actor->GetRootComponent()->Mobility == EComponentMobility::Movable)
+		return;
+
+	for (auto Component : Actor->GetComponents())
+	{
+		//Also covers hierarchical instanced meshes
+		if (auto InstancedComponent = Cast<UInstancedStaticMeshComponent>(Component))
+		{
+			if (InstancedComponent->GetInstanceCount() > 0)
+				OutInstancedComponents.Add(InstancedComponent);
+
+			continue;
+		}
+
+		auto StaticMeshComponent = Cast<UStaticMeshComponent>(Component);
+
+		if (!StaticMeshComponent)
+			continue;
+
+		if (auto OccluderMesh = GetStaticOccluderMesh(StaticMeshComponent))
+			OutElementIDs.Add(AddStaticOccluder(StaticMeshComponent->GetComponentTransform(), OccluderMesh));
+	}
+}
+
+bool UFogOfWarSubsystem::GatherStaticOccluderInstances(UInstancedStaticMeshComponent* Component, int32& NextInstance, TArray<int32>& OutElementIDs, double EndTime)
+{
+	check(Component);
+
+	auto OccluderMesh = GetStaticOccluderMesh(Component);
+
+	if (!OccluderMesh)
+		return true;
+
+	int32 NumInstances = Component->GetInstanceCount();
+
+	if (NextInstance == 0)
+		OutElementIDs.Reserve(OutElementIDs.Num() + NumInstances);
+
+	//Adding one instance is much quicker than reading the clock, so the time is only checked between batches
+	constexpr int32 InstancesPerTimeCheck = 64;
+
+	while (NextInstance < NumInstances)
+	{
+		int32 EndInstance = FMath::Min(NextInstance + InstancesPerTimeCheck, NumInstances);
+
+		//Every instance shares the one occluder mesh, so only the transforms are stored per instance until the edges are published
+		for (; NextInstance < EndInstance; ++NextInstance)
+		{
+			FTransform InstanceTransform;
+
+			if (Component->GetInstanceTransform(NextInstance, InstanceTransform, true))
+				OutElementIDs.Add(AddStaticOccluder(InstanceTransform, OccluderMesh));
+		}
+
+		if (NextInstance < NumInstances && FPlatformTime::Seconds() >= EndTime)
+			return false;
+	}
+
+	return true;
+}
+
+TFogOfWarSharedPtr<FFogOfWarOccluderMesh> UFogOfWarSubsystem::GetStaticOccluderMesh(UStaticMeshComponent* Component) const
+{
+	if (!Component->GetStaticMesh())
+		return nullptr;
+
+	if (Component->GetCollisionResponseToChannel(ECollisionChannel::ECC_FogOfWar) == ECollisionResponse::ECR_Ignore)
+		return nullptr;
+
+	auto GI = GetWorld()->GetGameInstance();
+
+	if (!GI)
+		return nullptr;
+
+	auto Subsystem = GI->GetSubsystem<UFogOfWarOccluderSubsystem>();
+
+	if (!Subsystem)
+		return nullptr;
+
+	return Subsystem->GetOccluderMesh(Component->GetStaticMesh());
+}
+
+int32 UFogOfWarSubsystem::AddStaticOccluder(const FTransform& Transform, const TFogOfWarSharedPtr<FFogOfWarOccluderMesh>& OccluderMesh)
+{
+	FFogOfWarOccluderInstance Instance;
+
+	Instance.Transform = Transform;
+
+	Instance.OccluderMesh = OccluderMesh;
+
+	FBox2D WorldBounds = FogOfWarUtils::TransformBox2D(Instance.Transform, Instance.OccluderMesh->Bounds);
+
+	//Before the first publish nothing has been cached from the occluders, so there are no cells to invalidate
+	if (StaticOccludersSnapshot.IsValid())
+		MarkOccludersChanged(WorldBounds);
+
+	return StaticOccluders.AddElementWorldSpace(WorldBounds, MoveTemp(Instance));
+}
+
+void UFogOfWarSubsystem::PublishStaticOccluders(double EndTime)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(PublishStaticOccluders);
+
+	auto& Publish = PendingStaticOccludersPublish;
+
+	const auto& Elements = StaticOccluders.GetElements();
+
+	//Static occluders never move, so their edges are transformed into world space once when they are published instead of by every viewer each frame.
+	//The old buffer may still be read by vision queries, so a new one is built, copying already transformed edges and compacting away removed occluders.
+	if (!Publish.Edges.IsValid())
+	{
+		Publish.Edges = MakeShared<FFogOfWarEdgeBuffer, ESPMode::ThreadSafe>();
+
+		Publish.FirstWorldEdges.Init(INDEX_NONE, Elements.GetMaxIndex());
+
+		Publish.NextElement = 0;
+
+		int32 NumEdges = 0;
+
+		for (auto& Element : Elements)
+			if (Element.Value.OccluderMesh)
+				NumEdges += Element.Value.OccluderMesh->ShadowEdges.Num();
+
+		Publish.Edges->Reserve(NumEdges);
+	}
+
+	//Copying one occluder is much quicker than reading the clock, so the time is only checked between batches
+	constexpr int32 ElementsPerTimeCheck = 64;
+
+	while (Publish.NextElement < Elements.GetMaxIndex())
+	{
+		int32 EndElement = FMath::Min(Publish.NextElement + ElementsPerTimeCheck, Elements.GetMaxIndex());
+
+		for (; Publish.NextElement < EndElement; ++Publish.NextElement)
+		{
+			if (!Elements.IsAllocated(Publish.NextElement))
+				continue;
+
+			auto& Instance = Elements[Publish.NextElement].Value;
+
+			if (!Instance.OccluderMesh)
+				continue;
+
+			Publish.FirstWorldEdges[Publish.NextElement] = Publish.Edges->Num();
+
+			if (Instance.HasWorldEdges() && StaticOccluderEdges.IsValid())
+				Publish.Edges->AppendEdges(*StaticOccluderEdges, Instance.FirstWorldEdge, Instance.NumWorldEdges);
+			else
+				Publish.Edges->AppendOccluderEdges(Instance);
+		}
+
+		if (FPlatformTime::Seconds() >= EndTime)
+			return;
+	}
+
+	//Every edge is in the new buffer, so the instances can point at it. The snapshot copies the instances, so it is built after.
+	//Building the snapshot can't be split up, so it is the last step of the publish and only starts on a tick with budget left.
+	for (int32 ElementID = 0; ElementID < Elements.GetMaxIndex(); ++ElementID)
+	{
+		if (!Elements.IsAllocated(ElementID))
+			continue;
+
+		auto& Instance = StaticOccluders.GetValue(ElementID);
+
+		Instance.FirstWorldEdge = Publish.FirstWorldEdges[ElementID];
+
+		Instance.NumWorldEdges = Instance.HasWorldEdges() ? Instance.OccluderMesh->ShadowEdges.Num() : 0;
+	}
+
+	//The first occluders replace an empty set, so any vision cached before then is stale everywhere
+	if (!StaticOccludersSnapshot.IsValid())
+		++StaticOccludersVersion;
+
+	auto NewStaticOccludersSnapshot = MakeShared<FStaticOccludersSnapshot, ESPMode::ThreadSafe>();
+
+	NewStaticOccludersSnapshot->Build(StaticOccluders);
+
+	StaticOccludersSnapshot = NewStaticOccludersSnapshot;
+
+	StaticOccluderEdges = Publish.Edges;
+
+	bStaticOccludersChanged = false;
+
+	RestartStaticOccludersPublish();
+}
+
+void UFogOfWarSubsystem::RestartStaticOccludersPublish()
+{
+	PendingStaticOccludersPublish.Edges.Reset();
+
+	PendingStaticOccludersPublish.FirstWorldEdges.Reset();
+
+	PendingStaticOccludersPublish.NextElement = 0;
+}
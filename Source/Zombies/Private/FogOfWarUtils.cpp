@@ -3,6 +3,7 @@
 
 #include "FogOfWarUtils.h"
 #include "Engine/TextureRenderTarget2D.h"
+#include "Engine/Texture2D.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/BoxComponent.h"
 #include "Components/SphereComponent.h"
@@ -85,7 +86,7 @@ FTransform FogOfWarUtils::GetSnappedCanvasTransform(const FTransform& DesiredTra
 	return FTransform{DesiredTransform.GetRotation(), DesiredTransform.TransformVectorNoScale(RotatedTexelPosition), DesiredTransform.GetScale3D()};
 }
 
-FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D* RenderTarget)
+FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D* RenderTarget, FCanvas::ECanvasDrawMode DrawMode)
 {
 	check(World);
 
@@ -95,7 +96,7 @@ FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D*
 
 	auto Resource = RenderTarget->GameThread_GetRenderTargetResource();
 
-	FCanvas Canvas{ Resource, nullptr, World, World->FeatureLevel,FCanvas::CDM_ImmediateDrawing };
+	FCanvas Canvas{ Resource, nullptr, World, World->FeatureLevel, DrawMode };
 
 	ENQUEUE_RENDER_COMMAND(FlushDeferredUpdates)(
 		[Resource](FRHICommandListImmediate& RHICmdList)
@@ -108,9 +109,9 @@ FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D*
 	return Canvas;
 }
 
-FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, const FTransform& Transform, UTextureRenderTarget2D* RenderTarget)
+FCanvas FogOfWarUtils::BeginDrawingCanvas(UWorld* World, const FTransform& Transform, UTextureRenderTarget2D* RenderTarget, FCanvas::ECanvasDrawMode DrawMode)
 {
-	auto Canvas = BeginDrawingCanvas(World, RenderTarget);
+	auto Canvas = BeginDrawingCanvas(World, RenderTarget, DrawMode);
 
 	//@todo: consider negative Z values, do they clip the geometry?
 	Canvas.SetBaseTransform(Transform.ToInverseMatrixWithScale());
@@ -145,6 +146,16 @@ void FogOfWarUtils::DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transfor
 }
 
 void FogOfWarUtils::DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, FTexture* Texture, FLinearColor Color, ESimpleElementBlendMode BlendMode)
+{
+	DrawTexturedQuad(Canvas, Transform, Texture, FBox2D{ FVector2D::ZeroVector, FVector2D::UnitVector }, Color, BlendMode);
+}
+
+void FogOfWarUtils::DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, UTexture* Texture, const FBox2D& UVs, FLinearColor Color, ESimpleElementBlendMode BlendMode)
+{
+	DrawTexturedQuad(Canvas, Transform, Texture->GetResource(), UVs, Color, BlendMode);
+}
+
+void FogOfWarUtils::DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, FTexture* Texture, const FBox2D& UVs, FLinearColor Color, ESimpleElementBlendMode BlendMode)
 {
 	TArray<FCanvasUVTri> QuadTriangles;
 
@@ -156,22 +167,22 @@ void FogOfWarUtils::DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transfor
 	FVector2D TopRight{ Transform.TransformPosition({ 1.0, 1.0, 0.0 }) };
 
 	QuadTriangles[0].V0_Pos = TopLeft;
-	QuadTriangles[0].V0_UV = { 0.0, 0.0 };
+	QuadTriangles[0].V0_UV = { UVs.Min.X, UVs.Min.Y };
 
 	QuadTriangles[0].V1_Pos = TopRight;
-	QuadTriangles[0].V1_UV = { 1.0, 0.0 };
+	QuadTriangles[0].V1_UV = { UVs.Max.X, UVs.Min.Y };
 
 	QuadTriangles[0].V2_Pos = BottomLeft;
-	QuadTriangles[0].V2_UV = { 0.0, 1.0 };
+	QuadTriangles[0].V2_UV = { UVs.Min.X, UVs.Max.Y };
 
 	QuadTriangles[1].V0_Pos = TopRight;
-	QuadTriangles[1].V0_UV = { 1.0, 0.0 };
+	QuadTriangles[1].V0_UV = { UVs.Max.X, UVs.Min.Y };
 
 	QuadTriangles[1].V1_Pos = BottomRight;
-	QuadTriangles[1].V1_UV = { 1.0, 1.0 };
+	QuadTriangles[1].V1_UV = { UVs.Max.X, UVs.Max.Y };
 
 	QuadTriangles[1].V2_Pos = BottomLeft;
-	QuadTriangles[1].V2_UV = { 0.0, 1.0 };
+	QuadTriangles[1].V2_UV = { UVs.Min.X, UVs.Max.Y };
 
 	FCanvasTriangleItem Item{ QuadTriangles, Texture };
 	
@@ -241,6 +252,34 @@ void FogOfWarUtils::DrawCone(FCanvas& Canvas, FVector2D Centre, FVector2D Direct
 	Canvas.DrawItem(Item);
 }
 
+void FogOfWarUtils::DrawTriangleFan(FCanvas& Canvas, FVector2D Centre, TArrayView<const FVector2D> Vertices, FLinearColor Color)
+{
+	if (Vertices.Num() < 2)
+		return;
+
+	TArray<FCanvasUVTri> Triangles;
+
+	Triangles.Reserve(Vertices.Num() - 1);
+
+	FCanvasUVTri Triangle;
+
+	Triangle.V0_Pos = Centre;
+
+	for (int32 Index = 0; Index + 1 < Vertices.Num(); ++Index)
+	{
+		Triangle.V1_Pos = Vertices[Index];
+		Triangle.V2_Pos = Vertices[Index + 1];
+
+		Triangles.Add(Triangle);
+	}
+
+	FCanvasTriangleItem Item{ Triangles, GWhiteTexture };
+
+	Item.SetColor(Color);
+
+	Canvas.DrawItem(Item);
+}
+
 void FogOfWarUtils::DrawMaterial(FCanvas& Canvas, UMaterialInterface* Material)
 {
 	FCanvasTileItem Item{ FVector2D{-1.0,-1.0}, Material->GetRenderProxy(), FVector2D{2.0,2.0} };
@@ -269,6 +308,50 @@ UTextureRenderTarget2D* FogOfWarUtils::CreateRenderTarget(UObject* Outer, uint32
 	return Texture;
 }
 
+UTexture2D* FogOfWarUtils::CreateTexture(uint32 Resolution)
+{
+	check(Resolution >= 32);
+
+	UTexture2D* Texture = UTexture2D::CreateTransient(Resolution, Resolution, PF_G8);
+
+	check(Texture);
+
+	Texture->SRGB = false;
+
+	Texture->Filter = TF_Bilinear;
+
+	Texture->AddressX = TA_Clamp;
+
+	Texture->AddressY = TA_Clamp;
+
+	Texture->UpdateResource();
+
+	return Texture;
+}
+
+FBox2D FogOfWarUtils::GetAtlasTileUVs(FIntPoint Tile, int32 TilesPerSide, int32 TileResolution, int32 GutterTexels)
+{
+	double InvAtlasResolution = 1.0 / (TilesPerSide * TileResolution);
+
+	FVector2D Min{ double(Tile.X * TileResolution + GutterTexels), double(Tile.Y * TileResolution + GutterTexels) };
+
+	FVector2D Max{ double((Tile.X + 1) * TileResolution - GutterTexels), double((Tile.Y + 1) * TileResolution - GutterTexels) };
+
+	return FBox2D{ Min * InvAtlasResolution, Max * InvAtlasResolution };
+}
+
+FMatrix FogOfWarUtils::GetAtlasTileMatrix(FIntPoint Tile, int32 TilesPerSide, int32 TileResolution, int32 GutterTexels)
+{
+	auto UVs = GetAtlasTileUVs(Tile, TilesPerSide, TileResolution, GutterTexels);
+
+	//Unit canvas -1 -> 1 maps to the tile UVs in clip space, where +Y is the top of the texture at V = 0
+	FVector Scale{ UVs.Max.X - UVs.Min.X, UVs.Max.Y - UVs.Min.Y, 1.0 };
+
+	FVector Translation{ UVs.Min.X + UVs.Max.X - 1.0, 1.0 - UVs.Min.Y - UVs.Max.Y, 0.0 };
+
+	return FScaleMatrix{ Scale } * FTranslationMatrix{ Translation };
+}
+
 FBox2D FogOfWarUtils::GetCanvasBounds(const FTransform& Transform)
 {
 	FBox2D Result{ ForceInit };
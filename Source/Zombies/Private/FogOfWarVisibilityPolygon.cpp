@@ -0,0 +1,369 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "FogOfWarVisibilityPolygon.h"
+#include "Algo/BinarySearch.h"
+
+void FFogOfWarVisibilityPolygon::Reset(const FVector2D& InCentre, const FVector2D& Direction, double InRadius, double HalfFOVInRadians, double InSelfRadius)
+{
+	Centre = InCentre;
+
+	Radius = FMath::Max(InRadius, 0.0);
+
+	SelfRadius = FMath::Clamp(InSelfRadius, 0.0, Radius);
+
+	HalfFOVInRadians = FMath::Clamp(HalfFOVInRadians, 0.0, PI);
+
+	double DirectionAngle = Direction.IsNearlyZero() ? 0.0 : FMath::Atan2(Direction.Y, Direction.X);
+
+	if (SelfRadius > 0.0 || HalfFOVInRadians >= PI)
+	{
+		//Sweep all the way around, starting behind the direction so the cone is one contiguous range in the middle
+		StartAngle = DirectionAngle - PI;
+		SweepAngle = 2.0 * PI;
+		ConeStartAngle = PI - HalfFOVInRadians;
+		ConeEndAngle = PI + HalfFOVInRadians;
+	}
+	else
+	{
+		StartAngle = DirectionAngle - HalfFOVInRadians;
+		SweepAngle = 2.0 * HalfFOVInRadians;
+		ConeStartAngle = 0.0;
+		ConeEndAngle = SweepAngle;
+	}
+
+	Edges.Reset();
+
+	Spans.Reset();
+}
+
+void FFogOfWarVisibilityPolygon::AddEdge(FVector2D From, FVector2D To)
+{
+	FVector2D ClosestPoint = FMath::ClosestPointOnSegment2D(Centre, From, To);
+
+	if ((ClosestPoint - Centre).SizeSquared() > FMath::Square(Radius))
+		return;
+
+	From -= Centre;
+	To -= Centre;
+
+	double Cross = From ^ To;
+
+	//Edges pointing at the centre cover no angle, so they can't hide anything
+	if (FMath::Abs(Cross) <= UE_KINDA_SMALL_NUMBER * From.Size() * To.Size())
+		return;
+
+	if (Cross < 0.0)
+	{
+		Swap(From, To);
+		Cross = -Cross;
+	}
+
+	Edges.Add(FEdge{ From, To - From, Cross });
+}
+
+void FFogOfWarVisibilityPolygon::AddOccluder(const FFogOfWarOccluderInstance& Occluder, double ShadowBias, const FFogOfWarEdgeBuffer* WorldEdges)
+{
+	double ScaledShadowBias = 1.0 + ShadowBias;
+
+	if (WorldEdges && Occluder.HasWorldEdges())
+	{
+		for (int32 Index = Occluder.FirstWorldEdge; Index < Occluder.FirstWorldEdge + Occluder.NumWorldEdges; ++Index)
+			AddEdge(Centre + (WorldEdges->GetFrom(Index) - Centre) * ScaledShadowBias, Centre + (WorldEdges->GetTo(Index) - Centre) * ScaledShadowBias);
+
+		return;
+	}
+
+	if (!Occluder.OccluderMesh)
+		return;
+
+	for (auto& [From, To] : Occluder.OccluderMesh->ShadowEdges)
+	{
+		FVector2D FromWS{ Occluder.Transform.TransformPosition(FVector{ From, 0.0 }) };
+		FVector2D ToWS{ Occluder.Transform.TransformPosition(FVector{ To, 0.0 }) };
+
+		AddEdge(Centre + (FromWS - Centre) * ScaledShadowBias, Centre + (ToWS - Centre) * ScaledShadowBias);
+	}
+}
+
+void FFogOfWarVisibilityPolygon::Build()
+{
+	Spans.Reset();
+
+	Intervals.Reset();
+
+	if (SweepAngle <= 0.0 || Radius <= 0.0)
+		return;
+
+	for (int32 Index = 0; Index < Edges.Num(); ++Index)
+	{
+		auto& Edge = Edges[Index];
+
+		double EdgeStart = GetSweepAngle(Edge.From);
+
+		//Counter clockwise angle from the start of the edge to the end, always less than PI
+		double EdgeEnd = EdgeStart + FMath::Atan2(Edge.Numerator, Edge.From | (Edge.From + Edge.Delta));
+
+		//Edges can wrap past the end of the sweep back around to the start
+		for (double Offset : { 0.0, -2.0 * PI })
+		{
+			double IntervalStart = FMath::Max(EdgeStart + Offset, 0.0);
+			double IntervalEnd = FMath::Min(EdgeEnd + Offset, SweepAngle);
+
+			if (IntervalStart < IntervalEnd)
+				Intervals.Add(FEdgeInterval{ IntervalStart, IntervalEnd, Index });
+		}
+	}
+
+	//Every angle where the active edges or the limit radius change
+	TArray<double> Events;
+
+	Events.Reserve(Intervals.Num() * 2 + 4);
+
+	Events.Add(0.0);
+	Events.Add(SweepAngle);
+	Events.Add(ConeStartAngle);
+	Events.Add(ConeEndAngle);
+
+	for (auto& Interval : Intervals)
+	{
+		Events.Add(Interval.StartAngle);
+		Events.Add(Interval.EndAngle);
+	}
+
+	Events.Sort();
+
+	Intervals.Sort([](const FEdgeInterval& A, const FEdgeInterval& B) { return A.StartAngle < B.StartAngle; });
+
+	TArray<int32, TInlineAllocator<64>> ActiveEdges;
+
+	TArray<double, TInlineAllocator<64>> ActiveEnds;
+
+	int32 NextInterval = 0;
+
+	for (int32 Index = 0; Index + 1 < Events.Num(); ++Index)
+	{
+		double WedgeStart = Events[Index];
+		double WedgeEnd = Events[Index + 1];
+
+		if (WedgeEnd <= WedgeStart || WedgeStart < 0.0 || WedgeEnd > SweepAngle)
+			continue;
+
+		for (int32 Active = ActiveEdges.Num() - 1; Active >= 0; --Active)
+			if (ActiveEnds[Active] <= WedgeStart)
+			{
+				ActiveEdges.RemoveAtSwap(Active, 1, false);
+				ActiveEnds.RemoveAtSwap(Active, 1, false);
+			}
+
+		for (; NextInterval < Intervals.Num() && Intervals[NextInterval].StartAngle <= WedgeStart; ++NextInterval)
+		{
+			ActiveEdges.Add(Intervals[NextInterval].Edge);
+			ActiveEnds.Add(Intervals[NextInterval].EndAngle);
+		}
+
+		AddWedge(ActiveEdges, WedgeStart, WedgeEnd, 0);
+	}
+}
+
+bool FFogOfWarVisibilityPolygon::IsPointVisible(const FVector2D& Point) const
+{
+	FVector2D Offset = Point - Centre;
+
+	double DistanceSquared = Offset.SizeSquared();
+
+	if (DistanceSquared < UE_KINDA_SMALL_NUMBER)
+		//Point is approximately on top of the vision source, so we will consider it trivially visible.
+		return true;
+
+	if (Spans.Num() == 0)
+		return false;
+
+	double Angle = GetSweepAngle(Offset);
+
+	if (Angle > SweepAngle)
+		return false;
+
+	int32 Index = Algo::UpperBoundBy(Spans, Angle, &FSpan::StartAngle) - 1;
+
+	if (!Spans.IsValidIndex(Index))
+		return false;
+
+	auto& Span = Spans[Index];
+
+	double Distance = Span.Edge == INDEX_NONE ? Span.Radius : Edges[Span.Edge].GetDistance(Offset * FMath::InvSqrt(DistanceSquared));
+
+	return DistanceSquared <= FMath::Square(Distance);
+}
+
+void FFogOfWarVisibilityPolygon::GetBoundary(TArray<FVector2D>& OutVertices, double MaxArcStep) const
+{
+	OutVertices.Reset();
+
+	auto AddVertex = [&](double Angle, double Distance)
+	{
+		FVector2D Vertex = Centre + GetRay(Angle) * Distance;
+
+		//Neighbouring spans that meet at the same point would only add empty triangles
+		if (OutVertices.Num() == 0 || !OutVertices.Last().Equals(Vertex))
+			OutVertices.Add(Vertex);
+	};
+
+	MaxArcStep = FMath::Max(MaxArcStep, UE_KINDA_SMALL_NUMBER);
+
+	for (auto& Span : Spans)
+	{
+		if (Span.Edge != INDEX_NONE)
+		{
+			auto& Edge = Edges[Span.Edge];
+
+			AddVertex(Span.StartAngle, Edge.GetDistance(GetRay(Span.StartAngle)));
+			AddVertex(Span.EndAngle, Edge.GetDistance(GetRay(Span.EndAngle)));
+			continue;
+		}
+
+		int32 NumSteps = FMath::Max(1, FMath::CeilToInt((Span.EndAngle - Span.StartAngle) / MaxArcStep));
+
+		for (int32 Step = 0; Step <= NumSteps; ++Step)
+			AddVertex(FMath::Lerp(Span.StartAngle, Span.EndAngle, double(Step) / NumSteps), Span.Radius);
+	}
+}
+
+double FFogOfWarVisibilityPolygon::GetSweepAngle(const FVector2D& Offset) const
+{
+	double Angle = FMath::Fmod(FMath::Atan2(Offset.Y, Offset.X) - StartAngle, 2.0 * PI);
+
+	return Angle < 0.0 ? Angle + 2.0 * PI : Angle;
+}
+
+double FFogOfWarVisibilityPolygon::GetLimitRadius(double Angle) const
+{
+	return Angle >= ConeStartAngle && Angle <= ConeEndAngle ? Radius : SelfRadius;
+}
+
+int32 FFogOfWarVisibilityPolygon::FindNearestEdge(TArrayView<const int32> ActiveEdges, double Angle) const
+{
+	FVector2D Ray = GetRay(Angle);
+
+	int32 NearestEdge = INDEX_NONE;
+
+	double NearestDistance = TNumericLimits<double>::Max();
+
+	for (int32 Edge : ActiveEdges)
+	{
+		double Distance = Edges[Edge].GetDistance(Ray);
+
+		if (Distance < NearestDistance)
+		{
+			NearestEdge = Edge;
+			NearestDistance = Distance;
+		}
+	}
+
+	return NearestEdge;
+}
+
+void FFogOfWarVisibilityPolygon::AddWedge(TArrayView<const int32> ActiveEdges, double WedgeStart, double WedgeEnd, int32 Depth)
+{
+	double LimitRadius = GetLimitRadius((WedgeStart + WedgeEnd) * 0.5);
+
+	if (ActiveEdges.Num() == 0)
+	{
+		AddSpan(WedgeStart, WedgeEnd, INDEX_NONE, LimitRadius);
+		return;
+	}
+
+	//Nearest edges just inside each end of the wedge, so that edges meeting at the ends don't tie
+	double Nudge = (WedgeEnd - WedgeStart) * 1e-4;
+
+	int32 StartEdge = FindNearestEdge(ActiveEdges, WedgeStart + Nudge);
+	int32 EndEdge = FindNearestEdge(ActiveEdges, WedgeEnd - Nudge);
+
+	//Subdividing any further would only be chasing rounding errors
+	constexpr int32 MaxDepth = 16;
+
+	if (StartEdge == EndEdge || Depth >= MaxDepth)
+	{
+		AddEdgeSpans(StartEdge, WedgeStart, WedgeEnd, LimitRadius);
+		return;
+	}
+
+	//Active edges span the whole wedge, which is less than PI, so two of them can only cross once inside it.
+	//An edge that is further than the nearest at both ends is further all the way across, so the nearest only changes where the start and end edges cross.
+	auto& A = Edges[StartEdge];
+	auto& B = Edges[EndEdge];
+
+	double Denominator = A.Delta ^ B.Delta;
+
+	double SplitAngle = (WedgeStart + WedgeEnd) * 0.5;
+
+	if (FMath::Abs(Denominator) > UE_SMALL_NUMBER)
+	{
+		FVector2D Crossing = A.From + A.Delta * (((B.From - A.From) ^ B.Delta) / Denominator);
+
+		double CrossingAngle = GetSweepAngle(Crossing);
+
+		if (CrossingAngle > WedgeStart + Nudge && CrossingAngle < WedgeEnd - Nudge)
+			SplitAngle = CrossingAngle;
+	}
+
+	AddWedge(ActiveEdges, WedgeStart, SplitAngle, Depth + 1);
+	AddWedge(ActiveEdges, SplitAngle, WedgeEnd, Depth + 1);
+}
+
+void FFogOfWarVisibilityPolygon::AddEdgeSpans(int32 EdgeIndex, double WedgeStart, double WedgeEnd, double LimitRadius)
+{
+	auto& Edge = Edges[EdgeIndex];
+
+	//The edge line crosses the limit circle at most twice, splitting the wedge into parts in front of and behind the limit
+	TArray<double, TInlineAllocator<4>> Splits{ WedgeStart };
+
+	double A = Edge.Delta.SizeSquared();
+	double B = 2.0 * (Edge.From | Edge.Delta);
+	double C = Edge.From.SizeSquared() - FMath::Square(LimitRadius);
+
+	double Discriminant = B * B - 4.0 * A * C;
+
+	if (A > UE_SMALL_NUMBER && Discriminant > 0.0)
+	{
+		double Root = FMath::Sqrt(Discriminant);
+
+		for (double Alpha : { (-B - Root) / (2.0 * A), (-B + Root) / (2.0 * A) })
+		{
+			double Angle = GetSweepAngle(Edge.From + Edge.Delta * Alpha);
+
+			if (Angle > WedgeStart && Angle < WedgeEnd)
+				Splits.Add(Angle);
+		}
+	}
+
+	Splits.Sort();
+
+	Splits.Add(WedgeEnd);
+
+	for (int32 Index = 0; Index + 1 < Splits.Num(); ++Index)
+	{
+		double SplitMiddle = (Splits[Index] + Splits[Index + 1]) * 0.5;
+
+		if (Edge.GetDistance(GetRay(SplitMiddle)) < LimitRadius)
+			AddSpan(Splits[Index], Splits[Index + 1], EdgeIndex, 0.0);
+		else
+			AddSpan(Splits[Index], Splits[Index + 1], INDEX_NONE, LimitRadius);
+	}
+}
+
+void FFogOfWarVisibilityPolygon::AddSpan(double SpanStart, double SpanEnd, int32 Edge, double SpanRadius)
+{
+	if (Spans.Num() > 0)
+	{
+		auto& Last = Spans.Last();
+
+		if (Last.Edge == Edge && Last.Radius == SpanRadius && Last.EndAngle == SpanStart)
+		{
+			Last.EndAngle = SpanEnd;
+			return;
+		}
+	}
+
+	Spans.Add(FSpan{ SpanStart, SpanEnd, Edge, SpanRadius });
+}
@@ -10,6 +10,7 @@
 #include "FogOfWarOccluderSubsystem.h"
 #include "FogOfWarUtils.h"
 #include "FogOfWarActor.h"
+#include "TeamVisibilitySubsystem.h"
 
 static TAutoConsoleVariable<bool> FogOfWarVisionDebug
 (
@@ -25,6 +26,24 @@ static TAutoConsoleVariable<bool> FogOfWarVisionShadows
 	TEXT("Enable or disable shadows in fog of war vision components.")
 );
 
+static TAutoConsoleVariable<bool> FogOfWarVisionPolygon
+(
+	TEXT("FogOfWar.Vision.Polygon"),
+	true,
+	TEXT("Draw vision and test visibility with a visibility polygon swept on the CPU, instead of drawing shadow triangles for every occluder edge.")
+);
+
+//Shows how much duplicate shadow work the deduplicating occluder query removes, see "stat FogOfWar"
+DECLARE_DWORD_COUNTER_STAT(TEXT("Occluder Cell Entries Walked"), STAT_FogOfWarOccluderCellEntries, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Occluders Drawn"), STAT_FogOfWarOccludersDrawn, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Duplicate Occluders Skipped"), STAT_FogOfWarDuplicateOccluders, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Shadow Edges Drawn"), STAT_FogOfWarShadowEdges, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Duplicate Shadow Edges Skipped"), STAT_FogOfWarDuplicateShadowEdges, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Visibility Polygon Edges"), STAT_FogOfWarVisibilityPolygonEdges, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Visibility Polygon Spans"), STAT_FogOfWarVisibilityPolygonSpans, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vision Cache Hits"), STAT_FogOfWarVisionCacheHits, STATGROUP_FogOfWar);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Vision Cache Misses"), STAT_FogOfWarVisionCacheMisses, STATGROUP_FogOfWar);
+
 UFogOfWarVisionComponent::UFogOfWarVisionComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
@@ -39,19 +58,21 @@ void UFogOfWarVisionComponent::BeginPlay()
 	//if (auto FoundManager = AFogOfWarManager::GetFogOfWarManager(this))
 	//	SetFogOfWarManager(FoundManager);
 
-	FTimerHandle Handle;
-
-	//Overlap detection can be done at a slower rate than whatever tick we want to do, so decouple it from tick
-	//Also has a random initial delay so that all the actors on spawn don't all tick their components on the same frame.
-	//GetWorld()->GetTimerManager().SetTimer(Handle, this, &UFogOfWarVisionComponent::UpdateVisionOverlaps, VisionActorsUpdateFrequency, true, FMath::FRand() * VisionActorsUpdateFrequency);
+	//Overlap detection can be done at a slower rate than whatever tick we want to do, so the subsystem updates it on its own schedule
+	//Also has a random initial delay so that all the actors on spawn don't all update their components on the same frame.
+	NextVisibleActorsUpdateTime = GetWorld()->GetTimeSeconds() + FMath::FRand() * VisionActorsUpdateFrequency;
 
-	UpdateVisionOverlaps();
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+		Subsystem->RegisterVisionComponent(this);
 }
 
 void UFogOfWarVisionComponent::EndPlay(EEndPlayReason::Type Reason)
 {
 	Super::EndPlay(Reason);
 
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+		Subsystem->UnregisterVisionComponent(this);
+
 	ClearVisibleActors();
 
 	//SetFogOfWarManager(nullptr);
@@ -61,8 +82,7 @@ void UFogOfWarVisionComponent::TickComponent(float DeltaTime, ELevelTick TickTyp
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	UpdateVisionOverlaps();
-
+	//Vision overlaps are updated by UFogOfWarSubsystem
 }
 
 void UFogOfWarVisionComponent::DrawVision(class UFogOfWarDisplayComponent* DisplayComponent, FCanvas& DisplayCanvas)
@@ -76,35 +96,38 @@ void UFogOfWarVisionComponent::DrawVision(class UFogOfWarDisplayComponent* Displ
 
 	auto CompositorTransform = GetVisionCanvasTransform();
 
-	auto CompositorBounds = GetVisionCanvasBounds();
-
-	bool bIsInDisplayRegion = FogOfWarUtils::GetCanvasBounds(DisplayComponent->GetDisplayCanvasTransform()).Intersect(CompositorBounds);
-	
 	auto CompositorRenderTarget = DisplayComponent->GetCompositorRenderTarget();
 
 	auto CompositorCanvas = FogOfWarUtils::BeginDrawingCanvas(GetWorld(), CompositorTransform, CompositorRenderTarget);
 
-	FVector2D VisionCentre{ GetComponentLocation() };
-
 	CompositorCanvas.Clear(FLinearColor::Black);
 
-	//Self vision circle
-	CompositorCanvas.DrawNGon(VisionCentre, FColor::White, 16, SelfVisionRadius);
+	DrawVisionArea(CompositorCanvas);
 
-	FogOfWarUtils::DrawCone(CompositorCanvas, VisionCentre, FVector2D{ GetForwardVector() }.GetSafeNormal(), VisionRadius, GetHalfFOVInRadians());
-	
-	//for (auto& Occluder : OverlappingVisionOccluders)
-	//	DrawOccluderShadow(Occluder, CompositorCanvas, VisionCentre, VisionRadius, GlobalShadowBias);
+	FogOfWarUtils::EndDrawingCanvas(CompositorCanvas, CompositorRenderTarget);
 
-	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
-		for (auto It = Subsystem->GetStaticOccluders().WorldBoxQuery(CompositorBounds); It; ++It)
-			DrawOccluderShadow(*It, CompositorCanvas, VisionCentre, VisionRadius, GlobalShadowBias);
+	CompositeVision(DisplayComponent, DisplayCanvas, CompositorRenderTarget, FBox2D{ FVector2D::ZeroVector, FVector2D::UnitVector });
+}
 
-	FogOfWarUtils::EndDrawingCanvas(CompositorCanvas, CompositorRenderTarget);
+void UFogOfWarVisionComponent::DrawVisionArea(FCanvas& Canvas)
+{
+	if (IsVisibilityPolygonEnabled())
+		DrawVisibilityPolygon(Canvas);
+	else
+		DrawVisionShadows(Canvas, GetVisionCanvasBounds());
+}
+
+void UFogOfWarVisionComponent::CompositeVision(UFogOfWarDisplayComponent* DisplayComponent, FCanvas& DisplayCanvas, UTexture* VisionTexture, const FBox2D& VisionUVs)
+{
+	auto CompositorTransform = GetVisionCanvasTransform();
+
+	auto CompositorBounds = GetVisionCanvasBounds();
+
+	bool bIsInDisplayRegion = FogOfWarUtils::GetCanvasBounds(DisplayComponent->GetDisplayCanvasTransform()).Intersect(CompositorBounds);
 
 	//Only bother drawing in the display if we're actually going to be in the visible region
 	if (bIsInDisplayRegion)
-		FogOfWarUtils::DrawTexturedQuad(DisplayCanvas, CompositorTransform, CompositorRenderTarget, FLinearColor::White, SE_BLEND_Additive);
+		FogOfWarUtils::DrawTexturedQuad(DisplayCanvas, CompositorTransform, VisionTexture, VisionUVs, FLinearColor::White, SE_BLEND_Additive);
 
 	//@todo: depending on game and level design, might want to discover areas in range regardless of occluders blocking direct vision
 	//In that case, we could skip shadows and compositing entirely if we're not in the display region and instead simply render vision directly to the discovered areas canvas
@@ -113,13 +136,85 @@ void UFogOfWarVisionComponent::DrawVision(class UFogOfWarDisplayComponent* Displ
 	{
 		auto& DiscoveredAreaCanvas = DisplayComponent->BeginDrawDiscoveredArea(Cell);
 
-		FogOfWarUtils::DrawTexturedQuad(DiscoveredAreaCanvas, CompositorTransform, CompositorRenderTarget, FLinearColor::White, SE_BLEND_Additive);
+		FogOfWarUtils::DrawTexturedQuad(DiscoveredAreaCanvas, CompositorTransform, VisionTexture, VisionUVs, FLinearColor::White, SE_BLEND_Additive);
+
+	};
+
+	if (IsVisibilityPolygonEnabled())
+	{
+		//The display tracks which texels have been discovered, so only the cells where this vision discovers something new need drawing into
+		TArray<FIntPoint, TInlineAllocator<16>> DiscoveredCells;
+
+		DisplayComponent->DiscoverVisionArea(this, DiscoveredCells);
+
+		//Bitmasks are filled by DiscoverVisionArea, so there is nothing to draw
+		if (!DisplayComponent->IsUsingDiscoveredAreaBitmasks())
+			for (auto Cell : DiscoveredCells)
+				DrawDiscoveredArea(Cell);
 
+		return;
+	}
+
+	auto DrawIncompleteDiscoveredArea = [&](FIntPoint Cell)
+	{
+		if (!DisplayComponent->IsDiscoveredAreaComplete(Cell))
+			DrawDiscoveredArea(Cell);
 	};
 
-	DisplayComponent->ForEachDiscoveredArea(DisplayComponent->WorldToDiscoveredAreas(CompositorBounds), DrawDiscoveredArea);
+	DisplayComponent->ForEachDiscoveredArea(DisplayComponent->WorldToDiscoveredAreas(CompositorBounds), DrawIncompleteDiscoveredArea);
+}
+
+bool UFogOfWarVisionComponent::IsVisibilityPolygonEnabled()
+{
+	return FogOfWarVisionPolygon.GetValueOnGameThread();
+}
+
+void UFogOfWarVisionComponent::DrawVisibilityPolygon(FCanvas& Canvas)
+{
+	UpdateVisibilityPolygon();
+
+	FogOfWarUtils::DrawTriangleFan(Canvas, VisibilityPolygon.GetCentre(), VisibilityBoundary);
+}
+
+void UFogOfWarVisionComponent::DrawVisionShadows(FCanvas& Canvas, const FBox2D& CanvasBounds)
+{
+	FVector2D VisionCentre{ GetComponentLocation() };
 
+	//Self vision circle
+	Canvas.DrawNGon(VisionCentre, FColor::White, 16, SelfVisionRadius);
+
+	FogOfWarUtils::DrawCone(Canvas, VisionCentre, FVector2D{ GetForwardVector() }.GetSafeNormal(), VisionRadius, GetHalfFOVInRadians());
 	
+	//for (auto& Occluder : OverlappingVisionOccluders)
+	//	DrawOccluderShadow(Occluder, Canvas, VisionCentre, VisionRadius, GlobalShadowBias);
+
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+	{
+		auto WorldEdges = Subsystem->GetStaticOccluderEdges();
+
+		auto It = Subsystem->GetStaticOccluders().WorldBoxQuery(CanvasBounds);
+
+		for (; It; ++It)
+		{
+			DrawOccluderShadow(*It, WorldEdges.Get(), Canvas, VisionCentre, VisionRadius, GlobalShadowBias);
+
+#if STATS
+			//Occluders spanning several cells are only drawn once, count the draws a per cell walk would have repeated
+			int32 NumShadowEdges = It->OccluderMesh ? It->OccluderMesh->ShadowEdges.Num() : 0;
+			int32 NumDuplicates = It.GetNumCellsOverlapping(It.GetLocalGeometry()) - 1;
+
+			INC_DWORD_STAT(STAT_FogOfWarOccludersDrawn);
+			INC_DWORD_STAT_BY(STAT_FogOfWarShadowEdges, NumShadowEdges);
+			INC_DWORD_STAT_BY(STAT_FogOfWarDuplicateOccluders, NumDuplicates);
+			INC_DWORD_STAT_BY(STAT_FogOfWarDuplicateShadowEdges, NumDuplicates * NumShadowEdges);
+#endif
+		}
+
+		INC_DWORD_STAT_BY(STAT_FogOfWarOccluderCellEntries, It.GetNumVisitedCellEntries());
+
+		for (auto DynamicIt = Subsystem->GetDynamicOccluders().WorldBoxQuery(CanvasBounds); DynamicIt; ++DynamicIt)
+			DrawOccluderShadow(*DynamicIt, nullptr, Canvas, VisionCentre, VisionRadius, GlobalShadowBias);
+	}
 }
 
 bool UFogOfWarVisionComponent::CanSeePoint(const FVector& Point) const
@@ -138,52 +233,88 @@ bool UFogOfWarVisionComponent::CanSeePoint(const FVector& Point) const
 		//Point is approximately on top of the vision source, so we will consider it trivially visible.
 		return true;
 
-	if (PointDistSqr > FMath::Square(SelfVisionRadius))
+	if (!GetViewer().IsInVisionCone(FVector2D{ Point }))
+		return false;
+
+	if (IsVisibilityPolygonCurrent())
 	{
-		//If point is further than the 360 degree self vision, check against the fov cone
-		auto PointAngleCos = (VisionToPoint * FMath::InvSqrtEst(PointDistSqr)) | (FVector2D{ GetForwardVector() }.GetSafeNormal());
+		//The polygon has the exact visible boundary, so no need to trace against the occluders again
+		bool bVisible = VisibilityPolygon.IsPointVisible(FVector2D{ Point });
 
-		if (PointAngleCos < FMath::Cos(GetHalfFOVInRadians()))
-			return false;
+		if (FogOfWarVisionDebug.GetValueOnGameThread())
+			DrawDebugLine(GetWorld(), GetComponentLocation(), Point, bVisible ? FColor::Magenta : FColor::Red, false, VisionActorsUpdateFrequency);
+
+		return bVisible;
 	}
 
-	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+	//Transforms the occluder's mesh edges, for occluders without baked edges
+	auto IsBlockedByMeshEdges = [&](const FFogOfWarOccluderInstance& Occluder)
 	{
-		//@todo: this should probably step the ray through the grid rather than querying a box that contains the ray
-		FBox2D QueryBox{ ForceInit };
-
-		QueryBox += VisionLocation;
-		QueryBox += FVector2D{ Point };
+		if (!Occluder.OccluderMesh)
+			return false;
 
-		for (auto It = Subsystem->GetStaticOccluders().WorldBoxQuery(QueryBox); It; ++It)
+		for (auto& Segment : Occluder.OccluderMesh->ShadowEdges)
 		{
-			auto& Occluder = *It;
+			//Unused, but needed for SegmentIntersection2D overload
+			FVector IntersectionPoint;
+
+			FVector From{ Occluder.Transform.TransformPosition(FVector{ Segment.Key, 0.0 }) };
 
-			if (!Occluder.OccluderMesh)
-				continue;
+			FVector To{ Occluder.Transform.TransformPosition(FVector{ Segment.Value, 0.0 }) };
 
-			for (auto& Segment : Occluder.OccluderMesh->ShadowEdges)
+			if (FMath::SegmentIntersection2D(GetComponentLocation(), Point, From, To, IntersectionPoint))
 			{
-				//Unused, but needed for SegmentIntersection2D overload
-				FVector IntersectionPoint;
+				if (FogOfWarVisionDebug.GetValueOnGameThread())
+				{
+					DrawDebugLine(GetWorld(), GetComponentLocation(), IntersectionPoint, FColor::Green, false, VisionActorsUpdateFrequency);
+					DrawDebugPoint(GetWorld(), IntersectionPoint, 10.f, FColor::Red, false, VisionActorsUpdateFrequency);
+					DrawDebugLine(GetWorld(), IntersectionPoint, Point, FColor::Red, false, VisionActorsUpdateFrequency);
+				}
+
+				return true;
+			}
+		}
 
-				FVector From{ Occluder.Transform.TransformPosition(FVector{ Segment.Key, 0.0 }) };
+		return false;
+	};
 
-				FVector To{ Occluder.Transform.TransformPosition(FVector{ Segment.Value, 0.0 }) };
+	if (auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>())
+	{
+		auto WorldEdges = Subsystem->GetStaticOccluderEdges();
 
-				if (FMath::SegmentIntersection2D(GetComponentLocation(), Point, From, To, IntersectionPoint))
+		//Step the ray through the grid, so only the cells it actually crosses are visited
+		for (auto It = Subsystem->GetStaticOccluders().WorldSegmentQuery(VisionLocation, FVector2D{ Point }); It; ++It)
+		{
+			auto& Occluder = *It;
+
+			if (WorldEdges && Occluder.HasWorldEdges())
+			{
+				int32 Edge = WorldEdges->FindIntersectingEdge(Occluder.FirstWorldEdge, Occluder.NumWorldEdges, VisionLocation, FVector2D{ Point });
+
+				if (Edge == INDEX_NONE)
+					continue;
+
+				if (FogOfWarVisionDebug.GetValueOnGameThread())
 				{
-					if (FogOfWarVisionDebug.GetValueOnGameThread())
-					{
-						DrawDebugLine(GetWorld(), GetComponentLocation(), IntersectionPoint, FColor::Green, false, VisionActorsUpdateFrequency);
-						DrawDebugPoint(GetWorld(), IntersectionPoint, 10.f, FColor::Red, false, VisionActorsUpdateFrequency);
-						DrawDebugLine(GetWorld(), IntersectionPoint, Point, FColor::Red, false, VisionActorsUpdateFrequency);
-					}
-
-					return false;
+					FVector IntersectionPoint;
+
+					FMath::SegmentIntersection2D(GetComponentLocation(), Point, FVector{ WorldEdges->GetFrom(Edge), 0.0 }, FVector{ WorldEdges->GetTo(Edge), 0.0 }, IntersectionPoint);
+
+					DrawDebugLine(GetWorld(), GetComponentLocation(), IntersectionPoint, FColor::Green, false, VisionActorsUpdateFrequency);
+					DrawDebugPoint(GetWorld(), IntersectionPoint, 10.f, FColor::Red, false, VisionActorsUpdateFrequency);
+					DrawDebugLine(GetWorld(), IntersectionPoint, Point, FColor::Red, false, VisionActorsUpdateFrequency);
 				}
+
+				return false;
 			}
+
+			if (IsBlockedByMeshEdges(Occluder))
+				return false;
 		}
+
+		for (auto It = Subsystem->GetDynamicOccluders().WorldSegmentQuery(VisionLocation, FVector2D{ Point }); It; ++It)
+			if (IsBlockedByMeshEdges(*It))
+				return false;
 	}
 
 	if (FogOfWarVisionDebug.GetValueOnGameThread())
@@ -192,17 +323,91 @@ bool UFogOfWarVisionComponent::CanSeePoint(const FVector& Point) const
 	return true;
 }
 
+void UFogOfWarVisionComponent::CanSeePoints(TArrayView<const FVector> Points, TBitArray<>& OutVisible) const
+{
+	QUICK_SCOPE_CYCLE_COUNTER(CanSeePoints);
+
+	OutVisible.Init(false, Points.Num());
+
+	auto Viewer = GetViewer();
+
+	FVector2D VisionLocation = Viewer.Location;
+
+	bool bUsePolygon = IsVisibilityPolygonCurrent();
+
+	//Points that passed the range and cone checks, but still need a line of sight test
+	TArray<FVector2D, TInlineAllocator<64>> Targets;
+
+	TArray<int32, TInlineAllocator<64>> TargetIndices;
+
+	for (int32 Index = 0; Index < Points.Num(); ++Index)
+	{
+		FVector2D Point{ Points[Index] };
+
+		if (!Viewer.IsInVisionCone(Point))
+			continue;
+
+		if ((Point - VisionLocation).SizeSquared() < KINDA_SMALL_NUMBER)
+			OutVisible[Index] = true;
+		else if (bUsePolygon)
+			OutVisible[Index] = VisibilityPolygon.IsPointVisible(Point);
+		else
+		{
+			Targets.Add(Point);
+			TargetIndices.Add(Index);
+		}
+	}
+
+	if (Targets.Num() == 0)
+		return;
+
+	auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>();
+
+	if (!Subsystem)
+	{
+		for (int32 Index : TargetIndices)
+			OutVisible[Index] = true;
+
+		return;
+	}
+
+	auto WorldEdges = Subsystem->GetStaticOccluderEdges();
+
+	auto CanvasBounds = GetVisionCanvasBounds();
+
+	//Every target is inside the canvas bounds, so one contiguous set of edges covers all of their lines of sight
+	FFogOfWarEdgeBuffer ViewerEdges;
+
+	if (WorldEdges)
+		for (auto It = Subsystem->GetStaticOccluders().WorldBoxQuery(CanvasBounds); It; ++It)
+			if (It->HasWorldEdges())
+				ViewerEdges.AppendEdges(*WorldEdges, It->FirstWorldEdge, It->NumWorldEdges);
+
+	for (auto It = Subsystem->GetDynamicOccluders().WorldBoxQuery(CanvasBounds); It; ++It)
+		ViewerEdges.AppendOccluderEdges(*It);
+
+	TBitArray<> TargetsVisible;
+
+	ViewerEdges.FindVisiblePoints(VisionLocation, Targets, TargetsVisible);
+
+	for (int32 Index = 0; Index < Targets.Num(); ++Index)
+		OutVisible[TargetIndices[Index]] = TargetsVisible[Index];
+}
+
 FTransform UFogOfWarVisionComponent::GetVisionCanvasTransform(bool bForceSquareAspectRatio) const
 {
 	//Form a bounding box that encloses the "pie slice" that is visible
 
 	double HalfFOVRad = GetHalfFOVInRadians();
 
+	//The self vision circle extends behind and to the sides of narrow cones
+	double ClampedSelfVisionRadius = FMath::Clamp(SelfVisionRadius, 0.0, VisionRadius);
+
 	//Clamp to only expand in the back quadrant
-	double MinAxialDistance = FMath::Cos(FMath::Clamp(HalfFOVRad, PI * 0.5, PI)) * VisionRadius;
+	double MinAxialDistance = FMath::Min(FMath::Cos(FMath::Clamp(HalfFOVRad, PI * 0.5, PI)) * VisionRadius, -ClampedSelfVisionRadius);
 
 	//Clamp to only expand in the front quadrant
-	double Width = FMath::Sin(FMath::Clamp(HalfFOVRad, 0.0, PI * 0.5)) * VisionRadius;
+	double Width = FMath::Max(FMath::Sin(FMath::Clamp(HalfFOVRad, 0.0, PI * 0.5)) * VisionRadius, ClampedSelfVisionRadius);
 
 	FRotator Rotation{ 0.0, GetComponentRotation().Yaw, 0.0 };
 
@@ -218,7 +423,15 @@ FTransform UFogOfWarVisionComponent::GetVisionCanvasTransform(bool bForceSquareA
 		Extent.Y = Extent.X;
 	}
 
-	return FTransform{ Rotation, Center, Extent };
+	FTransform Transform{ Rotation, Center, Extent };
+
+	//Snapping moves the canvas by up to half the snap size, which has to stay within the padding
+	double SnapSize = FMath::Min(VisionCanvasSnapSize, VisionCanvasPadding);
+
+	if (SnapSize > 0.0)
+		return FogOfWarUtils::GetSnappedCanvasTransform(Transform, FVector2D{ SnapSize });
+
+	return Transform;
 }
 
 FBox2D UFogOfWarVisionComponent::GetVisionCanvasBounds(bool bForceSquareAspectRatio) const
@@ -226,9 +439,11 @@ FBox2D UFogOfWarVisionComponent::GetVisionCanvasBounds(bool bForceSquareAspectRa
 	return FogOfWarUtils::GetCanvasBounds(GetVisionCanvasTransform(bForceSquareAspectRatio));
 }
 
-void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstance& Occluder, FCanvas& Canvas, FVector2D Centre, double Radius, double ShadowBias) const
+void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstance& Occluder, const FFogOfWarEdgeBuffer* WorldEdges, FCanvas& Canvas, FVector2D Centre, double Radius, double ShadowBias) const
 {
-	if (!Occluder.OccluderMesh)
+	bool bHasWorldEdges = WorldEdges && Occluder.HasWorldEdges();
+
+	if (!bHasWorldEdges && !Occluder.OccluderMesh)
 		return;
 
 	auto DebugDeltaSeconds = GetWorld()->GetDeltaSeconds() * 0.05f;
@@ -244,11 +459,8 @@ void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstanc
 
 	TArray<FCanvasUVTri> ShadowTriangles;
 
-	for (auto& [From, To] : Occluder.OccluderMesh->ShadowEdges)
+	auto AddShadow = [&](FVector2D FromWS, FVector2D ToWS)
 	{
-		FVector2D FromWS{ Occluder.Transform.TransformPosition(FVector{ From, 0.f }) };
-		FVector2D ToWS{ Occluder.Transform.TransformPosition(FVector{ To, 0.f }) };
-
 		//A shadow only needs to be cast far enough to get just outside the vision radius
 		//The shadow edge is just the occluding edge scaled up and away from the vision center, 
 		//so that its closest point lies on the vision circle
@@ -258,7 +470,7 @@ void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstanc
 		double DistanceSqr = (ClosestPoint - Centre).SizeSquared();
 
 		if (DistanceSqr > Radius * Radius)
-			continue;
+			return;
 
 		FVector2D FromOffset = FromWS - Centre;
 		FVector2D ToOffset = ToWS - Centre;
@@ -315,6 +527,18 @@ void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstanc
 		ShadowTriangles.Add(TriangleA);
 		ShadowTriangles.Add(TriangleB);
 
+	};
+
+	if (bHasWorldEdges)
+	{
+		//Baked when the occluders were gathered, so there is nothing to transform
+		for (int32 Index = Occluder.FirstWorldEdge; Index < Occluder.FirstWorldEdge + Occluder.NumWorldEdges; ++Index)
+			AddShadow(WorldEdges->GetFrom(Index), WorldEdges->GetTo(Index));
+	}
+	else
+	{
+		for (auto& [From, To] : Occluder.OccluderMesh->ShadowEdges)
+			AddShadow(FVector2D{ Occluder.Transform.TransformPosition(FVector{ From, 0.f }) }, FVector2D{ Occluder.Transform.TransformPosition(FVector{ To, 0.f }) });
 	}
 
 	if (ShadowTriangles.Num() == 0)
@@ -326,21 +550,124 @@ void UFogOfWarVisionComponent::DrawOccluderShadow(const FFogOfWarOccluderInstanc
 		Canvas.DrawItem(ShadowTrianglesItem);
 }
 
+void UFogOfWarVisionComponent::UpdateVisibilityPolygon()
+{
+	//Overlaps and drawing usually share one check, unless the component moved in between
+	if (IsVisibilityPolygonCurrent())
+		return;
+
+	QUICK_SCOPE_CYCLE_COUNTER(UpdateVisibilityPolygon);
+
+	VisibilityPolygonFrame = GFrameCounter;
+
+	auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>();
+
+	auto CanvasTransform = GetVisionCanvasTransform();
+
+	auto CanvasBounds = FogOfWarUtils::GetCanvasBounds(CanvasTransform);
+
+	auto Key = MakeVisionCacheKey(CanvasTransform, Subsystem ? Subsystem->GetOccludersVersion(CanvasBounds) : 0);
+
+	//Nothing the vision depends on has changed, so the polygon and anything drawn from it can be reused
+	if (VisionCacheVersion > 0 && Key == VisionCacheKey)
+	{
+		INC_DWORD_STAT(STAT_FogOfWarVisionCacheHits);
+		return;
+	}
+
+	INC_DWORD_STAT(STAT_FogOfWarVisionCacheMisses);
+
+	VisionCacheKey = Key;
+
+	++VisionCacheVersion;
+
+	VisibilityPolygon.Reset(FVector2D{ GetComponentLocation() }, FVector2D{ GetForwardVector() }.GetSafeNormal(), VisionRadius, GetHalfFOVInRadians(), SelfVisionRadius);
+
+	if (Subsystem && Key.bShadows)
+	{
+		auto WorldEdges = Subsystem->GetStaticOccluderEdges();
+
+		auto It = Subsystem->GetStaticOccluders().WorldBoxQuery(CanvasBounds);
+
+		for (; It; ++It)
+			VisibilityPolygon.AddOccluder(*It, GlobalShadowBias, WorldEdges.Get());
+
+		INC_DWORD_STAT_BY(STAT_FogOfWarOccluderCellEntries, It.GetNumVisitedCellEntries());
+
+		for (auto DynamicIt = Subsystem->GetDynamicOccluders().WorldBoxQuery(CanvasBounds); DynamicIt; ++DynamicIt)
+			VisibilityPolygon.AddOccluder(*DynamicIt, GlobalShadowBias);
+	}
+
+	VisibilityPolygon.Build();
+
+	VisibilityPolygon.GetBoundary(VisibilityBoundary);
+
+	INC_DWORD_STAT_BY(STAT_FogOfWarVisibilityPolygonEdges, VisibilityPolygon.NumEdges());
+	INC_DWORD_STAT_BY(STAT_FogOfWarVisibilityPolygonSpans, VisibilityPolygon.NumSpans());
+}
+
+FFogOfWarVisionCacheKey UFogOfWarVisionComponent::MakeVisionCacheKey(const FTransform& CanvasTransform, uint32 OccludersVersion) const
+{
+	FFogOfWarVisionCacheKey Key;
+
+	Key.CanvasLocation = FVector2D{ CanvasTransform.GetLocation() };
+
+	Key.Yaw = CanvasTransform.Rotator().Yaw;
+
+	Key.VisionRadius = VisionRadius;
+
+	Key.VisionFieldOfViewDeg = VisionFieldOfViewDeg;
+
+	Key.SelfVisionRadius = SelfVisionRadius;
+
+	Key.ShadowBias = GlobalShadowBias;
+
+	Key.bShadows = FogOfWarVisionShadows.GetValueOnGameThread();
+
+	Key.OccludersVersion = OccludersVersion;
+
+	return Key;
+}
+
+bool UFogOfWarVisionComponent::IsVisibilityPolygonCurrent() const
+{
+	//Occluder changes are picked up the next frame, so the version checked earlier this frame still holds
+	return IsVisibilityPolygonEnabled()
+		&& VisionCacheVersion > 0
+		&& VisibilityPolygonFrame == GFrameCounter
+		&& MakeVisionCacheKey(GetVisionCanvasTransform(), VisionCacheKey.OccludersVersion) == VisionCacheKey;
+}
+
 double UFogOfWarVisionComponent::GetHalfFOVInRadians() const
 {
 	return FMath::Abs(FMath::DegreesToRadians(FMath::Clamp(VisionFieldOfViewDeg * 0.5, 0.0, 180.0)));
 }
 
-
-void UFogOfWarVisionComponent::UpdateVisionOverlaps()
+FFogOfWarViewer UFogOfWarVisionComponent::GetViewer() const
 {
-	QUICK_SCOPE_CYCLE_COUNTER(UpdateVisionOverlaps);
+	FFogOfWarViewer Viewer;
 
-	auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>();
+	Viewer.Location = FVector2D{ GetComponentLocation() };
 
-	auto OldVisibleActors = MoveTemp(VisibleActors);
+	Viewer.Forward = FVector2D{ GetForwardVector() }.GetSafeNormal();
+
+	Viewer.VisionRadius = VisionRadius;
+
+	Viewer.SelfVisionRadius = SelfVisionRadius;
+
+	Viewer.CosHalfFOV = FMath::Cos(GetHalfFOVInRadians());
+
+	return Viewer;
+}
 
-	TArray<AActor*> NewlyVisibleActors;
+
+void UFogOfWarVisionComponent::UpdateVisionOverlaps(TArrayView<const TWeakObjectPtr<AActor>> Candidates)
+{
+	QUICK_SCOPE_CYCLE_COUNTER(UpdateVisionOverlaps);
+
+	//Fog of war actors generally decide their visibility with CanSeePoint, which uses the polygon when it is current
+	if (IsVisibilityPolygonEnabled())
+		UpdateVisibilityPolygon();
 
 	auto VisionCanvasBounds = GetVisionCanvasBounds();
 
@@ -353,42 +680,69 @@ void UFogOfWarVisionComponent::UpdateVisionOverlaps()
 		DrawDebugBox(GetWorld(), FVector{ Center, 150.0 }, FVector{ Extent, 1.0}, FColor::Magenta, false, GetWorld()->GetDeltaSeconds() * 1.05f);
 	}
 
-	for (auto It = Subsystem->GetFogOfWarActors().WorldBoxQuery(VisionCanvasBounds); It; ++It)
+	TSet<AActor*> NewVisibleActors;
+
+	//Actors that are only visible at their location are tested together, so the occluders around the component are only gathered once
+	TArray<AActor*, TInlineAllocator<64>> PointActors;
+
+	TArray<FVector, TInlineAllocator<64>> Points;
+
+	for (auto& Candidate : Candidates)
 	{
-		if (!It->IsValid())
+		if (!Candidate.IsValid())
 			continue;
 
-		auto Actor = It->Get();
+		auto Actor = Candidate.Get();
 
-		bool bActorVisible = IFogOfWarActor::Execute_IsFogOfWarVisible(Actor, this);
+		auto FogOfWarActor = Cast<IFogOfWarActor>(Actor);
 
-		if (bActorVisible)
+		if (FogOfWarActor && FogOfWarActor->IsFogOfWarVisibleAtActorLocation())
 		{
-			VisibleActors.Add(Actor);
-
-			if (!OldVisibleActors.Contains(Actor))
-				NewlyVisibleActors.Add(Actor);
-			
+			PointActors.Add(Actor);
+			Points.Add(Actor->GetActorLocation());
 		}
+		else if (IFogOfWarActor::Execute_IsFogOfWarVisible(Actor, this))
+			NewVisibleActors.Add(Actor);
 	}
 
-	bool bVisibleActorsChanged = NewlyVisibleActors.Num() > 0;
+	TBitArray<> PointsVisible;
 
-	for (auto Actor : OldVisibleActors)
-		if (!VisibleActors.Contains(Actor))
-		{
-			bVisibleActorsChanged = true;
+	CanSeePoints(Points, PointsVisible);
 
-			if (IsValid(Actor))
-				IFogOfWarActor::Execute_SetFogOfWarVisionVisibility(Actor, this, false);
-		}
+	for (int32 Index = 0; Index < PointActors.Num(); ++Index)
+		if (PointsVisible[Index])
+			NewVisibleActors.Add(PointActors[Index]);
+
+	SetVisibleActors(MoveTemp(NewVisibleActors));
+}
+
+void UFogOfWarVisionComponent::SetVisibleActors(TSet<AActor*>&& NewVisibleActors)
+{
+	auto OldVisibleActors = MoveTemp(VisibleActors);
+
+	auto OldVisibleActorsTeam = VisibleActorsTeam;
+
+	VisibleActors = MoveTemp(NewVisibleActors);
+
+	VisibleActorsTeam = FGenericTeamId::GetTeamIdentifier(GetOwner());
 
-	for (auto Actor : NewlyVisibleActors)
-		IFogOfWarActor::Execute_SetFogOfWarVisionVisibility(Actor, this, true);
+	//The team subsystem counts how many of a team's components see each actor, and only notifies actors when the team as a whole starts or stops seeing them
+	if (auto TeamVisibility = GetWorld()->GetSubsystem<UTeamVisibilitySubsystem>())
+		TeamVisibility->UpdateVisionComponent(this, OldVisibleActorsTeam, OldVisibleActors, VisibleActorsTeam, VisibleActors);
+
+	bool bVisibleActorsChanged = OldVisibleActorsTeam != VisibleActorsTeam || OldVisibleActors.Num() != VisibleActors.Num();
+
+	if (!bVisibleActorsChanged)
+		for (auto Actor : VisibleActors)
+			if (!OldVisibleActors.Contains(Actor))
+			{
+				bVisibleActorsChanged = true;
+
+				break;
+			}
 
 	if (bVisibleActorsChanged)
 		OnVisibleActorsUpdated.Broadcast(this, OldVisibleActors, VisibleActors);
-
 }
 
 //void UFogOfWarVisionComponent::SetFogOfWarManager(AFogOfWarManager* NewManager)
@@ -406,17 +760,7 @@ void UFogOfWarVisionComponent::UpdateVisionOverlaps()
 
 void UFogOfWarVisionComponent::ClearVisibleActors()
 {
-	auto OldVisibleActors = MoveTemp(VisibleActors);
-
-	for (auto Actor : OldVisibleActors)
-	{
-		if (!Actor)
-			continue;
-
-		IFogOfWarActor::Execute_SetFogOfWarVisionVisibility(Actor, this, false);
-	}
-
-	OnVisibleActorsUpdated.Broadcast(this, OldVisibleActors, VisibleActors);
+	SetVisibleActors({});
 }
 
 
@@ -9,6 +9,7 @@
 #include "WeaponItem.h"
 #include "AIController.h"
 #include "UtilityComponent.h"
+#include "TeamVisibilitySubsystem.h"
 
 APlayerUnit::APlayerUnit()
 {
@@ -22,7 +23,8 @@ APlayerUnit::APlayerUnit()
 
 void APlayerUnit::BeginPlay()
 {
-	FogOfWarVisionComponent->OnVisibleActorsUpdated.AddDynamic(this, &APlayerUnit::OnVisibleActorsUpdated);
+	if (auto TeamVisibility = GetWorld()->GetSubsystem<UTeamVisibilitySubsystem>())
+		TeamVisibility->OnVisibleActorsUpdated.AddDynamic(this, &APlayerUnit::OnTeamVisibleActorsUpdated);
 
 	Super::BeginPlay();
 }
@@ -54,7 +56,7 @@ void APlayerUnit::RegisterWeapon_Implementation(AWeaponItem* WeaponItem)
 		if (auto UtilityComponent = Cast<UUtilityComponent>(AIController->GetBrainComponent()))
 			WeaponItem->SetUtilityComponent(UtilityComponent);
 	
-	WeaponItem->RelevantActors = FogOfWarVisionComponent->GetVisibleActors();
+	WeaponItem->SetRelevantTeam(GetGenericTeamId());
 
 	WeaponItem->NotifyRelevantActorsUpdated();
 }
@@ -66,19 +68,34 @@ void APlayerUnit::UnregisterWeapon_Implementation(AWeaponItem* WeaponItem)
 
 	WeaponItem->SetUtilityComponent(nullptr);
 
-	WeaponItem->RelevantActors.Empty();
+	WeaponItem->SetRelevantTeam(FGenericTeamId::NoTeam);
 
 	WeaponItem->NotifyRelevantActorsUpdated();
 
 }
 
-void APlayerUnit::OnVisibleActorsUpdated(UFogOfWarVisionComponent* VisionComponent, const TSet<AActor*>& OldVisible, const TSet<AActor*>& NewVisible)
+void APlayerUnit::OnTeamVisibleActorsUpdated(FGenericTeamId Team, const TArray<AActor*>& AddedActors, const TArray<AActor*>& RemovedActors)
 {
-	//Push visible actors to any equipped items so they can run their attack logic
+	if (Team != GetGenericTeamId() || RegisteredWeapons.Num() == 0)
+		return;
+
+	auto IsHostile = [Team](AActor* Actor)
+	{
+		return FGenericTeamId::GetAttitude(Team, FGenericTeamId::GetTeamIdentifier(Actor)) == ETeamAttitude::Hostile;
+	};
+
+	//Removed actors that already ended play can't be checked, so they might have been a target
+	bool bHostileActorsChanged = AddedActors.ContainsByPredicate([&](AActor* Actor) { return IsValid(Actor) && IsHostile(Actor); })
+		|| RemovedActors.ContainsByPredicate([&](AActor* Actor) { return !IsValid(Actor) || IsHostile(Actor); });
+
+	if (!bHostileActorsChanged)
+		return;
+
+	//Equipped items read the team's visible actors in place, they just need to know to run their attack logic again
 	for (auto Weapon : RegisteredWeapons)
 		if (IsValid(Weapon))
 		{
-			Weapon->RelevantActors = NewVisible;
+			Weapon->SetRelevantTeam(Team);
 			Weapon->NotifyRelevantActorsUpdated();
 		}
 }
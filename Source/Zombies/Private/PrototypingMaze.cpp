@@ -18,9 +18,25 @@ APrototypingMaze::APrototypingMaze()
 
 	SetRootComponent(Root);
 	
-	//WallMeshes = CreateDefaultSubobject<UInstancedStaticMeshComponent>("WallMeshes");
+	WallMeshes = CreateDefaultSubobject<UInstancedStaticMeshComponent>("WallMeshes");
 
-	//WallMeshes->SetupAttachment(GetRootComponent());
+	WallMeshes->SetupAttachment(GetRootComponent());
+
+	WallMeshes->SetMobility(EComponentMobility::Static);
+
+	WallMeshes->SetCollisionProfileName("BlockAll");
+
+	WallMeshes->SetCollisionResponseToChannel(ECC_GameTraceChannel1, ECollisionResponse::ECR_Overlap);
+}
+
+void APrototypingMaze::OnConstruction(const FTransform& Transform)
+{
+	Super::OnConstruction(Transform);
+
+	//Static components can only change mesh during construction
+	WallMeshes->SetStaticMesh(WallMesh);
+
+	WallMeshes->SetMaterial(0, WallMaterial);
 }
 
 // Called when the game starts or when spawned
@@ -281,7 +297,7 @@ void APrototypingMaze::InsertDoors()
 
 void APrototypingMaze::BuildWalls()
 {
-	//WallMeshes->ClearInstances();
+	WallMeshes->ClearInstances();
 
 	auto BuildWall = [&](FIntPoint CenterLocation, FIntPoint OtherDirection)
 	{
@@ -295,28 +311,7 @@ void APrototypingMaze::BuildWalls()
 
 		FTransform Transform{ Rotation, Location, WallMeshScale };
 
-		auto MeshComponent = NewObject<UStaticMeshComponent>(this);
-
-		MeshComponent->SetStaticMesh(WallMesh);
-
-		MeshComponent->SetMaterial(0, WallMaterial);
-
-		MeshComponent->SetupAttachment(GetRootComponent());
-
-		MeshComponent->SetRelativeTransform(Transform);
-
-		MeshComponent->SetCollisionProfileName("BlockAll");
-
-		MeshComponent->SetCollisionResponseToChannel(ECC_GameTraceChannel1, ECollisionResponse::ECR_Overlap);
-
-		MeshComponent->SetMobility(EComponentMobility::Static);
-
-		MeshComponent->RegisterComponent();
-
-
-
-		//WallMeshes->AddInstance(Transform);
-
+		WallMeshes->AddInstance(Transform);
 	};
 
 	for (auto& VoronoiCell : VoronoiCells)
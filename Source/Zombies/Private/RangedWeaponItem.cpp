@@ -9,6 +9,7 @@
 #include "ShootAbility.h"
 #include "FocusComponent.h"
 #include "DrawDebugHelpers.h"
+#include "FogOfWarSubsystem.h"
 
 void UUtilityTask_RangedWeapon::SetPawn(APawn* InPawn)
 {
@@ -67,23 +68,8 @@ void UUtilityTask_RangedWeapon::UpdateScore_Implementation()
 
 	CQP.AddIgnoredActor(Pawn);
 
-	for (auto Actor : WeaponItem->RelevantActors)
+	auto ScoreCandidate = [&](AActor* Actor)
 	{
-		if (!IsValid(Actor))
-			continue;
-
-		if (Actor->Implements<UUnitInterface>())
-			if (IUnitInterface::Execute_IsDead(Actor))
-				continue;
-
-		FGenericTeamId ActorTeamId;
-
-		if (auto TeamAgent = Cast<IGenericTeamAgentInterface>(Actor))
-			ActorTeamId = TeamAgent->GetGenericTeamId();
-
-		if (FGenericTeamId::GetAttitude(PawnTeamId, ActorTeamId) != ETeamAttitude::Hostile)
-			continue;
-
 		FVector Direction;
 		
 		double Distance;
@@ -91,7 +77,7 @@ void UUtilityTask_RangedWeapon::UpdateScore_Implementation()
 		(Actor->GetActorLocation() - Pawn->GetActorLocation()).ToDirectionAndLength(Direction, Distance);
 
 		if (Distance > MaxDistance)
-			continue;
+			return;
 
 		auto DistanceScore = FMath::Max((MaxDistance - Distance) / MaxDistance, 0.0) * NormalizedDistanceWeight;
 
@@ -111,7 +97,7 @@ void UUtilityTask_RangedWeapon::UpdateScore_Implementation()
 			CurrentScore += CurrentTargetBonus;
 
 		if (BestScore && CurrentScore <= *BestScore)
-			continue;
+			return;
 
 		//@note: slight differences between fog of war shadows and actual collision meshes may effect this.
 		//So figure out what exact metric we want later on.
@@ -123,11 +109,56 @@ void UUtilityTask_RangedWeapon::UpdateScore_Implementation()
 			bHasLineOfSight = HitResult.GetActor() == Actor;
 
 		if (!bHasLineOfSight)
-			continue;
+			return;
 
 		BestScore = CurrentScore;
 		BestTarget = Actor;
 		
+	};
+
+	//Shared with the rest of the team, so don't copy it
+	const auto& RelevantActors = WeaponItem->GetRelevantActors();
+
+	auto Subsystem = GetWorld()->GetSubsystem<UFogOfWarSubsystem>();
+
+	if (MaxCandidates > 0 && Subsystem)
+	{
+		//Only the closest hostile relevant actors are worth scoring, so find them with the spatial hash instead of scoring every relevant actor.
+		//The search radius is 2D, so it never misses an actor that is within the 3D MaxDistance checked when scoring.
+		TArray<FSpatialHashMapNearestElement> Nearest;
+
+		auto IsCandidate = [&](const TWeakObjectPtr<AActor>& Actor)
+		{
+			return Actor.IsValid() && RelevantActors.Contains(Actor.Get()) && IsHostileTarget(Actor.Get(), PawnTeamId);
+		};
+
+		const auto& FogOfWarActors = Subsystem->GetFogOfWarActors();
+
+		FogOfWarActors.WorldNearestK(FVector2D{ Pawn->GetActorLocation() }, MaxCandidates, MaxDistance, Nearest, IsCandidate);
+
+		TArray<AActor*, TInlineAllocator<16>> Candidates;
+
+		for (auto& Element : Nearest)
+			Candidates.Add(FogOfWarActors.GetValue(Element.ElementID).Get());
+
+		//Keep scoring the current target even when closer actors push it out of the nearest, so it is not dropped just for being further away
+		if (OldShootTarget && !Candidates.Contains(OldShootTarget) && RelevantActors.Contains(OldShootTarget) && IsHostileTarget(OldShootTarget, PawnTeamId))
+			Candidates.Add(OldShootTarget);
+
+		for (auto Actor : Candidates)
+			ScoreCandidate(Actor);
+
+		//None of the nearest could be shot, E.G. they are all behind a wall, so look past them at every other relevant actor
+		if (!BestTarget)
+			for (auto Actor : RelevantActors)
+				if (!Candidates.Contains(Actor) && IsHostileTarget(Actor, PawnTeamId))
+					ScoreCandidate(Actor);
+	}
+	else
+	{
+		for (auto Actor : RelevantActors)
+			if (IsHostileTarget(Actor, PawnTeamId))
+				ScoreCandidate(Actor);
 	}
 
 	if (BestScore && BestTarget)
@@ -141,6 +172,23 @@ void UUtilityTask_RangedWeapon::UpdateScore_Implementation()
 
 }
 
+bool UUtilityTask_RangedWeapon::IsHostileTarget(AActor* Actor, FGenericTeamId PawnTeamId) const
+{
+	if (!IsValid(Actor))
+		return false;
+
+	if (Actor->Implements<UUnitInterface>())
+		if (IUnitInterface::Execute_IsDead(Actor))
+			return false;
+
+	FGenericTeamId ActorTeamId;
+
+	if (auto TeamAgent = Cast<IGenericTeamAgentInterface>(Actor))
+		ActorTeamId = TeamAgent->GetGenericTeamId();
+
+	return FGenericTeamId::GetAttitude(PawnTeamId, ActorTeamId) == ETeamAttitude::Hostile;
+}
+
 void UUtilityTask_RangedWeapon::BeginTask_Implementation()
 {
 	Super::BeginTask_Implementation();
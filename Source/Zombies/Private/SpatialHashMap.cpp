@@ -3,3 +3,34 @@
 
 #include "SpatialHashMap.h"
 
+DEFINE_STAT(STAT_SpatialHashAdds);
+DEFINE_STAT(STAT_SpatialHashMoves);
+DEFINE_STAT(STAT_SpatialHashRemoves);
+DEFINE_STAT(STAT_SpatialHashQueries);
+DEFINE_STAT(STAT_SpatialHashElementsVisited);
+DEFINE_STAT(STAT_SpatialHashElementsAccepted);
+
+FVector2D FSpatialHashMapStats::SuggestCellSize(const FVector2D& CurrentCellSize, double TargetOccupancy, double MaxCellsPerElement) const
+{
+	if (NumCellEntries == 0 || TargetOccupancy <= 0.0 || MaxCellsPerElement <= 0.0)
+		return CurrentCellSize;
+
+	//Crowding scales with cell area, so scale each side by the square root
+	double Scale = FMath::Sqrt(TargetOccupancy / GetMeanCrowding());
+
+	//Shrinking cells copies box elements into more cells, roughly by the inverse of the area scale
+	Scale = FMath::Max(Scale, FMath::Sqrt(GetMeanCellsPerElement() / MaxCellsPerElement));
+
+	return CurrentCellSize * Scale;
+}
+
+FString FSpatialHashMapStats::ToString() const
+{
+	FString Result = FString::Printf(TEXT("%d elements, %d cells, %d cell entries (%.2f cells per element), max %d per cell, mean %.2f per cell, mean crowding %.2f"),
+		NumElements, NumCells, NumCellEntries, GetMeanCellsPerElement(), MaxElementsPerCell, GetMeanElementsPerCell(), GetMeanCrowding());
+
+	for (int32 Bucket = 0; Bucket < OccupancyHistogram.Num(); ++Bucket)
+		Result += FString::Printf(TEXT("\n  %d-%d per cell: %d cells"), 1 << Bucket, (1 << (Bucket + 1)) - 1, OccupancyHistogram[Bucket]);
+
+	return Result;
+}
@@ -0,0 +1,168 @@
+//Copyright Jarrad Alexander 2022
+
+
+#include "TeamVisibilitySubsystem.h"
+#include "FogOfWarActor.h"
+#include "FogOfWarVisionComponent.h"
+#include "GameFramework/Pawn.h"
+
+void UTeamVisibilitySubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	struct FUpdatedTeam
+	{
+		uint8 Team;
+
+		TArray<AActor*> AddedActors;
+
+		TArray<AActor*> RemovedActors;
+	};
+
+	TArray<FUpdatedTeam, TInlineAllocator<8>> UpdatedTeams;
+
+	for (auto& [Team, TeamVisibleActors] : Teams)
+		if (TeamVisibleActors.AddedActors.Num() > 0 || TeamVisibleActors.RemovedActors.Num() > 0)
+			UpdatedTeams.Add({ Team, MoveTemp(TeamVisibleActors.AddedActors), MoveTemp(TeamVisibleActors.RemovedActors) });
+
+	//Listeners can change visibility, so broadcast after iterating
+	for (auto& UpdatedTeam : UpdatedTeams)
+		OnVisibleActorsUpdated.Broadcast(FGenericTeamId{ UpdatedTeam.Team }, UpdatedTeam.AddedActors, UpdatedTeam.RemovedActors);
+}
+
+void FTeamVisibleActors::RecordChange(AActor* Actor, bool bIsVisible)
+{
+	auto& Opposite = bIsVisible ? RemovedActors : AddedActors;
+
+	//Changing back before anyone was told cancels out
+	if (Opposite.RemoveSingleSwap(Actor) == 0)
+		(bIsVisible ? AddedActors : RemovedActors).Add(Actor);
+}
+
+void UTeamVisibilitySubsystem::UpdateVisionComponent(UFogOfWarVisionComponent* Component, FGenericTeamId OldTeam, const TSet<AActor*>& OldVisible, FGenericTeamId NewTeam, const TSet<AActor*>& NewVisible)
+{
+	//Marked before anything is added, so actors the player's units see are shown straight away.
+	//Only one player at the moment and the player never leaves their team, so this is never cleared.
+	if (IsValid(Component) && IsValid(Component->GetOwner()))
+		if (auto Pawn = Component->GetOwner()->GetOwner<APawn>())
+			if (Pawn->IsPlayerControlled())
+				Teams.FindOrAdd(NewTeam.GetId()).bHasPlayerVision = true;
+
+	//If the component changed teams, everything moves over rather than just the difference
+	bool bSameTeam = OldTeam == NewTeam;
+
+	for (auto Actor : NewVisible)
+		if (!bSameTeam || !OldVisible.Contains(Actor))
+			AddVisibleActor(NewTeam, Actor);
+
+	for (auto Actor : OldVisible)
+		if (!bSameTeam || !NewVisible.Contains(Actor))
+			RemoveVisibleActor(OldTeam, Actor);
+}
+
+const TSet<AActor*>& UTeamVisibilitySubsystem::GetVisibleActors(FGenericTeamId Team) const
+{
+	static const TSet<AActor*> NoVisibleActors;
+
+	auto TeamVisibleActors = Teams.Find(Team.GetId());
+
+	return TeamVisibleActors ? TeamVisibleActors->Actors : NoVisibleActors;
+}
+
+bool UTeamVisibilitySubsystem::IsVisibleToTeam(FGenericTeamId Team, AActor* Actor) const
+{
+	return GetVisibleActors(Team).Contains(Actor);
+}
+
+bool UTeamVisibilitySubsystem::HasPlayerVision(FGenericTeamId Team) const
+{
+	auto TeamVisibleActors = Teams.Find(Team.GetId());
+
+	return TeamVisibleActors && TeamVisibleActors->bHasPlayerVision;
+}
+
+void UTeamVisibilitySubsystem::AddVisibleActor(FGenericTeamId Team, AActor* Actor)
+{
+	auto& TeamVisibleActors = Teams.FindOrAdd(Team.GetId());
+
+	if (TeamVisibleActors.VisionCounts.FindOrAdd(Actor)++ > 0)
+		//Someone else on the team can already see it
+		return;
+
+	TeamVisibleActors.Actors.Add(Actor);
+
+	TeamVisibleActors.RecordChange(Actor, true);
+
+	if (IsValid(Actor))
+	{
+		Actor->OnEndPlay.AddUniqueDynamic(this, &UTeamVisibilitySubsystem::OnVisibleActorEndPlay);
+
+		IFogOfWarActor::Execute_SetFogOfWarVisionVisibility(Actor, Team, true);
+	}
+
+	OnActorVisibilityChanged.Broadcast(Team, Actor, true);
+}
+
+void UTeamVisibilitySubsystem::RemoveVisibleActor(FGenericTeamId Team, AActor* Actor)
+{
+	auto TeamVisibleActors = Teams.Find(Team.GetId());
+
+	if (!TeamVisibleActors)
+		return;
+
+	auto VisionCount = TeamVisibleActors->VisionCounts.Find(Actor);
+
+	if (!VisionCount)
+		return;
+
+	//Make sure nothing went wrong with ref count, would lead to permanent invisible/visible units
+	check(*VisionCount > 0);
+
+	if (--*VisionCount > 0)
+		//Someone else on the team can still see it
+		return;
+
+	TeamVisibleActors->VisionCounts.Remove(Actor);
+
+	TeamVisibleActors->Actors.Remove(Actor);
+
+	TeamVisibleActors->RecordChange(Actor, false);
+
+	if (IsValid(Actor))
+	{
+		if (!IsVisibleToAnyTeam(Actor))
+			Actor->OnEndPlay.RemoveDynamic(this, &UTeamVisibilitySubsystem::OnVisibleActorEndPlay);
+
+		IFogOfWarActor::Execute_SetFogOfWarVisionVisibility(Actor, Team, false);
+	}
+
+	OnActorVisibilityChanged.Broadcast(Team, Actor, false);
+}
+
+bool UTeamVisibilitySubsystem::IsVisibleToAnyTeam(AActor* Actor) const
+{
+	for (auto& [Team, TeamVisibleActors] : Teams)
+		if (TeamVisibleActors.Actors.Contains(Actor))
+			return true;
+
+	return false;
+}
+
+void UTeamVisibilitySubsystem::OnVisibleActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason)
+{
+	TArray<uint8, TInlineAllocator<8>> RemovedFromTeams;
+
+	for (auto& [Team, TeamVisibleActors] : Teams)
+		if (TeamVisibleActors.VisionCounts.Remove(Actor) > 0)
+		{
+			TeamVisibleActors.Actors.Remove(Actor);
+
+			TeamVisibleActors.RecordChange(Actor, false);
+
+			RemovedFromTeams.Add(Team);
+		}
+
+	//Vision components that still count the actor find nothing to remove when they next update
+	for (auto Team : RemovedFromTeams)
+		OnActorVisibilityChanged.Broadcast(FGenericTeamId{ Team }, Actor, false);
+}
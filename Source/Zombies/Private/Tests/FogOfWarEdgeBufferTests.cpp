@@ -0,0 +1,104 @@
+//Copyright Jarrad Alexander 2022
+
+#include "FogOfWarCommon.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+
+//Checks the vectorized edge test of FFogOfWarEdgeBuffer against FMath::SegmentIntersection2D. Run headless with:
+//UnrealEditor-Cmd Zombies.uproject -nullrhi -unattended -ExecCmds="Automation RunTests Zombies.FogOfWar.EdgeBuffer; Quit"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace FogOfWarEdgeBufferTests
+{
+	void AddEdge(FFogOfWarEdgeBuffer& Buffer, const FVector2D& From, const FVector2D& To)
+	{
+		Buffer.X0.Add(float(From.X));
+		Buffer.Y0.Add(float(From.Y));
+		Buffer.X1.Add(float(To.X));
+		Buffer.Y1.Add(float(To.Y));
+	}
+
+	//Small integer coordinates are exact in both float and double, so touching and parallel edges come up often and both tests must agree on them exactly
+	FVector2D RandomGridPoint(FRandomStream& Random)
+	{
+		return FVector2D{ double(Random.RandRange(-8, 8)), double(Random.RandRange(-8, 8)) };
+	}
+
+	//First edge in the span that SegmentIntersection2D says crosses the segment, or INDEX_NONE
+	int32 FindIntersectingEdgeScalar(const FFogOfWarEdgeBuffer& Buffer, int32 First, int32 Count, const FVector2D& From, const FVector2D& To)
+	{
+		for (int32 Index = First; Index < First + Count; ++Index)
+		{
+			FVector IntersectionPoint;
+
+			if (FMath::SegmentIntersection2D(FVector{ From, 0.0 }, FVector{ To, 0.0 }, FVector{ Buffer.GetFrom(Index), 0.0 }, FVector{ Buffer.GetTo(Index), 0.0 }, IntersectionPoint))
+				return Index;
+		}
+
+		return INDEX_NONE;
+	}
+
+	bool CheckSegment(FAutomationTestBase& Test, const FFogOfWarEdgeBuffer& Buffer, int32 First, int32 Count, const FVector2D& From, const FVector2D& To)
+	{
+		int32 Expected = FindIntersectingEdgeScalar(Buffer, First, Count, From, To);
+
+		int32 Found = Buffer.FindIntersectingEdge(First, Count, From, To);
+
+		if (Found == Expected)
+			return true;
+
+		Test.AddError(FString::Printf(TEXT("Edges %d -> %d, segment %s -> %s: found edge %d, expected %d"), First, First + Count, *From.ToString(), *To.ToString(), Found, Expected));
+
+		return false;
+	}
+}
+
+using namespace FogOfWarEdgeBufferTests;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFogOfWarEdgeBufferIntersectionTest, "Zombies.FogOfWar.EdgeBuffer.Intersection", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FFogOfWarEdgeBufferIntersectionTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	//Segments that only touch an edge at an end point count as crossing it
+	{
+		FFogOfWarEdgeBuffer Buffer;
+
+		AddEdge(Buffer, FVector2D{ 0.0, 0.0 }, FVector2D{ 4.0, 0.0 });
+
+		bPassed &= TestEqual(TEXT("Segment ending on edge"), Buffer.FindIntersectingEdge(0, 1, FVector2D{ 2.0, -2.0 }, FVector2D{ 2.0, 0.0 }), 0);
+		bPassed &= TestEqual(TEXT("Segment ending on edge end point"), Buffer.FindIntersectingEdge(0, 1, FVector2D{ 4.0, 4.0 }, FVector2D{ 4.0, 0.0 }), 0);
+		bPassed &= TestEqual(TEXT("Segment passing edge end point"), Buffer.FindIntersectingEdge(0, 1, FVector2D{ 0.0, 4.0 }, FVector2D{ -4.0, -4.0 }), int32(INDEX_NONE));
+		bPassed &= TestEqual(TEXT("Parallel segment"), Buffer.FindIntersectingEdge(0, 1, FVector2D{ 0.0, 1.0 }, FVector2D{ 4.0, 1.0 }), int32(INDEX_NONE));
+	}
+
+	FRandomStream Random{ 1234 };
+
+	//Every count from 1 to 13 and every start offset, so that the 4 wide loop, the scalar tail and unaligned spans are all covered
+	for (int32 Count = 1; Count <= 13; ++Count)
+	{
+		for (int32 First = 0; First < 4; ++First)
+		{
+			for (int32 Trial = 0; Trial < 200 && bPassed; ++Trial)
+			{
+				FFogOfWarEdgeBuffer Buffer;
+
+				for (int32 Index = 0; Index < First + Count; ++Index)
+					AddEdge(Buffer, RandomGridPoint(Random), RandomGridPoint(Random));
+
+				bPassed &= CheckSegment(*this, Buffer, First, Count, RandomGridPoint(Random), RandomGridPoint(Random));
+
+				//From one edge's end point, so the segment always touches at least that edge
+				int32 TouchedEdge = First + Random.RandHelper(Count);
+
+				bPassed &= CheckSegment(*this, Buffer, First, Count, Buffer.GetTo(TouchedEdge), RandomGridPoint(Random));
+			}
+		}
+	}
+
+	return bPassed;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
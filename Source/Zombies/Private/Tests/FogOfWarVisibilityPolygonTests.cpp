@@ -0,0 +1,338 @@
+//Copyright Jarrad Alexander 2022
+
+#include "FogOfWarVisibilityPolygon.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+
+//Checks FFogOfWarVisibilityPolygon::IsPointVisible against a brute force line of sight test over random occluders. Run headless with:
+//UnrealEditor-Cmd Zombies.uproject -nullrhi -unattended -ExecCmds="Automation RunTests Zombies.FogOfWar.VisibilityPolygon; Quit"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace FogOfWarVisibilityPolygonTests
+{
+	struct FViewer
+	{
+		FVector2D Centre;
+
+		double DirectionAngle;
+
+		double Radius;
+
+		double HalfFOV;
+
+		double SelfRadius;
+
+		FVector2D GetDirection() const { return FVector2D{ FMath::Cos(DirectionAngle), FMath::Sin(DirectionAngle) }; }
+	};
+
+	double RandRange(FRandomStream& Random, double Min, double Max)
+	{
+		return Min + (Max - Min) * Random.GetFraction();
+	}
+
+	FVector2D RandomDirection(FRandomStream& Random)
+	{
+		double Angle = RandRange(Random, -PI, PI);
+
+		return FVector2D{ FMath::Cos(Angle), FMath::Sin(Angle) };
+	}
+
+	//Closed loops of 3 to 6 vertices around the origin, or a single open wall
+	TFogOfWarSharedPtr<FFogOfWarOccluderMesh> RandomMesh(FRandomStream& Random)
+	{
+		auto Mesh = MakeShared<FFogOfWarOccluderMesh, FogOfWarSPMode>();
+
+		double Size = RandRange(Random, 20.0, 600.0);
+
+		if (Random.RandHelper(4) == 0)
+		{
+			Mesh->ShadowEdges.Add({ FVector2D{ -Size, 0.0 }, FVector2D{ Size, 0.0 } });
+		}
+		else
+		{
+			int32 NumVertices = Random.RandRange(3, 6);
+
+			TArray<FVector2D, TInlineAllocator<6>> Vertices;
+
+			for (int32 Index = 0; Index < NumVertices; ++Index)
+			{
+				double Angle = 2.0 * PI * (Index + RandRange(Random, 0.1, 0.9)) / NumVertices;
+
+				Vertices.Add(FVector2D{ FMath::Cos(Angle), FMath::Sin(Angle) } * Size * RandRange(Random, 0.5, 1.0));
+			}
+
+			for (int32 Index = 0; Index < NumVertices; ++Index)
+				Mesh->ShadowEdges.Add({ Vertices[Index], Vertices[(Index + 1) % NumVertices] });
+		}
+
+		Mesh->UpdateBounds();
+
+		return Mesh;
+	}
+
+	FTransform RandomTransform(FRandomStream& Random, const FVector2D& Location)
+	{
+		FQuat Rotation{ FVector::UpVector, RandRange(Random, -PI, PI) };
+
+		FVector Scale{ RandRange(Random, 0.5, 2.0), RandRange(Random, 0.5, 2.0), 1.0 };
+
+		return FTransform{ Rotation, FVector{ Location, RandRange(Random, -100.0, 100.0) }, Scale };
+	}
+
+	//Whether the point is in range and inside the cone or the self vision circle, ignoring edges
+	bool IsInVisionRange(const FViewer& Viewer, const FVector2D& Point)
+	{
+		FVector2D Offset = Point - Viewer.Centre;
+
+		double Distance = Offset.Size();
+
+		if (Distance > Viewer.Radius)
+			return false;
+
+		if (Distance <= Viewer.SelfRadius || Viewer.HalfFOV >= PI)
+			return true;
+
+		return FMath::Abs(FMath::FindDeltaAngleRadians(Viewer.DirectionAngle, FMath::Atan2(Offset.Y, Offset.X))) <= Viewer.HalfFOV;
+	}
+
+	bool IsPointVisibleBruteForce(const FViewer& Viewer, TArrayView<const TPair<FVector2D, FVector2D>> WorldEdges, const FVector2D& Point)
+	{
+		if (!IsInVisionRange(Viewer, Point))
+			return false;
+
+		for (auto& [From, To] : WorldEdges)
+		{
+			FVector IntersectionPoint;
+
+			if (FMath::SegmentIntersection2D(FVector{ Viewer.Centre, 0.0 }, FVector{ Point, 0.0 }, FVector{ From, 0.0 }, FVector{ To, 0.0 }, IntersectionPoint))
+				return false;
+		}
+
+		return true;
+	}
+
+	//Points this close to an edge, the vision limits, or with a line of sight that grazes an edge end point can go either way, so they are not checked
+	bool IsAmbiguous(const FViewer& Viewer, TArrayView<const TPair<FVector2D, FVector2D>> WorldEdges, const FVector2D& Point, double Tolerance)
+	{
+		FVector2D Offset = Point - Viewer.Centre;
+
+		double Distance = Offset.Size();
+
+		if (Distance < Tolerance || FMath::Abs(Distance - Viewer.Radius) < Tolerance || FMath::Abs(Distance - Viewer.SelfRadius) < Tolerance)
+			return true;
+
+		if (Viewer.HalfFOV < PI)
+		{
+			double DeltaAngle = FMath::Abs(FMath::FindDeltaAngleRadians(Viewer.DirectionAngle, FMath::Atan2(Offset.Y, Offset.X)));
+
+			if (FMath::Abs(DeltaAngle - Viewer.HalfFOV) * Distance < Tolerance)
+				return true;
+		}
+
+		for (auto& [From, To] : WorldEdges)
+		{
+			if (FMath::PointDistToSegment(FVector{ Point, 0.0 }, FVector{ From, 0.0 }, FVector{ To, 0.0 }) < Tolerance)
+				return true;
+
+			for (auto& EndPoint : { From, To })
+				if (FMath::PointDistToSegment(FVector{ EndPoint, 0.0 }, FVector{ Viewer.Centre, 0.0 }, FVector{ Point, 0.0 }) < Tolerance)
+					return true;
+		}
+
+		return false;
+	}
+
+	//Adds random occluders to the polygon, alternating between transforming mesh edges and reading baked edges, and collects the world edges the polygon sees.
+	//Some occluders are placed where the sweep starts, so that their edges wrap from the end of the sweep back around to the start.
+	void AddRandomOccluders(FRandomStream& Random, const FViewer& Viewer, FFogOfWarVisibilityPolygon& Polygon, FFogOfWarEdgeBuffer& EdgeBuffer, TArray<TPair<FVector2D, FVector2D>>& OutWorldEdges)
+	{
+		bool bFullSweep = Viewer.SelfRadius > 0.0 || Viewer.HalfFOV >= PI;
+
+		double SweepStartAngle = bFullSweep ? Viewer.DirectionAngle - PI : Viewer.DirectionAngle - Viewer.HalfFOV;
+
+		FVector2D SweepStart{ FMath::Cos(SweepStartAngle), FMath::Sin(SweepStartAngle) };
+
+		int32 NumOccluders = Random.RandHelper(13);
+
+		for (int32 Index = 0; Index < NumOccluders; ++Index)
+		{
+			FVector2D Location = Random.RandHelper(3) == 0
+				? Viewer.Centre + SweepStart * RandRange(Random, 100.0, Viewer.Radius * 0.8)
+				: Viewer.Centre + RandomDirection(Random) * RandRange(Random, 0.0, Viewer.Radius * 1.2);
+
+			FFogOfWarOccluderInstance Occluder;
+
+			Occluder.Transform = RandomTransform(Random, Location);
+			Occluder.OccluderMesh = RandomMesh(Random);
+
+			if (Index % 2 == 0)
+			{
+				EdgeBuffer.AddOccluder(Occluder);
+
+				for (int32 Edge = Occluder.FirstWorldEdge; Edge < Occluder.FirstWorldEdge + Occluder.NumWorldEdges; ++Edge)
+					OutWorldEdges.Add({ EdgeBuffer.GetFrom(Edge), EdgeBuffer.GetTo(Edge) });
+			}
+			else
+			{
+				for (auto& [From, To] : Occluder.OccluderMesh->ShadowEdges)
+					OutWorldEdges.Add({ FVector2D{ Occluder.Transform.TransformPosition(FVector{ From, 0.0 }) }, FVector2D{ Occluder.Transform.TransformPosition(FVector{ To, 0.0 }) } });
+			}
+
+			Polygon.AddOccluder(Occluder, 0.0, &EdgeBuffer);
+		}
+	}
+
+	//Random points out to a little past the vision radius. Returns false and stops at the first point the polygon gets wrong.
+	bool CheckPoints(FAutomationTestBase& Test, const TCHAR* Name, FRandomStream& Random, const FViewer& Viewer, const FFogOfWarVisibilityPolygon& Polygon, TArrayView<const TPair<FVector2D, FVector2D>> WorldEdges, int32& NumVisible, int32& NumHidden)
+	{
+		const double Tolerance = Viewer.Radius * 1e-3;
+
+		for (int32 Index = 0; Index < 300; ++Index)
+		{
+			FVector2D Point = Viewer.Centre + RandomDirection(Random) * Viewer.Radius * 1.1 * FMath::Sqrt(Random.GetFraction());
+
+			if (IsAmbiguous(Viewer, WorldEdges, Point, Tolerance))
+				continue;
+
+			bool bExpected = IsPointVisibleBruteForce(Viewer, WorldEdges, Point);
+
+			bool bFound = Polygon.IsPointVisible(Point);
+
+			if (bFound != bExpected)
+			{
+				Test.AddError(FString::Printf(TEXT("%s: centre %s, direction %.4f, half fov %.4f, radius %.1f, self radius %.1f, %d edges: point %s is %s, expected %s"),
+					Name, *Viewer.Centre.ToString(), Viewer.DirectionAngle, Viewer.HalfFOV, Viewer.Radius, Viewer.SelfRadius, WorldEdges.Num(), *Point.ToString(),
+					bFound ? TEXT("visible") : TEXT("hidden"), bExpected ? TEXT("visible") : TEXT("hidden")));
+
+				return false;
+			}
+
+			++(bExpected ? NumVisible : NumHidden);
+		}
+
+		return true;
+	}
+
+	//Builds polygons for random viewers and occluders and checks them against the brute force test
+	bool RunRandomTest(FAutomationTestBase& Test, const TCHAR* Name, FRandomStream& Random, int32 NumTrials, TFunctionRef<FViewer(FRandomStream&)> MakeTrialViewer)
+	{
+		int32 NumVisible = 0;
+		int32 NumHidden = 0;
+
+		FFogOfWarVisibilityPolygon Polygon;
+
+		FFogOfWarEdgeBuffer EdgeBuffer;
+
+		TArray<TPair<FVector2D, FVector2D>> WorldEdges;
+
+		for (int32 Trial = 0; Trial < NumTrials; ++Trial)
+		{
+			FViewer Viewer = MakeTrialViewer(Random);
+
+			Polygon.Reset(Viewer.Centre, Viewer.GetDirection(), Viewer.Radius, Viewer.HalfFOV, Viewer.SelfRadius);
+
+			EdgeBuffer.Reset();
+
+			WorldEdges.Reset();
+
+			AddRandomOccluders(Random, Viewer, Polygon, EdgeBuffer, WorldEdges);
+
+			//Every line of sight starts on an edge that passes through the centre, so which side is visible is arbitrary
+			bool bCentreOnEdge = false;
+
+			for (auto& [From, To] : WorldEdges)
+				bCentreOnEdge |= FMath::PointDistToSegment(FVector{ Viewer.Centre, 0.0 }, FVector{ From, 0.0 }, FVector{ To, 0.0 }) < Viewer.Radius * 1e-3;
+
+			if (bCentreOnEdge)
+				continue;
+
+			Polygon.Build();
+
+			if (!CheckPoints(Test, Name, Random, Viewer, Polygon, WorldEdges, NumVisible, NumHidden))
+				return false;
+		}
+
+		//Both outcomes must come up often, otherwise the comparison proves very little
+		if (NumVisible < NumTrials || NumHidden < NumTrials)
+		{
+			Test.AddError(FString::Printf(TEXT("%s: only %d visible and %d hidden points were checked"), Name, NumVisible, NumHidden));
+			return false;
+		}
+
+		return true;
+	}
+
+	FViewer MakeViewer(FRandomStream& Random, double DirectionAngle, double HalfFOV, double SelfRadius)
+	{
+		return FViewer{ FVector2D{ RandRange(Random, -1000.0, 1000.0), RandRange(Random, -1000.0, 1000.0) }, DirectionAngle, 2000.0, HalfFOV, SelfRadius };
+	}
+
+	//Straight behind, or just either side of it, so the cone straddles the -PI to PI seam of Atan2
+	double RandomSeamAngle(FRandomStream& Random)
+	{
+		switch (Random.RandHelper(3))
+		{
+		case 0:
+			return PI;
+		case 1:
+			return PI - RandRange(Random, 0.0, 0.2);
+		default:
+			return -PI + RandRange(Random, 0.0, 0.2);
+		}
+	}
+}
+
+using namespace FogOfWarVisibilityPolygonTests;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FFogOfWarVisibilityPolygonTest, "Zombies.FogOfWar.VisibilityPolygon", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FFogOfWarVisibilityPolygonTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	//A wall straight ahead hides what is behind it, but not what is beside it
+	{
+		FFogOfWarVisibilityPolygon Polygon;
+
+		Polygon.Reset(FVector2D::ZeroVector, FVector2D{ 1.0, 0.0 }, 1000.0, PI * 0.25, 0.0);
+		Polygon.AddEdge(FVector2D{ 500.0, -100.0 }, FVector2D{ 500.0, 100.0 });
+		Polygon.Build();
+
+		bPassed &= TestTrue(TEXT("In front of wall"), Polygon.IsPointVisible(FVector2D{ 400.0, 0.0 }));
+		bPassed &= TestFalse(TEXT("Behind wall"), Polygon.IsPointVisible(FVector2D{ 600.0, 0.0 }));
+		bPassed &= TestTrue(TEXT("Beside wall"), Polygon.IsPointVisible(FVector2D{ 600.0, 300.0 }));
+		bPassed &= TestFalse(TEXT("Outside of cone"), Polygon.IsPointVisible(FVector2D{ 0.0, 300.0 }));
+		bPassed &= TestFalse(TEXT("Out of range"), Polygon.IsPointVisible(FVector2D{ 1100.0, 0.0 }));
+	}
+
+	FRandomStream Random{ 1234 };
+
+	//Cones of any width in any direction, without self vision, so only the cone is swept
+	bPassed &= RunRandomTest(*this, TEXT("Cone"), Random, 300, [](FRandomStream& Stream)
+	{
+		return MakeViewer(Stream, RandRange(Stream, -PI, PI), RandRange(Stream, 0.05, PI * 0.9), 0.0);
+	});
+
+	//Cones facing the Atan2 seam, so the sweep starts on one side of it and ends on the other
+	bPassed &= RunRandomTest(*this, TEXT("Cone across seam"), Random, 300, [](FRandomStream& Stream)
+	{
+		return MakeViewer(Stream, RandomSeamAngle(Stream), RandRange(Stream, 0.05, PI * 0.9), 0.0);
+	});
+
+	//Self vision sweeps all the way around, with the cone in the middle and only the self vision circle behind
+	bPassed &= RunRandomTest(*this, TEXT("Self vision"), Random, 300, [](FRandomStream& Stream)
+	{
+		return MakeViewer(Stream, Stream.RandHelper(2) == 0 ? RandRange(Stream, -PI, PI) : RandomSeamAngle(Stream), RandRange(Stream, 0.05, PI * 0.9), RandRange(Stream, 100.0, 1500.0));
+	});
+
+	//Full circles, where edges behind the viewer wrap from the end of the sweep back to the start
+	bPassed &= RunRandomTest(*this, TEXT("Full circle"), Random, 300, [](FRandomStream& Stream)
+	{
+		return MakeViewer(Stream, Stream.RandHelper(2) == 0 ? RandRange(Stream, -PI, PI) : RandomSeamAngle(Stream), PI, Stream.RandHelper(2) == 0 ? 0.0 : RandRange(Stream, 100.0, 1500.0));
+	});
+
+	return bPassed;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
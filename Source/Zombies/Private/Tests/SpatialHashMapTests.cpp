@@ -0,0 +1,1059 @@
+//Copyright Jarrad Alexander 2022
+
+#include "SpatialHashMap.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "HAL/MemoryBase.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Parse.h"
+
+//Correctness tests and benchmarks for the spatial hash maps. Run headless with:
+//UnrealEditor-Cmd Zombies.uproject -nullrhi -unattended -ExecCmds="Automation RunTests Zombies.SpatialHash; Quit"
+//Benchmarks print ns/op and allocation counts to the automation log, so container changes can be compared against previous runs.
+//Allocations are only counted when -CountAllocations is also passed on the command line.
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace SpatialHashMapTests
+{
+	using FSparsePointMap = TSpatialHashMap<FVector2D, int32, FSpatialHashMapSparseCells>;
+	using FFlatPointMap = TSpatialHashMap<FVector2D, int32, FSpatialHashMapFlatCells>;
+	using FDensePointMap = TDenseSpatialGridMap<FVector2D, int32>;
+	using FHierarchicalPointMap = THierarchicalSpatialHashMap<FVector2D, int32>;
+
+	using FSparseBoxMap = TSpatialHashMap<FBox2D, int32, FSpatialHashMapSparseCells>;
+	using FFlatBoxMap = TSpatialHashMap<FBox2D, int32, FSpatialHashMapFlatCells>;
+	using FDenseBoxMap = TDenseSpatialGridMap<FBox2D, int32>;
+	using FHierarchicalBoxMap = THierarchicalSpatialHashMap<FBox2D, int32>;
+
+	//Element geometry in the local space of the map, by element ID. Values of the maps under test are their own element IDs.
+	template <typename GeometryType>
+	using TOracle = TMap<int32, GeometryType>;
+
+	//Forwards to the real allocator, counting the allocations made by each thread in a thread local counter.
+	//Only installed when the process is started with -CountAllocations, since it swaps GMalloc while other threads may be allocating.
+	//Installed once and never removed, so other threads can never call into it after it is gone, and everything it forwards is freed by the same allocator.
+	//Every FMalloc virtual is forwarded, so thread caches, stats and heap checks still reach the real allocator.
+	//Platforms that call their allocator directly instead of through GMalloc will always report zero.
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+
+		FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			++NumThreadAllocations;
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			++NumThreadAllocations;
+			return Inner->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+				++NumThreadAllocations;
+
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+				++NumThreadAllocations;
+
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override
+		{
+			Inner->Free(Original);
+		}
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override
+		{
+			return Inner->QuantizeSize(Count, Alignment);
+		}
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override
+		{
+			return Inner->GetAllocationSize(Original, SizeOut);
+		}
+
+		virtual void Trim(bool bTrimThreadCaches) override
+		{
+			Inner->Trim(bTrimThreadCaches);
+		}
+
+		virtual bool IsInternallyThreadSafe() const override
+		{
+			return Inner->IsInternallyThreadSafe();
+		}
+
+		virtual const TCHAR* GetDescriptiveName() override
+		{
+			return Inner->GetDescriptiveName();
+		}
+
+		virtual void InitializeStatsMetadata() override
+		{
+			Inner->InitializeStatsMetadata();
+		}
+
+		virtual void UpdateStats() override
+		{
+			Inner->UpdateStats();
+		}
+
+		virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override
+		{
+			Inner->GetAllocatorStats(OutStats);
+		}
+
+		virtual void DumpAllocatorStats(FOutputDevice& Ar) override
+		{
+			Inner->DumpAllocatorStats(Ar);
+		}
+
+		virtual bool ValidateHeap() override
+		{
+			return Inner->ValidateHeap();
+		}
+
+		virtual void SetupTLSCachesOnCurrentThread() override
+		{
+			Inner->SetupTLSCachesOnCurrentThread();
+		}
+
+		virtual void MarkTLSCachesAsUsedOnCurrentThread() override
+		{
+			Inner->MarkTLSCachesAsUsedOnCurrentThread();
+		}
+
+		virtual void MarkTLSCachesAsUnusedOnCurrentThread() override
+		{
+			Inner->MarkTLSCachesAsUnusedOnCurrentThread();
+		}
+
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override
+		{
+			Inner->ClearAndDisableTLSCachesOnCurrentThread();
+		}
+
+		virtual void OnMallocInitialized() override
+		{
+			Inner->OnMallocInitialized();
+		}
+
+		virtual void OnPreFork() override
+		{
+			Inner->OnPreFork();
+		}
+
+		virtual void OnPostFork() override
+		{
+			Inner->OnPostFork();
+		}
+
+		virtual bool Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& Ar) override
+		{
+			return Inner->Exec(InWorld, Cmd, Ar);
+		}
+
+		//Allocations made by the calling thread since the counting allocator was installed
+		static int64 GetNumThreadAllocations() { return NumThreadAllocations; }
+
+		//Wraps GMalloc the first time it is called, if the process was started with -CountAllocations. Returns null when allocations are not counted.
+		//Deliberately leaked, since memory allocated through it can be freed at any point until exit.
+		static FCountingMalloc* Install()
+		{
+			static FCountingMalloc* Installed = []() -> FCountingMalloc*
+			{
+				if (!FParse::Param(FCommandLine::Get(), TEXT("CountAllocations")))
+					return nullptr;
+
+				auto Counter = new FCountingMalloc(GMalloc);
+
+				//Threads that already read the old GMalloc keep calling the real allocator directly, which is safe since both free through it
+				FPlatformAtomics::InterlockedExchangePtr((void**)&GMalloc, Counter);
+
+				return Counter;
+			}();
+
+			return Installed;
+		}
+
+	protected:
+
+		FMalloc* Inner;
+
+		static thread_local int64 NumThreadAllocations;
+	};
+
+	thread_local int64 FCountingMalloc::NumThreadAllocations = 0;
+
+	//Counts allocations made by the calling thread during its lifetime. Allocations on other threads are not included.
+	struct FScopedAllocationCounter
+	{
+		FScopedAllocationCounter() : bCounting(FCountingMalloc::Install() != nullptr)
+		{
+			StartAllocations = FCountingMalloc::GetNumThreadAllocations();
+		}
+
+		//-1 if allocations are not being counted
+		int64 GetNumAllocations() const { return bCounting ? FCountingMalloc::GetNumThreadAllocations() - StartAllocations : -1; }
+
+	protected:
+
+		bool bCounting = false;
+
+		int64 StartAllocations = 0;
+	};
+
+	struct FBenchmarkResult
+	{
+		double NanosecondsPerOp = 0.0;
+
+		//-1 if allocations are not being counted
+		int64 NumAllocations = 0;
+
+		//Averages the time of one of NumFrames measured frames into this result, and totals their allocations
+		void AddFrame(const FBenchmarkResult& Frame, int32 NumFrames)
+		{
+			NanosecondsPerOp += Frame.NanosecondsPerOp / NumFrames;
+			NumAllocations = Frame.NumAllocations < 0 ? -1 : NumAllocations + Frame.NumAllocations;
+		}
+
+		FString ToString() const
+		{
+			if (NumAllocations < 0)
+				return FString::Printf(TEXT("%.1f ns/op, allocs not counted (run with -CountAllocations)"), NanosecondsPerOp);
+
+			return FString::Printf(TEXT("%.1f ns/op, %lld allocs"), NanosecondsPerOp, NumAllocations);
+		}
+	};
+
+	template <typename FuncType>
+	FBenchmarkResult Measure(int32 NumOps, FuncType&& Func)
+	{
+		FScopedAllocationCounter Allocations;
+
+		double StartTime = FPlatformTime::Seconds();
+
+		Func();
+
+		double Elapsed = FPlatformTime::Seconds() - StartTime;
+
+		return FBenchmarkResult{ Elapsed * 1e9 / FMath::Max(NumOps, 1), Allocations.GetNumAllocations() };
+	}
+
+	template <typename MapType>
+	void InitMap(MapType& Map, const FBox2D& WorldBounds, FVector2D CellSize)
+	{
+		Map.SetTransform(WorldBounds.Min, CellSize);
+	}
+
+	template <typename GeometryType, typename ValueType>
+	void InitMap(TDenseSpatialGridMap<GeometryType, ValueType>& Map, const FBox2D& WorldBounds, FVector2D CellSize)
+	{
+		Map.SetBounds(WorldBounds, CellSize);
+	}
+
+	bool Overlaps(const FBox2D& QueryBox, const FVector2D& Point)
+	{
+		return QueryBox.IsInside(Point);
+	}
+
+	bool Overlaps(const FBox2D& QueryBox, const FBox2D& Box)
+	{
+		return QueryBox.Intersect(Box);
+	}
+
+	double RandRange(FRandomStream& Random, double Min, double Max)
+	{
+		return Min + (Max - Min) * Random.GetFraction();
+	}
+
+	FVector2D RandomPoint(FRandomStream& Random, const FBox2D& Bounds)
+	{
+		return FVector2D{ RandRange(Random, Bounds.Min.X, Bounds.Max.X), RandRange(Random, Bounds.Min.Y, Bounds.Max.Y) };
+	}
+
+	//Boxes from tiny props up to walls many cells long
+	FBox2D RandomBox(FRandomStream& Random, const FBox2D& Bounds)
+	{
+		FVector2D Centre = RandomPoint(Random, Bounds);
+
+		double Size = FMath::Pow(10.0, RandRange(Random, 1.0, 3.7));
+
+		FVector2D Extent{ Size * RandRange(Random, 0.05, 0.5), Size * RandRange(Random, 0.05, 0.5) };
+
+		return FBox2D{ Centre - Extent, Centre + Extent };
+	}
+
+	FVector2D RandomGeometry(FRandomStream& Random, const FBox2D& Bounds, const FVector2D*)
+	{
+		return RandomPoint(Random, Bounds);
+	}
+
+	FBox2D RandomGeometry(FRandomStream& Random, const FBox2D& Bounds, const FBox2D*)
+	{
+		return RandomBox(Random, Bounds);
+	}
+
+	template <typename GeometryType>
+	GeometryType RandomGeometry(FRandomStream& Random, const FBox2D& Bounds)
+	{
+		return RandomGeometry(Random, Bounds, (const GeometryType*)nullptr);
+	}
+
+	template <typename MapType>
+	bool CheckBoxQuery(FAutomationTestBase& Test, const TCHAR* Name, const MapType& Map, const TOracle<typename MapType::GeometryType>& Oracle, const FBox2D& WorldBox)
+	{
+		TArray<int32> Found;
+
+		for (auto It = Map.WorldBoxQuery(WorldBox); It; ++It)
+			Found.Add(*It);
+
+		TArray<int32> Expected;
+
+		FBox2D LocalBox = Map.WorldToLocal(WorldBox);
+
+		for (auto& [ElementID, LocalGeometry] : Oracle)
+			if (Overlaps(LocalBox, LocalGeometry))
+				Expected.Add(ElementID);
+
+		Found.Sort();
+		Expected.Sort();
+
+		if (Found != Expected)
+		{
+			Test.AddError(FString::Printf(TEXT("%s: box query %s found %d elements, expected %d"), Name, *WorldBox.ToString(), Found.Num(), Expected.Num()));
+			return false;
+		}
+
+		return true;
+	}
+
+	//Only box elements, since point elements are reported for every crossed cell rather than by distance to the segment
+	template <typename MapType>
+	bool CheckSegmentQuery(FAutomationTestBase& Test, const TCHAR* Name, const MapType& Map, const TOracle<FBox2D>& Oracle, const FVector2D& WorldFrom, const FVector2D& WorldTo)
+	{
+		TArray<int32> Found;
+
+		for (auto It = Map.WorldSegmentQuery(WorldFrom, WorldTo); It; ++It)
+			Found.Add(*It);
+
+		TArray<int32> Expected;
+
+		FVector2D LocalFrom = Map.WorldToLocal(WorldFrom);
+		FVector2D Direction = Map.WorldToLocal(WorldTo) - LocalFrom;
+		FVector2D InvDirection{ Direction.X != 0.0 ? 1.0 / Direction.X : 0.0, Direction.Y != 0.0 ? 1.0 / Direction.Y : 0.0 };
+
+		for (auto& [ElementID, LocalBox] : Oracle)
+			if (SpatialHashMapUtils::SegmentIntersectsBox(LocalFrom, InvDirection, LocalBox))
+				Expected.Add(ElementID);
+
+		Found.Sort();
+		Expected.Sort();
+
+		if (Found != Expected)
+		{
+			Test.AddError(FString::Printf(TEXT("%s: segment query %s to %s found %d elements, expected %d"), Name, *WorldFrom.ToString(), *WorldTo.ToString(), Found.Num(), Expected.Num()));
+			return false;
+		}
+
+		return true;
+	}
+
+	template <typename MapType>
+	bool CheckNearestK(FAutomationTestBase& Test, const TCHAR* Name, const MapType& Map, const TOracle<typename MapType::GeometryType>& Oracle, const FVector2D& WorldCenter, int32 K, double MaxRadius)
+	{
+		//Odd element IDs only, to cover the filter
+		auto Filter = [](int32 ElementID) { return ElementID % 2 == 1; };
+
+		TArray<FSpatialHashMapNearestElement> Found;
+
+		Map.WorldNearestK(WorldCenter, K, MaxRadius, Found, Filter);
+
+		TArray<double> Expected;
+
+		for (auto& [ElementID, LocalGeometry] : Oracle)
+		{
+			double DistanceSquared = SpatialHashMapUtils::DistanceSquared(Map.LocalToWorld(LocalGeometry), WorldCenter);
+
+			if (DistanceSquared <= FMath::Square(MaxRadius) && Filter(ElementID))
+				Expected.Add(DistanceSquared);
+		}
+
+		Expected.Sort();
+
+		if (Expected.Num() > K)
+			Expected.SetNum(K);
+
+		bool bMatches = Found.Num() == Expected.Num();
+
+		for (int32 Index = 0; bMatches && Index < Found.Num(); ++Index)
+			bMatches = FMath::IsNearlyEqual(Found[Index].DistanceSquared, Expected[Index], 1e-6 * (1.0 + Expected[Index]));
+
+		if (!bMatches)
+		{
+			Test.AddError(FString::Printf(TEXT("%s: nearest %d to %s within %.1f found %d elements, expected %d"), Name, K, *WorldCenter.ToString(), MaxRadius, Found.Num(), Expected.Num()));
+			return false;
+		}
+
+		return true;
+	}
+
+	//Random adds, moves, batched moves and removes, checked against a brute force oracle every so often
+	template <typename MapType>
+	bool RunChurnTest(FAutomationTestBase& Test, const TCHAR* Name, int32 NumSteps)
+	{
+		using GeometryType = typename MapType::GeometryType;
+
+		FRandomStream Random{ 1234 };
+
+		//Some geometry falls outside of the bounds, to cover the border cells of bounded maps
+		const FBox2D MapBounds{ FVector2D{ -5000.0, -4000.0 }, FVector2D{ 5000.0, 4500.0 } };
+		const FBox2D SpawnBounds = MapBounds.ExpandBy(1000.0);
+
+		MapType Map;
+
+		InitMap(Map, MapBounds, FVector2D{ 400.0, 300.0 });
+
+		TOracle<GeometryType> Oracle;
+
+		TArray<int32> BatchIDs;
+		TArray<GeometryType> BatchGeometries;
+
+		auto RandomElementID = [&]()
+		{
+			auto It = Oracle.CreateConstIterator();
+
+			for (int32 Skip = Random.RandHelper(Oracle.Num()); Skip > 0; --Skip)
+				++It;
+
+			return It.Key();
+		};
+
+		for (int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			int32 Op = Random.RandHelper(10);
+
+			if (Op < 4 || Oracle.Num() < 16)
+			{
+				int32 ElementID = Map.AddElementWorldSpace(RandomGeometry<GeometryType>(Random, SpawnBounds), 0);
+
+				Map.GetValue(ElementID) = ElementID;
+
+				Oracle.Add(ElementID, Map.GetGeometry(ElementID));
+			}
+			else if (Op < 7)
+			{
+				int32 ElementID = RandomElementID();
+
+				Map.MoveElementWorldSpace(ElementID, RandomGeometry<GeometryType>(Random, SpawnBounds));
+
+				Oracle[ElementID] = Map.GetGeometry(ElementID);
+			}
+			else if (Op < 8)
+			{
+				BatchIDs.Reset();
+				BatchGeometries.Reset();
+
+				for (int32 Index = 0; Index < 64; ++Index)
+					BatchIDs.AddUnique(RandomElementID());
+
+				for (int32 Index = 0; Index < BatchIDs.Num(); ++Index)
+					BatchGeometries.Add(RandomGeometry<GeometryType>(Random, SpawnBounds));
+
+				Map.MoveElementsWorldSpace(BatchIDs, BatchGeometries);
+
+				for (int32 ElementID : BatchIDs)
+					Oracle[ElementID] = Map.GetGeometry(ElementID);
+			}
+			else
+			{
+				int32 ElementID = RandomElementID();
+
+				Map.RemoveElement(ElementID);
+
+				Oracle.Remove(ElementID);
+			}
+
+			if (Step % 500 != 0)
+				continue;
+
+			for (int32 Query = 0; Query < 20; ++Query)
+			{
+				FVector2D Centre = RandomPoint(Random, SpawnBounds);
+				FVector2D Extent{ RandRange(Random, 10.0, 3000.0), RandRange(Random, 10.0, 3000.0) };
+
+				if (!CheckBoxQuery(Test, Name, Map, Oracle, FBox2D{ Centre - Extent, Centre + Extent }))
+					return false;
+
+				if (!CheckNearestK(Test, Name, Map, Oracle, Centre, 1 + Random.RandHelper(12), RandRange(Random, 50.0, 4000.0)))
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	//Crowds many times denser than the cells, moved in large batches, so every batched move groups its cell changes by cell.
+	//The sparser churn test above mostly falls back to moving elements one at a time.
+	template <typename MapType>
+	bool RunCrowdedChurnTest(FAutomationTestBase& Test, const TCHAR* Name, int32 NumSteps)
+	{
+		FRandomStream Random{ 5678 };
+
+		//16 cells holding about 128 points each
+		const FBox2D MapBounds{ FVector2D{ -1000.0, -1000.0 }, FVector2D{ 1000.0, 1000.0 } };
+
+		MapType Map;
+
+		InitMap(Map, MapBounds, FVector2D{ 500.0, 500.0 });
+
+		TOracle<FVector2D> Oracle;
+
+		auto AddRandomElement = [&]()
+		{
+			int32 ElementID = Map.AddElementWorldSpace(RandomPoint(Random, MapBounds), 0);
+
+			Map.GetValue(ElementID) = ElementID;
+
+			Oracle.Add(ElementID, Map.GetGeometry(ElementID));
+		};
+
+		for (int32 Index = 0; Index < 2048; ++Index)
+			AddRandomElement();
+
+		TArray<int32> ElementIDs;
+		TArray<int32> BatchIDs;
+		TArray<FVector2D> BatchPositions;
+
+		for (int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			//A few elements leave and join between batches, so batches also cover element IDs that were freed and reused
+			for (int32 Index = 0; Index < 8; ++Index)
+			{
+				Oracle.GetKeys(ElementIDs);
+
+				int32 ElementID = ElementIDs[Random.RandHelper(ElementIDs.Num())];
+
+				Map.RemoveElement(ElementID);
+
+				Oracle.Remove(ElementID);
+
+				AddRandomElement();
+			}
+
+			BatchIDs.Reset();
+			BatchPositions.Reset();
+
+			int32 NumCellChanges = 0;
+
+			for (auto& [ElementID, LocalPosition] : Oracle)
+			{
+				if (Random.RandHelper(4) != 0)
+					continue;
+
+				//Short steps mostly stay in their cell, long ones can cross several
+				FVector2D Offset{ RandRange(Random, -400.0, 400.0), RandRange(Random, -400.0, 400.0) };
+
+				FVector2D NewPosition = (Map.LocalToWorld(LocalPosition) + Offset).ClampAxes(-999.0, 999.0);
+
+				if (Map.GetCellGeometry(LocalPosition) != Map.GetCellGeometry(Map.WorldToLocal(NewPosition)))
+					++NumCellChanges;
+
+				BatchIDs.Add(ElementID);
+				BatchPositions.Add(NewPosition);
+			}
+
+			if (!Map.ShouldBatchCellChanges(NumCellChanges))
+			{
+				Test.AddError(FString::Printf(TEXT("%s: step %d moves %d elements across cells, which would not be grouped by cell"), Name, Step, NumCellChanges));
+				return false;
+			}
+
+			Map.MoveElementsWorldSpace(BatchIDs, BatchPositions);
+
+			for (int32 ElementID : BatchIDs)
+				Oracle[ElementID] = Map.GetGeometry(ElementID);
+
+			for (int32 Query = 0; Query < 4; ++Query)
+			{
+				FVector2D Centre = RandomPoint(Random, MapBounds);
+				FVector2D Extent{ RandRange(Random, 10.0, 800.0), RandRange(Random, 10.0, 800.0) };
+
+				if (!CheckBoxQuery(Test, Name, Map, Oracle, FBox2D{ Centre - Extent, Centre + Extent }))
+					return false;
+
+				if (!CheckNearestK(Test, Name, Map, Oracle, Centre, 1 + Random.RandHelper(12), RandRange(Random, 50.0, 1500.0)))
+					return false;
+			}
+
+			//Every element must still be found in a query over the whole map
+			if (!CheckBoxQuery(Test, Name, Map, Oracle, MapBounds))
+				return false;
+		}
+
+		return true;
+	}
+
+	//Box occluder sets, with segment queries and snapshots on top of box queries
+	template <typename MapType>
+	bool RunOccluderTest(FAutomationTestBase& Test, const TCHAR* Name)
+	{
+		FRandomStream Random{ 4321 };
+
+		const FBox2D MapBounds{ FVector2D{ -8000.0, -8000.0 }, FVector2D{ 8000.0, 8000.0 } };
+
+		MapType Map;
+
+		InitMap(Map, MapBounds, FVector2D{ 500.0, 500.0 });
+
+		TOracle<FBox2D> Oracle;
+
+		for (int32 Index = 0; Index < 2000; ++Index)
+		{
+			int32 ElementID = Map.AddElementWorldSpace(RandomBox(Random, MapBounds.ExpandBy(500.0)), 0);
+
+			Map.GetValue(ElementID) = ElementID;
+
+			Oracle.Add(ElementID, Map.GetGeometry(ElementID));
+		}
+
+		TSpatialHashMapSnapshot<FBox2D, int32> Snapshot;
+
+		TArray<typename TSpatialHashMapSnapshot<FBox2D, int32>::FElement> SnapshotElements;
+
+		for (auto& [ElementID, LocalBox] : Oracle)
+			SnapshotElements.Add({ Map.LocalToWorld(LocalBox), ElementID });
+
+		Snapshot.SetTransform(Map.GetOrigin(), Map.GetCellSize());
+		Snapshot.BuildWorldSpace(MoveTemp(SnapshotElements));
+
+		TOracle<FBox2D> SnapshotOracle;
+
+		for (auto& Element : Snapshot.GetElements())
+			SnapshotOracle.Add(Element.Value, Element.Geometry);
+
+		for (int32 Query = 0; Query < 200; ++Query)
+		{
+			FVector2D Centre = RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+			FVector2D Extent{ RandRange(Random, 10.0, 4000.0), RandRange(Random, 10.0, 4000.0) };
+			FBox2D QueryBox{ Centre - Extent, Centre + Extent };
+
+			FVector2D From = RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+			FVector2D To = Query % 4 == 0 ? From + FVector2D{ RandRange(Random, -500.0, 500.0), 0.0 } : RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+
+			if (!CheckBoxQuery(Test, Name, Map, Oracle, QueryBox) || !CheckSegmentQuery(Test, Name, Map, Oracle, From, To))
+				return false;
+
+			if (!CheckBoxQuery(Test, Name, Snapshot, SnapshotOracle, QueryBox) || !CheckSegmentQuery(Test, Name, Snapshot, SnapshotOracle, From, To))
+				return false;
+
+			if (!CheckNearestK(Test, Name, Map, Oracle, Centre, 1 + Random.RandHelper(8), RandRange(Random, 100.0, 5000.0)))
+				return false;
+		}
+
+		//Nudged elements are patched in place while they stay in their cells, others are refused and left where they were
+		int32 NumPatched = 0;
+
+		for (int32 ElementID = 0; ElementID < Snapshot.GetElements().GetMaxIndex(); ++ElementID)
+		{
+			if (!Snapshot.GetElements().IsValidIndex(ElementID))
+				continue;
+
+			auto Element = Snapshot.GetElements()[ElementID];
+
+			//Local space is in cells, so a tenth of a cell mostly stays put and half a cell mostly crosses over
+			double Offset = Random.RandHelper(2) == 0 ? 0.1 : 0.5;
+
+			Element.Geometry = Element.Geometry.ShiftBy(FVector2D{ Offset, -Offset });
+
+			if (!Snapshot.PatchElement(ElementID, Element))
+				continue;
+
+			SnapshotOracle[Element.Value] = Element.Geometry;
+
+			++NumPatched;
+		}
+
+		if (NumPatched == 0)
+		{
+			Test.AddError(FString::Printf(TEXT("%s: no snapshot elements could be patched in place"), Name));
+			return false;
+		}
+
+		for (int32 Query = 0; Query < 100; ++Query)
+		{
+			FVector2D Centre = RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+			FVector2D Extent{ RandRange(Random, 10.0, 4000.0), RandRange(Random, 10.0, 4000.0) };
+
+			FVector2D From = RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+			FVector2D To = RandomPoint(Random, MapBounds.ExpandBy(1000.0));
+
+			if (!CheckBoxQuery(Test, Name, Snapshot, SnapshotOracle, FBox2D{ Centre - Extent, Centre + Extent }) || !CheckSegmentQuery(Test, Name, Snapshot, SnapshotOracle, From, To))
+				return false;
+		}
+
+		return true;
+	}
+
+	//Points random walking around, like crowds of units. Density is kept the same for every count.
+	template <typename MapType>
+	void RunRandomWalkBenchmark(FAutomationTestBase& Test, const TCHAR* Name, int32 NumPoints)
+	{
+		constexpr int32 NumFrames = 8;
+		constexpr int32 NumQueries = 1000;
+
+		FRandomStream Random{ 42 };
+
+		const double HalfSize = 100.0 * FMath::Sqrt((double)NumPoints);
+		const FBox2D Bounds{ FVector2D{ -HalfSize, -HalfSize }, FVector2D{ HalfSize, HalfSize } };
+
+		MapType Map;
+
+		InitMap(Map, Bounds, FVector2D{ 500.0, 500.0 });
+
+		TArray<FVector2D> Positions;
+		TArray<int32> ElementIDs;
+
+		for (int32 Index = 0; Index < NumPoints; ++Index)
+			Positions.Add(RandomPoint(Random, Bounds));
+
+		ElementIDs.SetNumUninitialized(NumPoints);
+
+		auto Add = Measure(NumPoints, [&]()
+		{
+			for (int32 Index = 0; Index < NumPoints; ++Index)
+				ElementIDs[Index] = Map.AddElementWorldSpace(Positions[Index], Index);
+		});
+
+		auto Step = [&]()
+		{
+			for (auto& Position : Positions)
+				Position = (Position + FVector2D{ RandRange(Random, -150.0, 150.0), RandRange(Random, -150.0, 150.0) }).ClampAxes(-HalfSize, HalfSize);
+		};
+
+		//First pass warms up any pooled memory, so that the measured frames show steady state allocations
+		Step();
+
+		for (int32 Index = 0; Index < NumPoints; ++Index)
+			Map.MoveElementWorldSpace(ElementIDs[Index], Positions[Index]);
+
+		FBenchmarkResult Move;
+
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			Step();
+
+			auto FrameResult = Measure(NumPoints, [&]()
+			{
+				for (int32 Index = 0; Index < NumPoints; ++Index)
+					Map.MoveElementWorldSpace(ElementIDs[Index], Positions[Index]);
+			});
+
+			Move.AddFrame(FrameResult, NumFrames);
+		}
+
+		FBenchmarkResult BatchedMove;
+
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			Step();
+
+			auto FrameResult = Measure(NumPoints, [&]()
+			{
+				Map.MoveElementsWorldSpace(ElementIDs, Positions);
+			});
+
+			BatchedMove.AddFrame(FrameResult, NumFrames);
+		}
+
+		TArray<FBox2D> QueryBoxes;
+
+		for (int32 Index = 0; Index < NumQueries; ++Index)
+		{
+			FVector2D Centre = RandomPoint(Random, Bounds);
+
+			QueryBoxes.Add(FBox2D{ Centre - 1000.0, Centre + 1000.0 });
+		}
+
+		int64 NumFound = 0;
+
+		auto Query = Measure(NumQueries, [&]()
+		{
+			for (auto& QueryBox : QueryBoxes)
+				for (auto It = Map.WorldBoxQuery(QueryBox); It; ++It)
+					++NumFound;
+		});
+
+		TArray<FSpatialHashMapNearestElement> Nearest;
+
+		auto NearestK = Measure(NumQueries, [&]()
+		{
+			for (auto& QueryBox : QueryBoxes)
+				Map.WorldNearestK(QueryBox.GetCenter(), 8, 2000.0, Nearest);
+		});
+
+		auto Remove = Measure(NumPoints, [&]()
+		{
+			for (int32 ElementID : ElementIDs)
+				Map.RemoveElement(ElementID);
+		});
+
+		Test.AddInfo(FString::Printf(TEXT("%s, %d points: add %s | move %s | batched move %s | box query %s (%.1f found) | nearest 8 %s | remove %s"),
+			Name, NumPoints, *Add.ToString(), *Move.ToString(), *BatchedMove.ToString(), *Query.ToString(), double(NumFound) / NumQueries, *NearestK.ToString(), *Remove.ToString()));
+	}
+
+	//Crowds of points at a fixed number per cell, so batched moves take the path that groups cell changes by cell.
+	//Reports how many of the measured frames took that path, since a frame with too few cell changes falls back to moving elements one at a time.
+	template <typename MapType>
+	void RunCrowdBenchmark(FAutomationTestBase& Test, const TCHAR* Name, int32 NumPoints)
+	{
+		constexpr int32 NumFrames = 8;
+		constexpr double PointsPerCell = 32.0;
+		constexpr double CellSize = 500.0;
+
+		FRandomStream Random{ 24 };
+
+		const double HalfSize = 0.5 * CellSize * FMath::Sqrt(NumPoints / PointsPerCell);
+		const FBox2D Bounds{ FVector2D{ -HalfSize, -HalfSize }, FVector2D{ HalfSize, HalfSize } };
+
+		MapType Map;
+
+		InitMap(Map, Bounds, FVector2D{ CellSize, CellSize });
+
+		TArray<FVector2D> Positions;
+		TArray<int32> ElementIDs;
+
+		for (int32 Index = 0; Index < NumPoints; ++Index)
+		{
+			Positions.Add(RandomPoint(Random, Bounds));
+
+			ElementIDs.Add(Map.AddElementWorldSpace(Positions[Index], Index));
+		}
+
+		auto Step = [&]()
+		{
+			int32 NumCellChanges = 0;
+
+			for (int32 Index = 0; Index < NumPoints; ++Index)
+			{
+				FVector2D& Position = Positions[Index];
+
+				Position = (Position + FVector2D{ RandRange(Random, -150.0, 150.0), RandRange(Random, -150.0, 150.0) }).ClampAxes(-HalfSize, HalfSize);
+
+				if (Map.GetCellGeometry(Map.GetGeometry(ElementIDs[Index])) != Map.GetCellGeometry(Map.WorldToLocal(Position)))
+					++NumCellChanges;
+			}
+
+			return NumCellChanges;
+		};
+
+		//First pass warms up any pooled memory, so that the measured frames show steady state allocations
+		Step();
+
+		Map.MoveElementsWorldSpace(ElementIDs, Positions);
+
+		FBenchmarkResult Move;
+
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			Step();
+
+			auto FrameResult = Measure(NumPoints, [&]()
+			{
+				for (int32 Index = 0; Index < NumPoints; ++Index)
+					Map.MoveElementWorldSpace(ElementIDs[Index], Positions[Index]);
+			});
+
+			Move.AddFrame(FrameResult, NumFrames);
+		}
+
+		FBenchmarkResult BatchedMove;
+
+		int32 NumGroupedFrames = 0;
+
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			if (Map.ShouldBatchCellChanges(Step()))
+				++NumGroupedFrames;
+
+			auto FrameResult = Measure(NumPoints, [&]()
+			{
+				Map.MoveElementsWorldSpace(ElementIDs, Positions);
+			});
+
+			BatchedMove.AddFrame(FrameResult, NumFrames);
+		}
+
+		Test.AddInfo(FString::Printf(TEXT("%s, %d points, %.0f per cell: move %s | batched move %s (%d/%d frames grouped by cell)"),
+			Name, NumPoints, PointsPerCell, *Move.ToString(), *BatchedMove.ToString(), NumGroupedFrames, NumFrames));
+	}
+
+	//Static occluder sets of mixed sizes, queried with vision sized boxes and line of sight segments
+	template <typename MapType>
+	void RunOccluderBenchmark(FAutomationTestBase& Test, const TCHAR* Name, int32 NumBoxes)
+	{
+		constexpr int32 NumQueries = 2000;
+
+		FRandomStream Random{ 7 };
+
+		const double HalfSize = 250.0 * FMath::Sqrt((double)NumBoxes);
+		const FBox2D Bounds{ FVector2D{ -HalfSize, -HalfSize }, FVector2D{ HalfSize, HalfSize } };
+
+		MapType Map;
+
+		InitMap(Map, Bounds, FVector2D{ 500.0, 500.0 });
+
+		TArray<FBox2D> Boxes;
+
+		for (int32 Index = 0; Index < NumBoxes; ++Index)
+			Boxes.Add(RandomBox(Random, Bounds));
+
+		auto Add = Measure(NumBoxes, [&]()
+		{
+			for (int32 Index = 0; Index < NumBoxes; ++Index)
+				Map.AddElementWorldSpace(Boxes[Index], Index);
+		});
+
+		TArray<FVector2D> Origins;
+
+		for (int32 Index = 0; Index < NumQueries; ++Index)
+			Origins.Add(RandomPoint(Random, Bounds));
+
+		int64 NumFound = 0;
+
+		auto Query = Measure(NumQueries, [&]()
+		{
+			for (auto& Origin : Origins)
+				for (auto It = Map.WorldBoxQuery(FBox2D{ Origin - 1500.0, Origin + 1500.0 }); It; ++It)
+					++NumFound;
+		});
+
+		int64 NumHits = 0;
+
+		auto Segment = Measure(NumQueries, [&]()
+		{
+			for (int32 Index = 0; Index < NumQueries; ++Index)
+				for (auto It = Map.WorldSegmentQuery(Origins[Index], Origins[Index] + (Origins[(Index + 1) % NumQueries] - Origins[Index]).GetClampedToMaxSize(1500.0)); It; ++It)
+					++NumHits;
+		});
+
+		auto Stats = Map.GetStats();
+
+		Test.AddInfo(FString::Printf(TEXT("%s, %d boxes (%.2f cells per box): add %s | box query %s (%.1f found) | segment query %s (%.1f found)"),
+			Name, NumBoxes, Stats.GetMeanCellsPerElement(), *Add.ToString(), *Query.ToString(), double(NumFound) / NumQueries, *Segment.ToString(), double(NumHits) / NumQueries));
+	}
+}
+
+using namespace SpatialHashMapTests;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapPointChurnTest, "Zombies.SpatialHash.PointChurn", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSpatialHashMapPointChurnTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	bPassed &= RunChurnTest<FSparsePointMap>(*this, TEXT("Sparse"), 20000);
+	bPassed &= RunChurnTest<FFlatPointMap>(*this, TEXT("Flat"), 20000);
+	bPassed &= RunChurnTest<FDensePointMap>(*this, TEXT("Dense"), 20000);
+	bPassed &= RunChurnTest<FHierarchicalPointMap>(*this, TEXT("Hierarchical"), 20000);
+
+	return bPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapCrowdedPointChurnTest, "Zombies.SpatialHash.CrowdedPointChurn", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSpatialHashMapCrowdedPointChurnTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	bPassed &= RunCrowdedChurnTest<FSparsePointMap>(*this, TEXT("Sparse"), 500);
+	bPassed &= RunCrowdedChurnTest<FFlatPointMap>(*this, TEXT("Flat"), 500);
+	bPassed &= RunCrowdedChurnTest<FDensePointMap>(*this, TEXT("Dense"), 500);
+
+	return bPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapBoxChurnTest, "Zombies.SpatialHash.BoxChurn", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSpatialHashMapBoxChurnTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	bPassed &= RunChurnTest<FSparseBoxMap>(*this, TEXT("Sparse"), 10000);
+	bPassed &= RunChurnTest<FFlatBoxMap>(*this, TEXT("Flat"), 10000);
+	bPassed &= RunChurnTest<FDenseBoxMap>(*this, TEXT("Dense"), 10000);
+	bPassed &= RunChurnTest<FHierarchicalBoxMap>(*this, TEXT("Hierarchical"), 10000);
+
+	return bPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapOccluderTest, "Zombies.SpatialHash.Occluders", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FSpatialHashMapOccluderTest::RunTest(const FString& Parameters)
+{
+	bool bPassed = true;
+
+	bPassed &= RunOccluderTest<FSparseBoxMap>(*this, TEXT("Sparse"));
+	bPassed &= RunOccluderTest<FFlatBoxMap>(*this, TEXT("Flat"));
+	bPassed &= RunOccluderTest<FDenseBoxMap>(*this, TEXT("Dense"));
+	bPassed &= RunOccluderTest<FHierarchicalBoxMap>(*this, TEXT("Hierarchical"));
+
+	return bPassed;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapRandomWalkBenchmark, "Zombies.SpatialHash.Benchmark.RandomWalk", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FSpatialHashMapRandomWalkBenchmark::RunTest(const FString& Parameters)
+{
+	for (int32 NumPoints : { 10000, 100000 })
+	{
+		RunRandomWalkBenchmark<FSparsePointMap>(*this, TEXT("Sparse"), NumPoints);
+		RunRandomWalkBenchmark<FFlatPointMap>(*this, TEXT("Flat"), NumPoints);
+		RunRandomWalkBenchmark<FDensePointMap>(*this, TEXT("Dense"), NumPoints);
+		RunRandomWalkBenchmark<FHierarchicalPointMap>(*this, TEXT("Hierarchical"), NumPoints);
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapCrowdBenchmark, "Zombies.SpatialHash.Benchmark.Crowd", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FSpatialHashMapCrowdBenchmark::RunTest(const FString& Parameters)
+{
+	for (int32 NumPoints : { 1000, 10000, 50000 })
+	{
+		RunCrowdBenchmark<FSparsePointMap>(*this, TEXT("Sparse"), NumPoints);
+		RunCrowdBenchmark<FFlatPointMap>(*this, TEXT("Flat"), NumPoints);
+		RunCrowdBenchmark<FDensePointMap>(*this, TEXT("Dense"), NumPoints);
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpatialHashMapOccluderBenchmark, "Zombies.SpatialHash.Benchmark.Occluders", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FSpatialHashMapOccluderBenchmark::RunTest(const FString& Parameters)
+{
+	for (int32 NumBoxes : { 1000, 10000 })
+	{
+		RunOccluderBenchmark<FSparseBoxMap>(*this, TEXT("Sparse"), NumBoxes);
+		RunOccluderBenchmark<FFlatBoxMap>(*this, TEXT("Flat"), NumBoxes);
+		RunOccluderBenchmark<FDenseBoxMap>(*this, TEXT("Dense"), NumBoxes);
+		RunOccluderBenchmark<FHierarchicalBoxMap>(*this, TEXT("Hierarchical"), NumBoxes);
+	}
+
+	return true;
+}
+
+#endif //WITH_DEV_AUTOMATION_TESTS
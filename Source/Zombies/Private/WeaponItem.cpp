@@ -6,6 +6,7 @@
 #include "UtilityTask.h"
 #include "AIController.h"
 #include "WeaponHost.h"
+#include "TeamVisibilitySubsystem.h"
 
 void AWeaponItem::SetPawn(APawn* NewPawn)
 {
@@ -73,6 +74,23 @@ void AWeaponItem::NotifyRelevantActorsUpdated()
 			Task->UpdateScore();
 }
 
+const TSet<AActor*>& AWeaponItem::GetRelevantActors() const
+{
+	static const TSet<AActor*> NoRelevantActors;
+
+	if (RelevantTeam == FGenericTeamId::NoTeam)
+		return NoRelevantActors;
+
+	auto TeamVisibility = GetWorld()->GetSubsystem<UTeamVisibilitySubsystem>();
+
+	return TeamVisibility ? TeamVisibility->GetVisibleActors(RelevantTeam) : NoRelevantActors;
+}
+
+void AWeaponItem::SetRelevantTeam(FGenericTeamId NewRelevantTeam)
+{
+	RelevantTeam = NewRelevantTeam;
+}
+
 void AWeaponItem::UpdateUtilityTaskComponent()
 {
 	//Only bind to a utility task component when equipped
@@ -95,7 +95,9 @@ public:
 
 	virtual bool IsFogOfWarVisible_Implementation(const class UFogOfWarVisionComponent* Component) const override;
 
-	virtual void SetFogOfWarVisionVisibility_Implementation(class UFogOfWarVisionComponent* Component, bool bIsVisible) override;
+	virtual bool IsFogOfWarVisibleAtActorLocation() const override;
+
+	virtual void SetFogOfWarVisionVisibility_Implementation(FGenericTeamId Team, bool bIsVisible) override;
 
 	virtual void SetFogOfWarDisplayVisibility_Implementation(class UFogOfWarDisplayComponent* Component, bool bIsVisible) override;
 
@@ -207,8 +209,14 @@ protected:
 	//Drive movement component walking speed based on Stats.MoveSpeed
 	void UpdateMoveSpeed();
 
-	//Number of player vision components that can see this unit, used for visibility detection.
-	int32 FogOfWarVisionRefCount = 0;
+	//Teams that can see this unit, whether or not a player is on them, so that every team that stops seeing it was added when it started
+	TArray<FGenericTeamId, TInlineAllocator<2>> FogOfWarVisionTeams;
+
+	//Whether visuals were last shown by SetFogOfWarVisibility
+	bool bFogOfWarVisibleToPlayer = false;
+
+	//True if any team with player vision can see this unit
+	bool IsFogOfWarVisibleToPlayer() const;
 
 	//Spatial hash ID for fog of war actor queries.
 	int32 FogOfWarActorID = -1;
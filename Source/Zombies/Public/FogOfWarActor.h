@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "UObject/Interface.h"
+#include "GenericTeamAgentInterface.h"
 #include "FogOfWarActor.generated.h"
 
 UINTERFACE(MinimalAPI)
@@ -31,12 +32,19 @@ public:
 	//Whether this actor is visible to the given component.
 	//Should generally just use return UFogOfWarVisionComponent::CanSeePoint(GetActorLocation());
 	//Note that the actor needs a component that overlaps with the vision channel of the vision component in order to be detected in the first place
+	//Not called for actors where IsFogOfWarVisibleAtActorLocation is true, since the subsystem tests their location in batches instead
 	UFUNCTION(BlueprintNativeEvent, BlueprintCallable, Category = FogOfWar)
 	bool IsFogOfWarVisible(const class UFogOfWarVisionComponent* Component) const;
 
-	//Notifies the actor that they have become visible or not visible to a specific vision component.
+	//True if IsFogOfWarVisible would only test CanSeePoint at the actor's location. Then the subsystem can test many actors together, or on worker threads.
+	//Actors that decide their visibility any other way, including blueprints overriding IsFogOfWarVisible, must return false.
+	virtual bool IsFogOfWarVisibleAtActorLocation() const { return false; }
+
+	//Notifies the actor that they have become visible or not visible to a team.
+	//Called by UTeamVisibilitySubsystem once when the first of the team's vision components sees the actor, and once when the last one stops seeing it,
+	//so every call for a team with bIsVisible true is followed by one with it false, unless the actor ends play first.
 	UFUNCTION(BlueprintNativeEvent, BlueprintCallable, Category = FogOfWar)
-	void SetFogOfWarVisionVisibility(class UFogOfWarVisionComponent* Component, bool bIsVisible);
+	void SetFogOfWarVisionVisibility(FGenericTeamId Team, bool bIsVisible);
 
 	//Notifies the actor that they have become visible or not visible to at least one of the vision components of a display component.
 	UFUNCTION(BlueprintNativeEvent, BlueprintCallable, Category = FogOfWar)
@@ -4,8 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "Templates/SharedPointer.h" 
+#include "Stats/Stats.h"
 //#include "FogOfWarCommon.generated.h"
 
+DECLARE_STATS_GROUP(TEXT("FogOfWar"), STATGROUP_FogOfWar, STATCAT_Advanced);
+
 
 static constexpr ESPMode FogOfWarSPMode = ESPMode::NotThreadSafe;
 
@@ -21,6 +24,14 @@ struct ZOMBIES_API FFogOfWarOccluderMesh : TSharedFromThis<FFogOfWarOccluderMesh
 	//Mesh space bounding box
 	FBox2D Bounds;
 
+	//Chains the shadow edges into loops and open runs, then removes the vertices of each that are within Tolerance of the simplified line.
+	//Vertices in the middle of straight runs are always removed, so that several collinear edges become one.
+	//Positive tolerance simplifies further with Douglas-Peucker.
+	void SimplifyShadowEdges(double Tolerance = 0.0);
+
+	//Recalculates the bounds from the shadow edges
+	void UpdateBounds();
+
 	//Possibly not needed...
 	//The triangles that make up the occluder itself.
 	//Only really necessary when the vision source is inside the geometry itself, since shadows would be projected outwards in that case.
@@ -34,4 +45,68 @@ struct ZOMBIES_API FFogOfWarOccluderInstance
 
 	//Mesh data
 	TFogOfWarSharedPtr<FFogOfWarOccluderMesh> OccluderMesh;
+
+	//Span of this instance's world space shadow edges in an FFogOfWarEdgeBuffer, or INDEX_NONE if they have not been baked
+	int32 FirstWorldEdge = INDEX_NONE;
+
+	int32 NumWorldEdges = 0;
+
+	FORCEINLINE bool HasWorldEdges() const { return FirstWorldEdge != INDEX_NONE; }
+};
+
+//Where a vision component is and what it can see at one moment, so that visibility can be tested away from the game thread
+struct ZOMBIES_API FFogOfWarViewer
+{
+	FVector2D Location = FVector2D::ZeroVector;
+
+	FVector2D Forward = FVector2D{ 1.0, 0.0 };
+
+	double VisionRadius = 0.0;
+
+	double SelfVisionRadius = 0.0;
+
+	//Cosine of half the field of view
+	double CosHalfFOV = 1.0;
+
+	//True if the world space point is in range and inside either the self vision radius or the fov cone, ignoring occluders
+	bool IsInVisionCone(const FVector2D& Point) const;
+};
+
+//World space shadow edges of many occluders, baked once so that shadow and line of sight kernels can stream through flat arrays without any transforms.
+//Coordinates are split into one array each, so that several edges can be loaded into vector registers at once.
+struct ZOMBIES_API FFogOfWarEdgeBuffer
+{
+	TArray<float> X0;
+
+	TArray<float> Y0;
+
+	TArray<float> X1;
+
+	TArray<float> Y1;
+
+	FORCEINLINE int32 Num() const { return X0.Num(); }
+
+	FORCEINLINE FVector2D GetFrom(int32 Index) const { return FVector2D{ X0[Index], Y0[Index] }; }
+
+	FORCEINLINE FVector2D GetTo(int32 Index) const { return FVector2D{ X1[Index], Y1[Index] }; }
+
+	void Reset();
+
+	//Makes room for at least NumEdges edges in total
+	void Reserve(int32 NumEdges);
+
+	//Transforms the occluder's shadow edges into world space and appends them, pointing the occluder at its span
+	void AddOccluder(FFogOfWarOccluderInstance& Occluder);
+
+	//Transforms the occluder's shadow edges into world space and appends them, without pointing the occluder at them. For occluders that move.
+	void AppendOccluderEdges(const FFogOfWarOccluderInstance& Occluder);
+
+	//Appends a span of another buffer's edges, e.g. to gather every edge around one viewer into a contiguous set
+	void AppendEdges(const FFogOfWarEdgeBuffer& Source, int32 First, int32 Count);
+
+	//Index of the first edge in the span that crosses the segment, or INDEX_NONE if none do. Tests 4 edges at a time.
+	int32 FindIntersectingEdge(int32 First, int32 Count, const FVector2D& From, const FVector2D& To) const;
+
+	//Sets a bit for each target that can be seen from the viewer without crossing any edge in this buffer
+	void FindVisiblePoints(const FVector2D& From, TArrayView<const FVector2D> Targets, TBitArray<>& OutVisible) const;
 };
\ No newline at end of file
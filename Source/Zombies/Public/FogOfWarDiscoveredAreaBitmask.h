@@ -0,0 +1,65 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//One bit per texel record of the area a display component has discovered within one cell.
+//Vision is rasterized into it on the CPU, and only the rows that changed need uploading to the texture the display draws from.
+//Texel (X, Y) covers X -> X + 1 and Y -> Y + 1 in texel space, with row 0 at the top of the texture.
+//Also counts the discovered texels in each SubTileSize square, so areas that are already fully discovered can be skipped.
+struct ZOMBIES_API FFogOfWarDiscoveredAreaBitmask
+{
+	//One word of each row per sub tile
+	static constexpr int32 SubTileSize = 64;
+
+	void Init(int32 InResolution);
+
+	FORCEINLINE int32 GetResolution() const { return Resolution; }
+
+	FORCEINLINE int32 NumSet() const { return NumSetTexels; }
+
+	//Once everything is discovered the bits are freed, since nothing more can change
+	FORCEINLINE bool IsFull() const { return NumSetTexels == Resolution * Resolution; }
+
+	bool IsSet(int32 X, int32 Y) const;
+
+	//True if every texel of every sub tile that TexelRect overlaps is discovered. Parts of the rect outside of the bitmask are ignored.
+	bool IsRectComplete(const FIntRect& TexelRect) const;
+
+	//Sets every texel whose centre is inside the triangle
+	void FillTriangle(const FVector2D& A, const FVector2D& B, const FVector2D& C);
+
+	//Sets every texel whose centre is inside a triangle from the centre to a consecutive pair of vertices
+	void FillTriangleFan(const FVector2D& Centre, TArrayView<const FVector2D> Vertices);
+
+	//Texels that changed since the last ClearDirty, empty if nothing changed
+	FORCEINLINE const FIntRect& GetDirtyRect() const { return DirtyRect; }
+
+	FORCEINLINE bool IsDirty() const { return DirtyRect.Area() > 0; }
+
+	FORCEINLINE void ClearDirty() { DirtyRect = FIntRect{}; }
+
+	//Writes one byte per texel of Rect, 255 if set or 0 if not, rows packed together
+	void ExpandRect(const FIntRect& Rect, uint8* OutTexels) const;
+
+protected:
+
+	//Sets texels X0 -> X1 (exclusive) on row Y
+	void FillSpan(int32 Y, int32 X0, int32 X1);
+
+	int32 Resolution = 0;
+
+	int32 WordsPerRow = 0;
+
+	int32 NumSetTexels = 0;
+
+	TArray<uint64> Words;
+
+	//Discovered texels in each sub tile, WordsPerRow sub tiles per row
+	TArray<int32> SubTileCounts;
+
+	int32 GetSubTileArea(int32 SubTileX, int32 SubTileY) const;
+
+	FIntRect DirtyRect;
+};
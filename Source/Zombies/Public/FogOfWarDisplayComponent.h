@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "Components/BoxComponent.h"
 #include "Templates/SharedPointer.h" 
+#include "FogOfWarDiscoveredAreaBitmask.h"
 #include "FogOfWarDisplayComponent.generated.h"
 
 USTRUCT()
@@ -19,6 +20,14 @@ public:
 
 	//If set, is a canvas that is currently drawing on the render target.
 	TSharedPtr<FCanvas> Canvas;
+
+	//Discovered texels, whenever vision is drawn from visibility polygons
+	TSharedPtr<FFogOfWarDiscoveredAreaBitmask> Bitmask;
+
+	//Texture the bitmask is uploaded to when using discovered area bitmasks. Only cells on the display have one, the rest are kept by the bitmask alone.
+	//This and the render target are released once the bitmask is full, since the whole cell is then drawn as discovered.
+	UPROPERTY()
+	class UTexture2D* Texture = nullptr;
 };
 
 /**
@@ -74,6 +83,20 @@ public:
 	//Ends drawing on all currently drawing discovered areas
 	void EndDrawDiscoveredAreas();
 
+	//True if discovered areas are rasterized from vision components visibility polygons into CPU bitmasks, rather than drawn into render targets
+	bool IsUsingDiscoveredAreaBitmasks() const;
+
+	//Rasterizes the visibility polygon of a vision component into the bitmask of every cell it overlaps, adding the cells where anything new was discovered to OutDiscoveredCells.
+	//Bitmasks track which texels are discovered even when drawing into render targets, so that vision only needs drawing into the cells in OutDiscoveredCells.
+	//Skipped if the vision hasn't changed since it was last discovered, and for cells whose sub tiles under the vision are already fully discovered.
+	void DiscoverVisionArea(class UFogOfWarVisionComponent* Component, TArray<FIntPoint, TInlineAllocator<16>>& OutDiscoveredCells);
+
+	//True once every texel of the cell has been discovered. Complete cells are drawn as a solid quad and never drawn into again.
+	bool IsDiscoveredAreaComplete(FIntPoint Cell) const;
+
+	//Uploads the changed texels of every bitmask in VisibleCells to its texture. Releases the textures of cells that are complete or outside VisibleCells.
+	void UpdateDiscoveredAreaTextures(const FIntRect& VisibleCells);
+
 	//Executes Func(Cell, Args...) for every cell that overlaps the input box
 	//E.G. ForEachDiscoveredArea(Display->WorldToDiscoveredAreas(MyCanvasBounds), [&](FIntPoint Cell){ auto& Canvas = Display->BeginDrawDiscoveredArea(Cell); .... });
 	template <typename FuncType, typename ... ArgTypes>
@@ -89,6 +112,11 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	float DisplayPersistence = 0.f;
 
+	//Times per second the fog of war display is redrawn. 0 redraws every frame.
+	//Between redraws the post process material blends from the previous display to the latest one, each mapped through the canvas transform it was drawn with.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar, Meta = (ClampMin = 0))
+	float DisplayUpdateRate = 0.f;
+
 	//World space radius of blur applied to display texture
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	float BlurRadius = 100.f;
@@ -116,6 +144,15 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
 	int32 CompositorResolution = 128;
 
+	//Draw every vision component into its own tile of one compositor atlas, so the number of canvas flushes per frame doesn't grow with the number of vision components.
+	//Only used with FogOfWar.Vision.Polygon, since shadow triangles can spill over into neighbouring tiles.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
+	bool bUseCompositorAtlas = true;
+
+	//Largest size of the compositor atlas. Once every tile is used, the remaining vision components are drawn in another batch.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar, Meta = (EditCondition = "bUseCompositorAtlas", ClampMin = 128))
+	int32 MaxCompositorAtlasResolution = 2048;
+
 	//Material that is used to smooth out the display pixels using separable kernel gaussian blur technique
 	//This material should implement the X pass of the blur
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
@@ -134,6 +171,12 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
 	int32 DiscoveredAreaResolution = 512;
 
+	//Keep discovered areas as one bit per texel on the CPU, and only upload the texels that change to an 8 bit texture per cell on the display.
+	//Cells off the display keep only their bits, an eighth of a render target per cell, and vision no longer draws into cells that are already fully discovered.
+	//Only used with FogOfWar.Vision.Polygon, since the bitmasks are filled from the visibility polygon. Off by default so existing maps keep their render target cells until this is enabled per display.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
+	bool bUseDiscoveredAreaBitmasks = false;
+
 	double DiscoveredAreaCellSize;
 	double InvDiscoveredAreaCellSize;
 
@@ -170,6 +213,28 @@ protected:
 	UPROPERTY(Transient)
 	class UTextureRenderTarget2D* CompositorRenderTarget;
 
+	//Intermediate render target with a tile of CompositorResolution for each vision component. Grows as needed.
+	UPROPERTY(Transient)
+	class UTextureRenderTarget2D* CompositorAtlasRenderTarget;
+
+	//Draws vision components into the compositor atlas, then composites each tile into the display.
+	//Each component keeps its tile while there is room for everyone, and the tile is only redrawn when the component's cached vision changes.
+	//Otherwise everything is drawn in batches that fill the atlas.
+	void DrawVisionAtlas(FCanvas& DisplayCanvas);
+
+	//Tile of a vision component in the compositor atlas, and the vision cache version it was last drawn with
+	struct FCompositorAtlasTile
+	{
+		FIntPoint Tile = FIntPoint::NoneValue;
+
+		uint32 VisionCacheVersion = 0;
+	};
+
+	TMap<TWeakObjectPtr<class UFogOfWarVisionComponent>, FCompositorAtlasTile> CompositorAtlasTiles;
+
+	//True if discovered area canvases batch their draws until EndDrawDiscoveredAreas, rather than flushing every draw
+	bool bDeferDiscoveredAreaDrawing = false;
+
 	UPROPERTY(Transient)
 	class UTextureRenderTarget2D* BlurPassXRenderTarget;
 
@@ -189,8 +254,19 @@ protected:
 	void DrawBlurPass();
 
 	//Applies the final fog of war parameters to any active cameras on the owning actor.
+	//Called every frame, so that the blend between the previous and latest display keeps moving between updates.
 	void ApplyPostProcessMaterialParameters();
 
+	//Seconds since UpdateFogOfWar last ran. Starts high so that the first tick always updates.
+	float TimeSinceDisplayUpdate = MAX_flt;
+
+	//The final display texture from the update before the latest one. Swapped with BlurPassYRenderTarget on every update.
+	UPROPERTY(Transient)
+	class UTextureRenderTarget2D* PreviousDisplayRenderTarget;
+
+	//The canvas transform PreviousDisplayRenderTarget was drawn with
+	FTransform PreviousDisplayCanvasTransform;
+
 	////Visit this worlds fog of war manager and create our discovered areas render target
 	//void InitializeDiscoveredAreaResources();
 
@@ -206,4 +282,13 @@ protected:
 
 	UPROPERTY()
 	TMap<FIntPoint, FDiscoveredAreasCell> DiscoveredAreas;
+
+	//Discovered area textures released by cells that left the display, reused by cells that come onto it
+	UPROPERTY()
+	TArray<class UTexture2D*> FreeDiscoveredAreaTextures;
+
+	void ReleaseDiscoveredAreaTexture(FDiscoveredAreasCell& DiscoveredArea);
+
+	//Vision cache version each vision component was last discovered with
+	TMap<TWeakObjectPtr<class UFogOfWarVisionComponent>, uint32> DiscoveredVisionVersions;
 };
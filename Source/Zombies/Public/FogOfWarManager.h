@@ -41,6 +41,9 @@ public:
 	UFUNCTION(BlueprintCallable, Category = FogOfWar)
 	FTransform GetDiscoveredAreaCanvasTransform() const;
 
+	//Get the world space area covered by the discovered areas texture
+	FBox2D GetDiscoveredAreaWorldBounds() const;
+
 	//Resolution of texture used by player to store their discovered areas
 	//Should be power of 2.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
@@ -50,6 +53,16 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	TEnumAsByte<ECollisionChannel> StaticFogOfWarOccluderChannel;
 
+	//Cell size of the grid that static occluders are stored in.
+	//Run FogOfWar.SpatialHashStats in the level to get a suggested value.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar, Meta = (ClampMin = "1.0"))
+	FVector2D StaticOccluderCellSize{ 500.0, 500.0 };
+
+	//Cell size of the grid that fog of war actors are stored in.
+	//Run FogOfWar.SpatialHashStats in the level to get a suggested value.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar, Meta = (ClampMin = "1.0"))
+	FVector2D FogOfWarActorCellSize{ 500.0, 500.0 };
+
 	FORCEINLINE const auto& GetVisionComponents() const { return VisionComponents; }
 
 	void RegisterVisionComponent(class UFogOfWarVisionComponent* Component);
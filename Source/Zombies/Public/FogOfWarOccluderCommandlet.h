@@ -0,0 +1,24 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FogOfWarOccluderCommandlet.generated.h"
+
+/**
+ * Cooks fog of war shadow edges into every project static mesh that the project's maps use as an occluder, adding a UFogOfWarOccluderUserData to meshes that don't have one.
+ * Occluders are static meshes that overlap the fog of war collision channel and the meshes of fog of war occluder components, found in the persistent level of each map.
+ * Meshes outside /Game are only reported, since engine and plugin content can't be saved. Run before packaging with:
+ * UnrealEditor-Cmd Zombies.uproject -run=FogOfWarOccluder
+ */
+UCLASS()
+class ZOMBIES_API UFogOfWarOccluderCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFogOfWarOccluderCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,48 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "FogOfWarOccluderComponent.generated.h"
+
+//Casts fog of war shadows from the edges of a static mesh while moving, for barricades, doors, vehicles and anything else that is not static.
+//Attach it to the moving mesh. Its cells in UFogOfWarSubsystem are only updated when its transform changes.
+UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
+class ZOMBIES_API UFogOfWarOccluderComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:	
+	// Sets default values for this component's properties
+	UFogOfWarOccluderComponent();
+
+protected:
+	// Called when the game starts
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(EEndPlayReason::Type Reason) override;
+
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport = ETeleportType::None) override;
+
+public:
+
+	FORCEINLINE class UStaticMesh* GetOccluderMesh() const { return OccluderMesh; }
+
+	//Changes the mesh that shadows are cast from, e.g. to a broken version of a barricade. Null stops casting shadows.
+	UFUNCTION(BlueprintCallable, Category = FogOfWar)
+	void SetOccluderMesh(class UStaticMesh* NewOccluderMesh);
+
+protected:
+
+	//Mesh whose shadow edges are used, usually the same mesh as the component this is attached to
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar, Meta = (AllowPrivateAccess = "true"))
+	class UStaticMesh* OccluderMesh;
+
+	//ID of this occluder in UFogOfWarSubsystem, or INDEX_NONE if it is not registered
+	int32 OccluderID = INDEX_NONE;
+
+	void RegisterOccluder();
+
+	void UnregisterOccluder();
+};
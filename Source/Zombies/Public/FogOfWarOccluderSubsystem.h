@@ -18,9 +18,14 @@ class ZOMBIES_API UFogOfWarOccluderSubsystem : public UGameInstanceSubsystem
 public:
 
 	//Gets the occluder mesh for the given static mesh.
-	//The static mesh itself must have bAllowCPUAccess == true in order to create this data.
+	//Uses the shadow edges cooked into the meshes UFogOfWarOccluderUserData if it has them, otherwise the static mesh itself must have bAllowCPUAccess == true in order to create this data.
+	//In the editor, meshes with neither are still built into this cache with a warning, without touching the asset. UFogOfWarOccluderCommandlet cooks their edges.
 	TFogOfWarSharedPtr<FFogOfWarOccluderMesh> GetOccluderMesh(class UStaticMesh* StaticMesh);
 
+	//Extracts the mesh space shadow edges from the LOD 0 render data of a static mesh, then merges and simplifies them as set by its UFogOfWarOccluderUserData.
+	//Reads the CPU side index and vertex buffers, which are always available in the editor. Returns the number of shadow edges before merging and simplifying.
+	static int32 BuildShadowEdges(class UStaticMesh* StaticMesh, FFogOfWarOccluderMesh& OutOccluderMesh);
+
 protected:
 
 	//Use soft object ptr to static mesh, so that we don't force it to be loaded if the game itself is not using it.
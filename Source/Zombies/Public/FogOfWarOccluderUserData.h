@@ -0,0 +1,57 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetUserData.h"
+#include "FogOfWarOccluderUserData.generated.h"
+
+/**
+ * Per mesh settings for how UFogOfWarOccluderSubsystem builds shadow edges. Add to the asset user data of a static mesh used as an occluder.
+ * Meshes without it have collinear edges merged and are not simplified.
+ * The shadow edges are built in the editor whenever the mesh is edited, reimported, saved or cooked and stored here, so that the mesh doesn't need bAllowCPUAccess in packaged builds.
+ * Occluder meshes that don't have it yet get it added by UFogOfWarOccluderCommandlet.
+ */
+UCLASS(BlueprintType, EditInlineNew, Meta = (DisplayName = "Fog Of War Occluder"))
+class ZOMBIES_API UFogOfWarOccluderUserData : public UAssetUserData
+{
+	GENERATED_BODY()
+public:
+
+	//Join shadow edges that continue in a straight line into one edge. Doesn't change the shadow, only how many edges cast it.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar)
+	bool bMergeCollinearEdges = true;
+
+	//Mesh space distance the simplified silhouette may stray from the original. 0 keeps the silhouette exact.
+	//Useful for highly tessellated or curved walls, where a few cm of error isn't visible in the shadows.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = FogOfWar, Meta = (ClampMin = 0))
+	double SimplifyTolerance = 0.0;
+
+	FORCEINLINE bool HasCookedShadowEdges() const { return CookedShadowEdges.Num() > 0; }
+
+	void GetCookedShadowEdges(TArray<TPair<FVector2D, FVector2D>>& OutShadowEdges) const;
+
+#if WITH_EDITOR
+
+	virtual void PreSave(FObjectPreSaveContext ObjectSaveContext) override;
+
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+
+	//Called when the static mesh is edited or reimported, so the cooked edges never lag behind its geometry
+	virtual void PostEditChangeOwner() override;
+
+	//Rebuilds the cooked shadow edges from the static mesh this is attached to. Returns true if they changed.
+	bool CookShadowEdges();
+
+#endif
+
+protected:
+
+	//Mesh space shadow edges built from the owning static mesh, as consecutive From, To pairs
+	UPROPERTY(VisibleAnywhere, Category = FogOfWar)
+	TArray<FVector2D> CookedShadowEdges;
+
+	//Number of shadow edges in the mesh before merging and simplifying, for comparison
+	UPROPERTY(VisibleAnywhere, Category = FogOfWar)
+	int32 NumSourceShadowEdges = 0;
+};
@@ -6,8 +6,69 @@
 #include "Subsystems/WorldSubsystem.h"
 #include "SpatialHashMap.h"
 #include "FogOfWarCommon.h"
+#include "Tasks/Task.h"
 #include "FogOfWarSubsystem.generated.h"
 
+//Read only snapshots that can be queried from worker threads
+using FFogOfWarActorsSnapshot = TSpatialHashMapSnapshot<FVector2D, TWeakObjectPtr<AActor>>;
+
+using FStaticOccludersSnapshot = TSpatialHashMapSnapshot<FBox2D, FFogOfWarOccluderInstance>;
+
+using FDynamicOccludersSnapshot = TSpatialHashMapSnapshot<FBox2D, FFogOfWarOccluderInstance>;
+
+//Finds the fog of war actors that one vision component can see on a worker thread. Launched on one frame and applied on the next.
+struct FFogOfWarVisionQuery
+{
+	TWeakObjectPtr<class UFogOfWarVisionComponent> Component;
+
+	FFogOfWarViewer Viewer;
+
+	//World space bounds to look for actors and occluders in
+	FBox2D Bounds{ ForceInit };
+
+	//Results of the query. Actors in the vision cone, with whether each can be seen from the viewer at its position in the fog of war actors map.
+	TArray<TWeakObjectPtr<AActor>> Targets;
+
+	TBitArray<> TargetsVisible;
+
+	//Actors in the bounds but outside the vision cone. Only actors that decide their own visibility can still be seen.
+	TArray<TWeakObjectPtr<AActor>> OutOfConeTargets;
+
+	//Scratch for the worker, kept between frames to reuse the allocations
+	TArray<FVector2D> TargetPositions;
+
+	FFogOfWarEdgeBuffer Edges;
+};
+
+//A streamed in level whose actors are still being searched for static occluders
+struct FPendingStaticOccluderLevel
+{
+	TWeakObjectPtr<ULevel> Level;
+
+	//Index into the level's actors to carry on from next tick
+	int32 NextActor = 0;
+
+	//Instanced meshes found in the level's actors whose instances are still being added. One component can hold more instances than fit in a tick.
+	TArray<TWeakObjectPtr<class UInstancedStaticMeshComponent>> InstancedComponents;
+
+	//Index into the first instanced component's instances to carry on from next tick
+	int32 NextInstance = 0;
+};
+
+//Static occluders being published over several ticks. Edges are copied into a new buffer a batch of occluders at a time, then the snapshot is built and both are published together.
+struct FPendingStaticOccludersPublish
+{
+	//New edge buffer, or null if no publish is in progress
+	TSharedPtr<FFogOfWarEdgeBuffer, ESPMode::ThreadSafe> Edges;
+
+	//First edge of each static occluder in the new buffer, indexed by element ID.
+	//Kept apart from the instances until the new buffer is published, since the game thread reads their spans from the old one until then.
+	TArray<int32> FirstWorldEdges;
+
+	//Element ID to carry on copying edges from next tick
+	int32 NextElement = 0;
+};
+
 /**
  * 
  */
@@ -21,6 +82,8 @@ public:
 
 	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
 
+	virtual void Deinitialize() override;
+
 	virtual void Tick(float DeltaTime) override;
 
 	FORCEINLINE virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(UFogOfWarSubsystem, STATGROUP_Tickables);};
@@ -35,12 +98,182 @@ public:
 
 	void UpdateFogOfWarActors();
 
+	//Snapshot of the fog of war actors as of the last tick. Safe to query from any thread, but resolve the actors on the game thread.
+	FORCEINLINE TSharedPtr<const FFogOfWarActorsSnapshot, ESPMode::ThreadSafe> GetFogOfWarActorsSnapshot() const { return FogOfWarActorsSnapshot; }
+
+	//Snapshot of the static occluders. Safe to query from any thread, but must be released on the game thread since occluder meshes are not thread safe shared pointers.
+	FORCEINLINE TSharedPtr<const FStaticOccludersSnapshot, ESPMode::ThreadSafe> GetStaticOccludersSnapshot() const { return StaticOccludersSnapshot; }
+
+	//World space shadow edges of the static occluders, which each static occluder instance points into.
+	//Never modified once published, a new buffer replaces it whenever occluders are added or removed, so safe to read from any thread.
+	FORCEINLINE TSharedPtr<const FFogOfWarEdgeBuffer, ESPMode::ThreadSafe> GetStaticOccluderEdges() const { return StaticOccluderEdges; }
+
+	//Occluders that can move, registered by UFogOfWarOccluderComponent. They have no baked edges, so their mesh edges are transformed where they are used.
+	FORCEINLINE const auto& GetDynamicOccluders() const { return DynamicOccluders; }
+
+	//Snapshot of the dynamic occluders as of the last tick. Same threading rules as the static occluders snapshot.
+	FORCEINLINE TSharedPtr<const FDynamicOccludersSnapshot, ESPMode::ThreadSafe> GetDynamicOccludersSnapshot() const { return DynamicOccludersSnapshot; }
+
+	//Returns the ID to move and remove the occluder with, or INDEX_NONE if it has no mesh
+	int32 AddDynamicOccluder(FFogOfWarOccluderInstance&& Instance);
+
+	//Only the cells under the old and new bounds are updated, so occluders that do not move cost nothing
+	void MoveDynamicOccluder(int32 OccluderID, const FTransform& NewTransform);
+
+	void RemoveDynamicOccluder(int32 OccluderID);
+
+	//Vision components are updated by the subsystem, so that their overlap queries can run in parallel
+	void RegisterVisionComponent(class UFogOfWarVisionComponent* Component);
+
+	void UnregisterVisionComponent(class UFogOfWarVisionComponent* Component);
+
+	//Bumps the version of every occluder cell the world box overlaps, so that vision cached over them is rebuilt.
+	//Call whenever static or dynamic occluders in the box are added, moved or removed.
+	void MarkOccludersChanged(const FBox2D& WorldBounds);
+
+	//Changes whenever the occluders in cells overlapping the world box change
+	uint32 GetOccludersVersion(const FBox2D& WorldBounds) const;
+
+	//Logs how the fog of war maps are spread over their cells, with cell sizes that would give about TargetOccupancy elements per cell
+	void LogSpatialHashStats(double TargetOccupancy) const;
+
 protected:
 
-	//Gathers all static meshes in the level that overlap the fog of war collision channel
-	void GatherStaticOccluders();
+	//Queues a level to have its static occluders gathered over the next few ticks. Levels that are already registered are ignored.
+	void AddStaticOccluderLevel(ULevel* Level);
+
+	//Removes the static occluders gathered from a level, and stops gathering it if it is still queued
+	void RemoveStaticOccluderLevel(ULevel* Level);
+
+	void OnLevelAddedToWorld(ULevel* Level, UWorld* World);
+
+	void OnLevelRemovedFromWorld(ULevel* Level, UWorld* World);
+
+	//Gathers static occluders from the queued levels until the time budget runs out, then publishes them under the same budget once the queue is empty
+	void GatherPendingStaticOccluders();
+
+	//Adds the static meshes of an actor that overlap the fog of war collision channel, appending their element IDs.
+	//Instanced meshes are appended to OutInstancedComponents instead, to have their instances added by GatherStaticOccluderInstances.
+	void GatherStaticOccluders(AActor* Actor, TArray<int32>& OutElementIDs, TArray<TWeakObjectPtr<class UInstancedStaticMeshComponent>>& OutInstancedComponents);
+
+	//Adds one occluder per instance of an instanced mesh from NextInstance on, until every instance is added or EndTime passes. Returns true once every instance is added.
+	bool GatherStaticOccluderInstances(class UInstancedStaticMeshComponent* Component, int32& NextInstance, TArray<int32>& OutElementIDs, double EndTime);
+
+	//Occluder mesh of a static mesh component if it overlaps the fog of war collision channel
+	TFogOfWarSharedPtr<FFogOfWarOccluderMesh> GetStaticOccluderMesh(class UStaticMeshComponent* Component) const;
+
+	int32 AddStaticOccluder(const FTransform& Transform, const TFogOfWarSharedPtr<FFogOfWarOccluderMesh>& OccluderMesh);
+
+	//Carries on rebuilding the static occluders edge buffer from the static occluders until EndTime, copying the edges of occluders that are already published.
+	//Once every occluder's edges are in, builds the snapshot and publishes both.
+	void PublishStaticOccluders(double EndTime);
+
+	//Any publish in progress was started from static occluders that have since changed, so it starts over
+	void RestartStaticOccludersPublish();
+
+	//Sizes the dense grids to the fog of war manager's bounds, or to the loaded levels if there is no manager
+	void InitSpatialGrids();
+
+	//World space area covered by the dense grids
+	FBox2D SpatialGridsBounds{ ForceInit };
+
+	//True if there was no fog of war manager, so the grids were sized to the levels loaded at begin play
+	bool bSpatialGridsFromLevelBounds = false;
+
+	//Levels have known bounds, so all maps use dense grids instead of hashing cells
+	TDenseSpatialGridMap<FBox2D, FFogOfWarOccluderInstance> StaticOccluders;
+
+	//Shares the cells of the static occluders, so that both are versioned by the same cells
+	TDenseSpatialGridMap<FBox2D, FFogOfWarOccluderInstance> DynamicOccluders;
+
+	TDenseSpatialGridMap<FVector2D, TWeakObjectPtr<AActor>> FogOfWarActors;
+
+	//Versions of occluder cells that have changed since the static occluders were first published. Cells that never changed are left out.
+	TMap<FIntPoint, uint32> OccluderCellVersions;
+
+	//Bumped when the static occluders are first published. Changes after that are tracked per cell.
+	uint32 StaticOccludersVersion = 0;
+
+	//Element IDs of the static occluders gathered from each level, so they can be removed when the level streams out
+	TMap<TWeakObjectPtr<ULevel>, TArray<int32>> StaticOccluderLevels;
+
+	TArray<FPendingStaticOccluderLevel> PendingStaticOccluderLevels;
+
+	//True if the static occluders have changed since they were last published
+	bool bStaticOccludersChanged = false;
+
+	FPendingStaticOccludersPublish PendingStaticOccludersPublish;
+
+	FDelegateHandle LevelAddedToWorldHandle;
+
+	FDelegateHandle LevelRemovedFromWorldHandle;
+
+	//Scratch arrays for batch moving fog of war actors
+	TArray<int32> UpdatedActorIDs;
+
+	TArray<FVector2D> UpdatedActorPositions;
+
+	TSharedPtr<FFogOfWarActorsSnapshot, ESPMode::ThreadSafe> FogOfWarActorsSnapshot;
+
+	//True if fog of war actors were added, moved or removed since the snapshot was built
+	bool bFogOfWarActorsChanged = false;
+
+	TSharedPtr<FStaticOccludersSnapshot, ESPMode::ThreadSafe> StaticOccludersSnapshot;
+
+	TSharedPtr<FFogOfWarEdgeBuffer, ESPMode::ThreadSafe> StaticOccluderEdges;
+
+	TSharedPtr<FDynamicOccludersSnapshot, ESPMode::ThreadSafe> DynamicOccludersSnapshot;
+
+	//True if dynamic occluders were added, moved or removed since the snapshot was built
+	bool bDynamicOccludersChanged = false;
+
+	//True if dynamic occluders were added or removed since the snapshot was built, which always needs a full rebuild
+	bool bDynamicOccludersAddedOrRemoved = false;
+
+	//Dynamic occluders moved since the snapshot was built, possibly more than once each
+	TArray<int32> MovedDynamicOccluderIDs;
+
+	//Updates the dynamic occluders snapshot if they changed. When occluders only moved within their cells and nobody else holds the snapshot,
+	//just the moved occluders are patched in place. Otherwise the whole snapshot is rebuilt, reusing the previous one if nobody else is holding on to it.
+	//A rebuild costs the same however few occluders changed, so many dynamic occluders crossing cells every tick will rebuild every tick.
+	void PublishDynamicOccludersSnapshot();
+
+	//Rebuilds the fog of war actors snapshot if the actors changed, reusing the previous one if nobody else is holding on to it
+	void PublishFogOfWarActorsSnapshot();
+
+	UPROPERTY(Transient)
+	TArray<class UFogOfWarVisionComponent*> VisionComponents;
+
+	//Fog of war actors in the vision bounds of each vision component, found in parallel
+	TArray<TArray<TWeakObjectPtr<AActor>>> VisionCandidates;
+
+	void UpdateVisionComponents();
+
+	//Vision components whose visible actors are due for an update, following each component's VisionActorsUpdateFrequency
+	void GatherDueVisionComponents(TArray<class UFogOfWarVisionComponent*, TInlineAllocator<64>>& OutComponents);
+
+	//Where GatherDueVisionComponents starts looking, so that components over the per frame limit are first in line next frame
+	int32 NextDueVisionComponent = 0;
+
+	//Snapshots the components' vision and starts finding the actors they can see on worker threads
+	void LaunchVisionQueries(TArrayView<class UFogOfWarVisionComponent* const> Components);
+
+	//Waits for the queries launched last frame and hands their results to the components
+	void ApplyVisionQueries();
+
+	TArray<FFogOfWarVisionQuery> VisionQueries;
+
+	UE::Tasks::FTask VisionQueriesTask;
+
+	//Snapshots that the queries in flight are reading. Released on the game thread once the queries are applied.
+	TSharedPtr<const FFogOfWarActorsSnapshot, ESPMode::ThreadSafe> VisionQueriesActorsSnapshot;
+
+	TSharedPtr<const FStaticOccludersSnapshot, ESPMode::ThreadSafe> VisionQueriesOccludersSnapshot;
+
+	TSharedPtr<const FFogOfWarEdgeBuffer, ESPMode::ThreadSafe> VisionQueriesOccluderEdges;
 
-	TSpatialHashMap<FBox2D, FFogOfWarOccluderInstance> StaticOccluders;
+	TSharedPtr<const FDynamicOccludersSnapshot, ESPMode::ThreadSafe> VisionQueriesDynamicOccludersSnapshot;
 
-	TSpatialHashMap<FVector2D, TWeakObjectPtr<AActor>> FogOfWarActors;
+	//Updates the "stat SpatialHash" occupancy stats of the fog of war maps
+	void UpdateSpatialHashStats() const;
 };
@@ -37,9 +37,10 @@ namespace FogOfWarUtils
 	//(e.g. when displaying vision texture)
 	FTransform GetSnappedCanvasTransform(const FTransform& DesiredTransform, FVector2D TexelSize);
 
-	FCanvas BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D* RenderTarget);
+	//Immediate canvases flush after every item. Deferred canvases batch everything until they are flushed, so they can draw many items with a single flush.
+	FCanvas BeginDrawingCanvas(UWorld* World, UTextureRenderTarget2D* RenderTarget, FCanvas::ECanvasDrawMode DrawMode = FCanvas::CDM_ImmediateDrawing);
 
-	FCanvas BeginDrawingCanvas(UWorld* World, const FTransform& Transform, UTextureRenderTarget2D* RenderTarget);
+	FCanvas BeginDrawingCanvas(UWorld* World, const FTransform& Transform, UTextureRenderTarget2D* RenderTarget, FCanvas::ECanvasDrawMode DrawMode = FCanvas::CDM_ImmediateDrawing);
 
 	void EndDrawingCanvas(FCanvas& Canvas, UTextureRenderTarget2D* RenderTarget);
 
@@ -49,12 +50,30 @@ namespace FogOfWarUtils
 
 	void DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, class FTexture* Texture, FLinearColor Color = FLinearColor::White, ESimpleElementBlendMode BlendMode = ESimpleElementBlendMode::SE_BLEND_Opaque);
 
+	//Draws part of a texture, e.g. one tile of an atlas
+	void DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, class UTexture* Texture, const FBox2D& UVs, FLinearColor Color = FLinearColor::White, ESimpleElementBlendMode BlendMode = ESimpleElementBlendMode::SE_BLEND_Opaque);
+
+	void DrawTexturedQuad(FCanvas& Canvas, const FTransform& Transform, class FTexture* Texture, const FBox2D& UVs, FLinearColor Color = FLinearColor::White, ESimpleElementBlendMode BlendMode = ESimpleElementBlendMode::SE_BLEND_Opaque);
+
 	void DrawCone(class FCanvas& Canvas, FVector2D Centre, FVector2D Direction, double Radius, double HalfFOVInRadians);
 
+	//Draws triangles from the centre to each consecutive pair of vertices
+	void DrawTriangleFan(FCanvas& Canvas, FVector2D Centre, TArrayView<const FVector2D> Vertices, FLinearColor Color = FLinearColor::White);
+
 	void DrawMaterial(FCanvas& Canvas, UMaterialInterface* Material);
 
 	UTextureRenderTarget2D* CreateRenderTarget(UObject* Outer, uint32 Resolution);
 
+	//Creates a single channel 8 bit texture whose texels are written from the CPU with UpdateTextureRegions
+	class UTexture2D* CreateTexture(uint32 Resolution);
+
+	//UVs of a tile in a square atlas of TilesPerSide * TilesPerSide tiles.
+	//Tiles are inset by GutterTexels on each side, so that bilinear filtering never reads from a neighbouring tile.
+	FBox2D GetAtlasTileUVs(FIntPoint Tile, int32 TilesPerSide, int32 TileResolution, int32 GutterTexels = 1);
+
+	//Base transform for drawing a unit canvas into a tile of an atlas, to be combined with the inverse of the canvas transform
+	FMatrix GetAtlasTileMatrix(FIntPoint Tile, int32 TilesPerSide, int32 TileResolution, int32 GutterTexels = 1);
+
 	//Gets the bounds of a canvas transform
 	FBox2D GetCanvasBounds(const FTransform& Transform);
 
@@ -0,0 +1,128 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "FogOfWarCommon.h"
+
+//The area visible from a point, built on the CPU from occluder shadow edges by an angular sweep.
+//Covers the vision cone out to the vision radius, plus the self vision circle around the rest, with everything behind an edge removed.
+//The boundary is stored exactly as spans of edge lines and arcs, so that point queries match what the vision actually sees.
+struct ZOMBIES_API FFogOfWarVisibilityPolygon
+{
+	//Starts a new polygon, removing any edges from the previous one
+	void Reset(const FVector2D& InCentre, const FVector2D& Direction, double InRadius, double HalfFOVInRadians, double SelfRadius);
+
+	//Adds a world space edge that blocks vision. Edges out of range or pointing straight at the centre are ignored.
+	void AddEdge(FVector2D From, FVector2D To);
+
+	//Adds the shadow edges of an occluder. Positive bias pushes the edges away from the centre, negative brings them closer.
+	//Reads the occluder's baked edges from WorldEdges if it has them, otherwise transforms its mesh edges.
+	void AddOccluder(const FFogOfWarOccluderInstance& Occluder, double ShadowBias = 0.0, const FFogOfWarEdgeBuffer* WorldEdges = nullptr);
+
+	//Sweeps the edges to find the visible boundary
+	void Build();
+
+	//True if the world space point is inside the polygon
+	bool IsPointVisible(const FVector2D& Point) const;
+
+	//World space boundary vertices in sweep order. Triangles from the centre to each consecutive pair cover the visible area.
+	//Arcs are split into segments of at most MaxArcStep radians.
+	void GetBoundary(TArray<FVector2D>& OutVertices, double MaxArcStep = PI / 32.0) const;
+
+	FORCEINLINE const FVector2D& GetCentre() const { return Centre; }
+
+	FORCEINLINE int32 NumEdges() const { return Edges.Num(); }
+
+	FORCEINLINE int32 NumSpans() const { return Spans.Num(); }
+
+	FORCEINLINE bool IsEmpty() const { return Spans.Num() == 0; }
+
+protected:
+
+	//Edge relative to the centre, oriented counter clockwise
+	struct FEdge
+	{
+		FVector2D From;
+
+		FVector2D Delta;
+
+		//Cross(From, Delta), so the distance along a unit ray U to the edge line is Numerator / Cross(U, Delta)
+		double Numerator;
+
+		FORCEINLINE double GetDistance(const FVector2D& Ray) const { return Numerator / (Ray ^ Delta); }
+	};
+
+	//Part of the boundary between two sweep angles that is either one edge, or an arc if Edge is INDEX_NONE
+	struct FSpan
+	{
+		double StartAngle;
+
+		double EndAngle;
+
+		int32 Edge;
+
+		double Radius;
+	};
+
+	//Range of sweep angles that an edge covers
+	struct FEdgeInterval
+	{
+		double StartAngle;
+
+		double EndAngle;
+
+		int32 Edge;
+	};
+
+	//Unit ray for a sweep angle
+	FORCEINLINE FVector2D GetRay(double Angle) const
+	{
+		double Sin, Cos;
+
+		FMath::SinCos(&Sin, &Cos, StartAngle + Angle);
+
+		return FVector2D{ Cos, Sin };
+	}
+
+	//Sweep angle of a direction relative to the centre, in the range 0 -> 2 PI
+	double GetSweepAngle(const FVector2D& Offset) const;
+
+	//Vision radius at a sweep angle, ignoring edges
+	double GetLimitRadius(double Angle) const;
+
+	//Closest of the active edges along a ray, or INDEX_NONE if there are none
+	int32 FindNearestEdge(TArrayView<const int32> ActiveEdges, double Angle) const;
+
+	//Adds the boundary for a wedge between two sweep angles where the active edges do not change
+	void AddWedge(TArrayView<const int32> ActiveEdges, double WedgeStart, double WedgeEnd, int32 Depth);
+
+	//Adds the boundary for a wedge where only a single edge is nearest, clipped by the limit radius
+	void AddEdgeSpans(int32 Edge, double WedgeStart, double WedgeEnd, double LimitRadius);
+
+	void AddSpan(double SpanStart, double SpanEnd, int32 Edge, double SpanRadius);
+
+	FVector2D Centre = FVector2D::ZeroVector;
+
+	//World space angle where the sweep starts
+	double StartAngle = 0.0;
+
+	//Sweep angles covered by the polygon, from 0
+	double SweepAngle = 0.0;
+
+	//Sweep angles of the vision cone. Outside of the cone only the self vision radius is visible.
+	double ConeStartAngle = 0.0;
+
+	double ConeEndAngle = 0.0;
+
+	double Radius = 0.0;
+
+	double SelfRadius = 0.0;
+
+	TArray<FEdge> Edges;
+
+	TArray<FSpan> Spans;
+
+	//Scratch for building
+	TArray<FEdgeInterval> Intervals;
+};
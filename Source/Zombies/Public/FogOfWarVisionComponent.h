@@ -5,10 +5,47 @@
 #include "CoreMinimal.h"
 #include "Components/SceneComponent.h"
 #include "FogOfWarCommon.h"
+#include "FogOfWarVisibilityPolygon.h"
+#include "GenericTeamAgentInterface.h"
 #include "FogOfWarVisionComponent.generated.h"
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FFogOfWarVisibleActorsUpdated, class UFogOfWarVisionComponent*, VisionComponent, const TSet<AActor*>&, OldVisible, const TSet<AActor*>&, NewVisible);
 
+//Everything the drawn vision of a component depends on. The cached vision is only rebuilt when this changes.
+struct FFogOfWarVisionCacheKey
+{
+	//Snapped vision canvas location and yaw
+	FVector2D CanvasLocation = FVector2D::ZeroVector;
+
+	double Yaw = 0.0;
+
+	double VisionRadius = 0.0;
+
+	double VisionFieldOfViewDeg = 0.0;
+
+	double SelfVisionRadius = 0.0;
+
+	double ShadowBias = 0.0;
+
+	bool bShadows = false;
+
+	//Version of the static and dynamic occluders in the vision canvas bounds
+	uint32 OccludersVersion = 0;
+
+	bool operator==(const FFogOfWarVisionCacheKey& Other) const
+	{
+		return CanvasLocation == Other.CanvasLocation
+			&& Yaw == Other.Yaw
+			&& VisionRadius == Other.VisionRadius
+			&& VisionFieldOfViewDeg == Other.VisionFieldOfViewDeg
+			&& SelfVisionRadius == Other.SelfVisionRadius
+			&& ShadowBias == Other.ShadowBias
+			&& bShadows == Other.bShadows
+			&& OccludersVersion == Other.OccludersVersion;
+	}
+
+	bool operator!=(const FFogOfWarVisionCacheKey& Other) const { return !(*this == Other); }
+};
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class ZOMBIES_API UFogOfWarVisionComponent : public USceneComponent
@@ -33,14 +70,31 @@ public:
 	//Draw the vision of this component to the given canvases
 	virtual void DrawVision(class UFogOfWarDisplayComponent* DisplayComponent, class FCanvas& DisplayCanvas);
 
+	//Draw the visible area into a cleared canvas whose base transform maps the vision canvas transform to the area being drawn to.
+	//With the visibility polygon enabled nothing is drawn outside of the vision canvas bounds, so several components can share one render target.
+	void DrawVisionArea(class FCanvas& Canvas);
+
+	//Draw the visible area from a texture drawn with DrawVisionArea into the display and any discovered areas it overlaps
+	void CompositeVision(class UFogOfWarDisplayComponent* DisplayComponent, class FCanvas& DisplayCanvas, class UTexture* VisionTexture, const FBox2D& VisionUVs);
+
+	//True if vision is drawn from visibility polygons rather than shadow triangles
+	static bool IsVisibilityPolygonEnabled();
+
 	UFUNCTION(BlueprintCallable, Category = FogOfWar)
 	bool CanSeePoint(const FVector& Point) const;
 
+	//Batch version of CanSeePoint that sets a bit for each visible point.
+	//Without a current visibility polygon, the occluder edges around the component are gathered once and every point is tested against them together.
+	void CanSeePoints(TArrayView<const FVector> Points, TBitArray<>& OutVisible) const;
+
 	//The transform of a unit box that encloses the visible area
 	FTransform GetVisionCanvasTransform(bool bForceSquareAspectRatio = true) const;
 
 	FBox2D GetVisionCanvasBounds(bool bForceSquareAspectRatio = true) const;
 
+	//The vision of this component as it is now, for testing visibility away from the game thread
+	FFogOfWarViewer GetViewer() const;
+
 	//Collision channel to test for vision relevant objects like shadow casting meshes, enemy units, items, etc.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	TEnumAsByte<ECollisionChannel> VisionOverlapChannel = ECollisionChannel::ECC_GameTraceChannel1;
@@ -61,29 +115,81 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	double VisionCanvasPadding = 10.0;
 
+	//World space grid the vision canvas is snapped to. Cached vision is reused until the snapped canvas moves, so units shuffling on the spot don't redraw.
+	//Clamped to the canvas padding so that the vision never leaves the canvas.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar, Meta = (ClampMin = 0))
+	double VisionCanvasSnapSize = 8.0;
+
 	//Global push back applied to shadowing edges. Use small positive values to push shadows back into the object, or small negative values to bring them closer.
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
 	double GlobalShadowBias = 0.f;
 
-	//How often the vision checks for new occluders and IFogOfWarActors
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar)
+	//Seconds between updates of the visible IFogOfWarActors. 0 updates every frame.
+	//Components start at a random point in the interval, so that units spawned together don't all update on the same frame.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = FogOfWar, Meta = (ClampMin = 0))
 	float VisionActorsUpdateFrequency = 0.1;
 
+	//World time that UFogOfWarSubsystem next updates the visible actors
+	double NextVisibleActorsUpdateTime = 0.0;
+
 	//Called when visible actors are updated
 	UPROPERTY(BlueprintAssignable, Category = FogOfWar)
 	FFogOfWarVisibleActorsUpdated OnVisibleActorsUpdated;
 
 	FORCEINLINE const auto& GetVisibleActors() const { return VisibleActors; }
 
+	//Called by UFogOfWarSubsystem with the fog of war actors that are inside the vision canvas bounds
+	void UpdateVisionOverlaps(TArrayView<const TWeakObjectPtr<AActor>> Candidates);
+
+	//Replaces the visible actors, passing the change on to UTeamVisibilitySubsystem and broadcasting OnVisibleActorsUpdated if anything changed.
+	//Called by UFogOfWarSubsystem with the results of asynchronous visibility queries.
+	void SetVisibleActors(TSet<AActor*>&& NewVisibleActors);
+
+	//Rebuilds the visibility polygon from the static occluders if the vision cache key has changed. Checks at most once per frame unless the component moves.
+	void UpdateVisibilityPolygon();
+
+	FORCEINLINE const FFogOfWarVisibilityPolygon& GetVisibilityPolygon() const { return VisibilityPolygon; }
+
+	//Tessellated boundary of the visibility polygon, as drawn in a triangle fan from its centre
+	FORCEINLINE const TArray<FVector2D>& GetVisibilityBoundary() const { return VisibilityBoundary; }
+
+	//Changes whenever the visibility polygon is rebuilt, so anything drawn from it knows when it has to be drawn again
+	FORCEINLINE uint32 GetVisionCacheVersion() const { return VisionCacheVersion; }
+
 protected:
 	
-	//Draw the shadow of a static mesh component into a canvas
-	virtual void DrawOccluderShadow(const FFogOfWarOccluderInstance& Occluder, class FCanvas& Canvas, FVector2D Centre, double Radius, double ShadowBias) const;
+	//Draw the visible area as a single triangle fan from the visibility polygon
+	void DrawVisibilityPolygon(class FCanvas& Canvas);
+
+	//Draw the vision cone and self vision circle, then draw shadows over the top for every occluder edge in the canvas bounds
+	void DrawVisionShadows(class FCanvas& Canvas, const FBox2D& CanvasBounds);
+
+	//Draw the shadow of a static mesh component into a canvas, reading its baked edges from WorldEdges if it has them
+	virtual void DrawOccluderShadow(const FFogOfWarOccluderInstance& Occluder, const FFogOfWarEdgeBuffer* WorldEdges, class FCanvas& Canvas, FVector2D Centre, double Radius, double ShadowBias) const;
 
 	//Helper to get half the FOV in radians while making sure it is clamped to 0 -> PI
 	double GetHalfFOVInRadians() const;
 
-	void UpdateVisionOverlaps();
+
+	//Visible area as of the last UpdateVisibilityPolygon, used for drawing and CanSeePoint
+	FFogOfWarVisibilityPolygon VisibilityPolygon;
+
+	//Last frame the vision cache key was checked, so drawing and overlap updates in the same frame only look up the occluders once
+	uint64 VisibilityPolygonFrame = MAX_uint64;
+
+	//What the visibility polygon was built from
+	FFogOfWarVisionCacheKey VisionCacheKey;
+
+	//Incremented every time the visibility polygon is rebuilt, 0 until it is first built
+	uint32 VisionCacheVersion = 0;
+
+	FFogOfWarVisionCacheKey MakeVisionCacheKey(const FTransform& CanvasTransform, uint32 OccludersVersion) const;
+
+	//Boundary of the visibility polygon, tessellated when it is rebuilt
+	TArray<FVector2D> VisibilityBoundary;
+
+	//True if the cache key was checked this frame and the component has not moved out of its snapped canvas since
+	bool IsVisibilityPolygonCurrent() const;
 
 	TArray<FFogOfWarOccluderInstance> OverlappingVisionOccluders;
 
@@ -97,5 +203,8 @@ protected:
 	UPROPERTY(Transient, BlueprintReadOnly, Category = FogOfWar, Meta = (AllowPrivateAccess = "true"))
 	TSet<AActor*> VisibleActors;
 
+	//Team the visible actors are counted for in UTeamVisibilitySubsystem
+	FGenericTeamId VisibleActorsTeam = FGenericTeamId::NoTeam;
+
 	void ClearVisibleActors();
 };
@@ -47,7 +47,8 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category = Unit, Meta = (AllowPrivateAccess = "True"))
 	TSet<class AWeaponItem*> RegisteredWeapons;
 
+	//Lets registered weapons know when the team starts or stops seeing an actor that is hostile to it. Other changes can't change what the weapons target.
 	UFUNCTION()
-	void OnVisibleActorsUpdated(class UFogOfWarVisionComponent* VisionComponent, const TSet<AActor*>& OldVisible, const TSet<AActor*>& NewVisible);
+	void OnTeamVisibleActorsUpdated(FGenericTeamId Team, const TArray<AActor*>& AddedActors, const TArray<AActor*>& RemovedActors);
 
 };
@@ -56,6 +56,8 @@ public:
 	// Sets default values for this actor's properties
 	APrototypingMaze();
 
+	virtual void OnConstruction(const FTransform& Transform) override;
+
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
@@ -132,6 +134,7 @@ public:
 
 protected:
 
-	//UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Prototyping, Meta = (AllowPrivateAccess = "True"))
-	//class UInstancedStaticMeshComponent* WallMeshes;
+	//Every wall is an instance of the wall mesh, rather than a component of its own
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Prototyping, Meta = (AllowPrivateAccess = "True"))
+	class UInstancedStaticMeshComponent* WallMeshes;
 };
@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "WeaponItem.h"
 #include "UtilityTask.h"
+#include "GenericTeamAgentInterface.h"
 #include "RangedWeaponItem.generated.h"
 
 /**
@@ -64,6 +65,11 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Utility)
 	double CurrentTargetBonus = 0.2;
 
+	//Only score this many of the closest hostile relevant actors, which saves line of sight traces in big crowds. 0 to score all of them.
+	//The current target is always scored, and if none of the closest can be shot the rest are scored as well.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Utility, Meta = (ClampMin = "0"))
+	int32 MaxCandidates = 0;
+
 protected:
 
 	//The target that is chosen to be attacked using ranged weapon
@@ -79,4 +85,7 @@ protected:
 	class UFocusComponent* PawnFocusComponent;
 
 	void TryBeginAbility();
+
+	//Whether an actor is alive and hostile to the pawn
+	bool IsHostileTarget(AActor* Actor, FGenericTeamId PawnTeamId) const;
 };
\ No newline at end of file
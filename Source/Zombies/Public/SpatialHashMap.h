@@ -3,410 +3,2974 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/ParallelFor.h"
+#include "Stats/Stats.h"
 //#include "SpatialHashMap.generated.h"
 
+DECLARE_STATS_GROUP(TEXT("SpatialHash"), STATGROUP_SpatialHash, STATCAT_Advanced);
 
-//Base data for spatial hash maps
-template <typename InGeometryType, typename InValueType>
-struct TSpatialHashMapBase
+//Per frame activity of every spatial hash map, see "stat SpatialHash"
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Elements Added"), STAT_SpatialHashAdds, STATGROUP_SpatialHash, ZOMBIES_API);
+//Only moves that change an element's cells are counted
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Elements Moved"), STAT_SpatialHashMoves, STATGROUP_SpatialHash, ZOMBIES_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Elements Removed"), STAT_SpatialHashRemoves, STATGROUP_SpatialHash, ZOMBIES_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Queries"), STAT_SpatialHashQueries, STATGROUP_SpatialHash, ZOMBIES_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Query Elements Visited"), STAT_SpatialHashElementsVisited, STATGROUP_SpatialHash, ZOMBIES_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Query Elements Accepted"), STAT_SpatialHashElementsAccepted, STATGROUP_SpatialHash, ZOMBIES_API);
+
+//Summary of how the elements of a map are spread over its cells, for tuning cell sizes
+struct ZOMBIES_API FSpatialHashMapStats
 {
-	using GeometryType = InGeometryType;
-	using ValueType = InValueType;
-	using CellType = TArray<int32>;
+	int32 NumElements = 0;
+
+	//Non empty cells
+	int32 NumCells = 0;
+
+	//Element IDs stored over all cells. Larger than NumElements when box elements span several cells.
+	int32 NumCellEntries = 0;
 
-	struct FElement
+	int32 MaxElementsPerCell = 0;
+
+	//Sum of the squared number of element IDs in each cell
+	int64 SumSquaredElementsPerCell = 0;
+
+	//Bucket N counts the cells holding [2^N, 2^(N+1)) element IDs
+	TArray<int32> OccupancyHistogram;
+
+	void AddCell(int32 NumElementIDs)
 	{
-		GeometryType Geometry{ ForceInit };
-		ValueType Value;
-	};
+		if (NumElementIDs <= 0)
+			return;
 
-protected:
+		++NumCells;
+		NumCellEntries += NumElementIDs;
+		MaxElementsPerCell = FMath::Max(MaxElementsPerCell, NumElementIDs);
+		SumSquaredElementsPerCell += (int64)NumElementIDs * NumElementIDs;
 
-	FVector2D Origin;
-	FVector2D CellSize;
-	FVector2D InvCellSize;
+		int32 Bucket = FMath::FloorLog2((uint32)NumElementIDs);
 
+		if (OccupancyHistogram.Num() <= Bucket)
+			OccupancyHistogram.SetNumZeroed(Bucket + 1);
 
-	//GetTypeHash(FIntPoint) simply sums the elements together, which forces all diagonals into the same bucket which is bad for performance.
-	struct FKeyFuncs : public TDefaultMapHashableKeyFuncs<FIntPoint, CellType, false>
+		++OccupancyHistogram[Bucket];
+	}
+
+	double GetMeanElementsPerCell() const
 	{
-		static uint32 GetKeyHash(FIntPoint Key)
-		{
-			return HashCombine(*reinterpret_cast<uint32*>(&Key.X), *reinterpret_cast<uint32*>(&Key.Y));
-		}
-	};
+		return NumCells > 0 ? double(NumCellEntries) / NumCells : 0.0;
+	}
 
-	TMap<FIntPoint, CellType, FDefaultSetAllocator, FKeyFuncs> Cells;
+	//Mean number of element IDs in the cell of each element ID, ie. how crowded cells are on average from the point of view of an element
+	double GetMeanCrowding() const
+	{
+		return NumCellEntries > 0 ? double(SumSquaredElementsPerCell) / NumCellEntries : 0.0;
+	}
 
-	TSparseArray<FElement> Elements;
+	//Mean number of cells each element is stored in
+	double GetMeanCellsPerElement() const
+	{
+		return NumElements > 0 ? double(NumCellEntries) / NumElements : 0.0;
+	}
 
-public:
+	//Suggests a cell size that would make the mean crowding about TargetOccupancy, without growing box elements past MaxCellsPerElement cells each.
+	//Assumes density changes smoothly over a few cells, so apply it and measure again until it settles.
+	FVector2D SuggestCellSize(const FVector2D& CurrentCellSize, double TargetOccupancy = 8.0, double MaxCellsPerElement = 4.0) const;
 
-	TSpatialHashMapBase()
+	FString ToString() const;
+};
+
+namespace SpatialHashMapUtils
+{
+	//Adds a finished query to the "stat SpatialHash" counters
+	inline void RecordQueryStats(int32 NumVisited, int32 NumAccepted)
 	{
-		SetTransform(FVector2D::Zero(), FVector2D{ 500.0, 500.0 });
+		INC_DWORD_STAT(STAT_SpatialHashQueries);
+		INC_DWORD_STAT_BY(STAT_SpatialHashElementsVisited, NumVisited);
+		INC_DWORD_STAT_BY(STAT_SpatialHashElementsAccepted, NumAccepted);
 	}
+}
 
-	const auto& GetCells() const { return Cells; }
 
-	const auto& GetElements() const { return Elements; }
+//Rect around every cell that has held an element since the cells were last emptied.
+//Only ever grows, since shrinking it would mean searching the remaining cells on every remove, so it can be larger than the cells in use.
+struct FSpatialHashMapOccupiedBounds
+{
+	FIntRect Rect{ FIntPoint{ MAX_int32 }, FIntPoint{ MIN_int32 } };
 
-	void SetTransform(FVector2D InOrigin, FVector2D InCellSize)
+	FORCEINLINE bool IsEmpty() const { return Rect.Min.X > Rect.Max.X; }
+
+	FORCEINLINE void Add(FIntPoint Cell)
 	{
-		//modify transform on non-empty map is not supported
-		Empty();
+		Rect.Min = Rect.Min.ComponentMin(Cell);
+		Rect.Max = Rect.Max.ComponentMax(Cell + 1);
+	}
 
-		Origin = InOrigin;
-		CellSize = InCellSize;
-		InvCellSize = { 1.0 / CellSize.X, 1.0 / CellSize.Y };
+	void Reset()
+	{
+		*this = FSpatialHashMapOccupiedBounds{};
 	}
+};
 
-	const FVector2D& GetOrigin() const { return Origin; }
-	const FVector2D& GetCellSize() const { return CellSize; }
-	const FVector2D& GetInvCellSize() const { return InvCellSize; }
+//Iterates a contiguous range of element IDs belonging to a single cell
+struct FSpatialHashMapCellRangeIterator
+{
+	FSpatialHashMapCellRangeIterator() = default;
 
-	FVector2D WorldToLocal(const FVector2D& Position) const
+	FSpatialHashMapCellRangeIterator(const int32* InCurrent, const int32* InEnd) : Current(InCurrent), End(InEnd) {}
+
+	explicit operator bool() const
 	{
-		return (Position - Origin) * InvCellSize;
+		return Current != End;
 	}
 
-	FBox2D WorldToLocal(const FBox2D& Box) const
+	int32 operator*() const
 	{
-		return FBox2d{ WorldToLocal(Box.Min), WorldToLocal(Box.Max) };
+		check(Current != End);
+		return *Current;
 	}
 
-	FVector2D LocalToWorld(const FVector2D& Position) const
+	FSpatialHashMapCellRangeIterator& operator++()
 	{
-		return Position * CellSize + Origin;
+		++Current;
+		return *this;
 	}
 
-	FBox2D LocalToWorld(const FBox2D& Box) const
+protected:
+
+	const int32* Current = nullptr;
+
+	const int32* End = nullptr;
+};
+
+//Cell storage policy that stores each cell as its own array of element IDs in a hash map.
+//Simple and general, but every newly occupied cell allocates, and the cells are scattered around in memory.
+struct FSpatialHashMapSparseCells
+{
+	using FCellIterator = FSpatialHashMapCellRangeIterator;
+
+	FCellIterator CreateCellIterator(FIntPoint Cell) const
 	{
-		return FBox2D{ LocalToWorld(Box.Min), LocalToWorld(Box.Max) };
+		if (auto ElementIDs = Cells.Find(Cell))
+			return FCellIterator{ ElementIDs->GetData(), ElementIDs->GetData() + ElementIDs->Num() };
+
+		return FCellIterator{};
 	}
 
-	FIntPoint GetCellGeometry(const FVector2D& LocalPosition) const
+	void Add(FIntPoint Cell, int32 ElementID)
 	{
-		return FIntPoint{ FMath::FloorToInt32(LocalPosition.X), FMath::FloorToInt32(LocalPosition.Y) };
+		Cells.FindOrAdd(Cell).Add(ElementID);
+
+		OccupiedBounds.Add(Cell);
 	}
 
-	FIntRect GetCellGeometry(const FBox2D& LocalBox) const
+	void Remove(FIntPoint Cell, int32 ElementID, bool bAllowShrinking)
 	{
-		return FIntRect{ GetCellGeometry(LocalBox.Min), GetCellGeometry(LocalBox.Max) + 1 };
+		if (auto ElementIDs = Cells.Find(Cell))
+		{
+			ElementIDs->RemoveSingleSwap(ElementID, bAllowShrinking);
+
+			if (ElementIDs->Num() == 0)
+				Cells.Remove(Cell);
+		}
 	}
 
-	FElement& GetElement(int32 ElementID)
+	void Append(FIntPoint Cell, TArrayView<const int32> ElementIDs)
 	{
-		return Elements[ElementID];
+		Cells.FindOrAdd(Cell).Append(ElementIDs.GetData(), ElementIDs.Num());
+
+		OccupiedBounds.Add(Cell);
 	}
 
-	const FElement& GetElement(int32 ElementID) const
+	//Removes every element ID in the cell that is set in Marked, which is indexed by element ID
+	void RemoveMarked(FIntPoint Cell, const TBitArray<>& Marked, bool bAllowShrinking)
 	{
-		return Elements[ElementID];
+		if (auto ElementIDs = Cells.Find(Cell))
+		{
+			ElementIDs->RemoveAllSwap([&](int32 ElementID) { return Marked[ElementID]; }, bAllowShrinking);
+
+			if (ElementIDs->Num() == 0)
+				Cells.Remove(Cell);
+		}
 	}
 
-	ValueType& GetValue(int32 ElementID)
+	//Unbounded, so every cell is valid
+	FIntPoint ClampCell(FIntPoint Cell) const
 	{
-		return Elements[ElementID].Value;
+		return Cell;
 	}
 
-	const ValueType& GetValue(int32 ElementID) const
+	//Number of non empty cells
+	int32 Num() const
 	{
-		return Elements[ElementID].Value;
+		return Cells.Num();
 	}
 
-	const FBox2D& GetGeometry(int32 ElementID) const
+	//Calls Func(FIntPoint Cell, int32 NumElementIDs) for each non empty cell
+	template <typename FuncType>
+	void ForEachCell(FuncType&& Func) const
 	{
-		return Elements[ElementID].Geometry;
+		for (auto& [Cell, ElementIDs] : Cells)
+			Func(Cell, ElementIDs.Num());
+	}
+
+	const FSpatialHashMapOccupiedBounds& GetOccupiedBounds() const
+	{
+		return OccupiedBounds;
 	}
 
 	void Empty()
 	{
-		Elements.Empty();
 		Cells.Empty();
+		OccupiedBounds.Reset();
 	}
-};
 
-//Maps a geometry to the cells that it should appear in
-template <typename InGeometryType, typename InValueType>
-struct TSpatialHashMapGeometryType : public TSpatialHashMapBase<InGeometryType, InValueType>
-{
 protected:
 
-	//void AddElementID(const GeometryType& Geometry, int32 ElementID);
+	//GetTypeHash(FIntPoint) simply sums the elements together, which forces all diagonals into the same bucket which is bad for performance.
+	struct FKeyFuncs : public TDefaultMapHashableKeyFuncs<FIntPoint, TArray<int32>, false>
+	{
+		static uint32 GetKeyHash(FIntPoint Key)
+		{
+			return HashCombine(*reinterpret_cast<uint32*>(&Key.X), *reinterpret_cast<uint32*>(&Key.Y));
+		}
+	};
 
-	//void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking);
+	TMap<FIntPoint, TArray<int32>, FDefaultSetAllocator, FKeyFuncs> Cells;
 
+	FSpatialHashMapOccupiedBounds OccupiedBounds;
 };
 
-template <typename InValueType>
-struct TSpatialHashMapGeometryType<FVector2D, InValueType> : public TSpatialHashMapBase<FVector2D, InValueType>
+//Cell storage policy that stores cells in a flat open addressing table (linear probing, backward shift deletion),
+//with the element IDs of every cell pooled into a single array of power of two sized slabs.
+//Freed slabs are kept on intrusive per size class free lists, so once the pool is warmed up adding, moving and removing elements does not allocate.
+struct FSpatialHashMapFlatCells
 {
-	using Super = TSpatialHashMapBase<FVector2D, InValueType>;
-	using Super::GetCellGeometry;
-	using typename Super::GeometryType;
-
-protected:
+	using FCellIterator = FSpatialHashMapCellRangeIterator;
 
-	void AddElementID(const GeometryType& Geometry, int32 ElementID)
+	FSpatialHashMapFlatCells()
 	{
-		InternalAddElementID(GetCellGeometry(Geometry), ElementID);
+		ResetFreeSlabs();
 	}
 
-	void MoveElementID(const GeometryType& OldGeometry, const GeometryType& NewGeometry, int32 ElementID, bool bAllowShrinking)
+	FCellIterator CreateCellIterator(FIntPoint Cell) const
 	{
-		auto OldPoint = GetCellGeometry(OldGeometry);
-		auto NewPoint = GetCellGeometry(NewGeometry);
+		int32 SlotIndex = FindSlot(Cell);
 
-		if (OldPoint == NewPoint)
-			//Same cell, do not need to do anything
-			return;
-		
-		InternalRemoveElementID(OldPoint, ElementID, bAllowShrinking);
-		InternalAddElementID(NewPoint, ElementID);
-	}
+		if (SlotIndex == INDEX_NONE)
+			return FCellIterator{};
 
-	void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking)
-	{
-		InternalRemoveElementID(GetCellGeometry(Geometry), ElementID, bAllowShrinking);
-	}
+		auto& Slot = Slots[SlotIndex];
 
-protected:
+		const int32* Data = Pool.GetData() + Slot.Offset;
 
-	void InternalAddElementID(const FIntPoint& Point, int32 ElementID)
-	{
-		Cells.FindOrAdd(Point).Add(ElementID);
+		return FCellIterator{ Data, Data + Slot.Num };
 	}
 
-	void InternalRemoveElementID(const FIntPoint& Point, int32 ElementID, bool bAllowShrinking)
+	void Add(FIntPoint Cell, int32 ElementID)
 	{
-		if (auto Cell = Cells.Find(Point))
-		{
-			Cell->RemoveSingleSwap(ElementID, bAllowShrinking);
-
-			if (Cell->Num() == 0)
-				Cells.Remove(Point);
-		}
-	}
-
+		auto& Slot = Slots[FindOrAddSlot(Cell)];
 
-};
-
-template <typename InValueType>
-struct TSpatialHashMapGeometryType<FBox2D, InValueType> : public TSpatialHashMapBase<FBox2D, InValueType>
-{
-	using Super = TSpatialHashMapBase<FBox2D, InValueType>;
-	using Super::GetCellGeometry;
-	using typename Super::GeometryType;
+		if (Slot.Num == GetSlabCapacity(Slot.SizeClass))
+			GrowSlab(Slot, Slot.Num + 1);
 
-protected:
+		Pool[Slot.Offset + Slot.Num++] = ElementID;
 
-	void AddElementID(const GeometryType& Geometry, int32 ElementID)
-	{
-		InternalAddElementID(GetCellGeometry(Geometry), ElementID);
+		OccupiedBounds.Add(Cell);
 	}
 
-	void MoveElementID(const GeometryType& OldGeometry, const GeometryType& NewGeometry, int32 ElementID, bool bAllowShrinking)
+	//Slabs are only handed back to the pool once their cell is empty, so bAllowShrinking is ignored.
+	void Remove(FIntPoint Cell, int32 ElementID, bool bAllowShrinking)
 	{
-		auto OldBox = GetCellGeometry(OldGeometry);
-		auto NewBox = GetCellGeometry(NewGeometry);
+		int32 SlotIndex = FindSlot(Cell);
 
-		if (OldBox == NewBox)
-			//Could possibly be optimised further by doing a set intersection of covered cells instead of simple equality
+		if (SlotIndex == INDEX_NONE)
 			return;
 
-		InternalRemoveElementID(OldBox, ElementID, bAllowShrinking);
-		InternalAddElementID(NewBox, ElementID, bAllowShrinking);
-	}
+		auto& Slot = Slots[SlotIndex];
 
-	void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking)
-	{
-		InternalRemoveElementID(GetCellGeometry(Geometry), ElementID, bAllowShrinking);
-	}
+		int32* Data = Pool.GetData() + Slot.Offset;
 
-protected:
+		for (int32 Index = 0; Index < Slot.Num; ++Index)
+			if (Data[Index] == ElementID)
+			{
+				Data[Index] = Data[--Slot.Num];
+				break;
+			}
 
-	void InternalAddElementID(const FIntRect& Box, int32 ElementID)
-	{
-		for (int32 Y = Box.Min.Y; Y < Box.Max.Y; ++Y)
-			for (int32 X = Box.Min.X; X < Box.Max.X; ++X)
-				Cells.FindOrAdd(FIntPoint{ X,Y }).Add(ElementID);
+		if (Slot.Num == 0)
+			RemoveSlot(SlotIndex);
 	}
 
-	void InternalRemoveElementID(const FIntRect& Box, int32 ElementID, bool bAllowShrinking)
+	void Append(FIntPoint Cell, TArrayView<const int32> ElementIDs)
 	{
-		for (int32 Y = Box.Min.Y; Y < Box.Max.Y; ++Y)
-			for (int32 X = Box.Min.X; X < Box.Max.X; ++X)
-				if (auto Cell = Cells.Find(FIntPoint{ X,Y }))
-				{
-					Cell->RemoveSingleSwap(ElementID, bAllowShrinking);
+		auto& Slot = Slots[FindOrAddSlot(Cell)];
 
-					if (Cell->Num() == 0)
-						Cells.Remove(FIntPoint{ X,Y });
-				}
-	}
-};
+		GrowSlab(Slot, Slot.Num + ElementIDs.Num());
 
+		FMemory::Memcpy(Pool.GetData() + Slot.Offset + Slot.Num, ElementIDs.GetData(), ElementIDs.Num() * sizeof(int32));
 
-//UE style iterator
-template <typename MapType>
-struct TSpatialHashMapBoxQuery
-{
-	template <typename T>
-	using ChooseConstType = typename TChooseClass<TIsConst<MapType>::Value, const T, T>::Result;
+		Slot.Num += ElementIDs.Num();
 
-	using IteratorMapType = MapType;
+		OccupiedBounds.Add(Cell);
+	}
 
-	using IteratorCellType = typename ChooseConstType<typename MapType::CellType>;
+	//Removes every element ID in the cell that is set in Marked, which is indexed by element ID
+	void RemoveMarked(FIntPoint Cell, const TBitArray<>& Marked, bool bAllowShrinking)
+	{
+		int32 SlotIndex = FindSlot(Cell);
 
-	using IteratorElementType = typename ChooseConstType<typename MapType::FElement>;
+		if (SlotIndex == INDEX_NONE)
+			return;
 
-	using IteratorValueType = typename ChooseConstType<typename MapType::ValueType>;
+		auto& Slot = Slots[SlotIndex];
 
-	TSpatialHashMapBoxQuery(IteratorMapType& InMap, const FBox2D& InQueryBox) : Map(InMap), QueryBox(InQueryBox), QueryCellBox(InMap.GetCellGeometry(InQueryBox))
-	{
-		//Start one to the left so that Advance() will advance to the first valid element
-		CurrentCell.X = QueryCellBox.Min.X - 1;
-		CurrentCell.Y = QueryCellBox.Min.Y;
+		int32* Data = Pool.GetData() + Slot.Offset;
 
-		Advance();
-	};
+		for (int32 Index = 0; Index < Slot.Num;)
+			if (Marked[Data[Index]])
+				Data[Index] = Data[--Slot.Num];
+			else
+				++Index;
 
-	operator bool() const
+		if (Slot.Num == 0)
+			RemoveSlot(SlotIndex);
+	}
+
+	//Unbounded, so every cell is valid
+	FIntPoint ClampCell(FIntPoint Cell) const
 	{
-		return CurrentCell.X < QueryCellBox.Max.X && CurrentCell.Y < QueryCellBox.Max.Y;
+		return Cell;
 	}
 
-	TSpatialHashMapBoxQuery& operator++()
+	//Number of non empty cells
+	int32 Num() const
 	{
-		Advance();
-		return *this;
+		return NumUsedSlots;
 	}
 
-	IteratorValueType& operator*() const
+	//Calls Func(FIntPoint Cell, int32 NumElementIDs) for each non empty cell
+	template <typename FuncType>
+	void ForEachCell(FuncType&& Func) const
 	{
-		check(CurrentElement);
-		return CurrentElement->Value;
+		for (auto& Slot : Slots)
+			if (Slot.IsUsed())
+				Func(Slot.Key, Slot.Num);
 	}
 
-	IteratorValueType* operator->() const
+	const FSpatialHashMapOccupiedBounds& GetOccupiedBounds() const
 	{
-		check(CurrentElement);
-		return &CurrentElement->Value;
+		return OccupiedBounds;
 	}
 
-	const FBox2D& GetLocalGeometry() const
+	void Empty()
 	{
-		check(CurrentElement);
-		return CurrentElement->Geometry;
+		Slots.Empty();
+		Pool.Empty();
+		NumUsedSlots = 0;
+		ResetFreeSlabs();
+		OccupiedBounds.Reset();
 	}
 
-	const FBox2D& GetWorldGeometry() const
+	//Unlike GetTypeHash(FIntPoint), this spreads neighbouring and diagonal cells across the table, which matters a lot for linear probing
+	static uint32 HashCell(FIntPoint Cell)
 	{
-		return Map.LocalToWorld(GetLocalGeometry());
+		uint32 Hash = (uint32)Cell.X * 0x9E3779B1u ^ (uint32)Cell.Y * 0x85EBCA77u;
+
+		return Hash ^ (Hash >> 16);
 	}
 
 protected:
 
-	IteratorMapType& Map;
+	//Smallest slab holds 4 element IDs
+	static constexpr int32 MinSizeClass = 2;
 
-	FBox2D QueryBox;
+	static constexpr int32 NumSizeClasses = 31;
 
-	FIntRect QueryCellBox;
+	struct FSlot
+	{
+		FIntPoint Key{ 0, 0 };
 
-	FIntPoint CurrentCell;
+		//Offset of this cells slab in the pool, or INDEX_NONE if the slot is unused
+		int32 Offset = INDEX_NONE;
 
-	IteratorElementType* CurrentElement = nullptr;
+		//Number of element IDs in the slab
+		int32 Num = 0;
 
-	IteratorCellType* Elements = nullptr;
+		//Log2 of the slab capacity
+		int32 SizeClass = MinSizeClass;
 
-	int32 ElementIndex = -1;
+		bool IsUsed() const { return Offset != INDEX_NONE; }
+	};
 
-	//Technically these overloads should be specialized template structs to allow further extension
-	bool ShouldVisitElement(const FBox2D& Box) const
+	//Power of two sized table of cells
+	TArray<FSlot> Slots;
+
+	int32 NumUsedSlots = 0;
+
+	FSpatialHashMapOccupiedBounds OccupiedBounds;
+
+	//Backing storage for every cells slab
+	TArray<int32> Pool;
+
+	//Offset of the first free slab of each size class. Free slabs store the offset of the next free slab of the same size class in their first entry.
+	int32 FreeSlabs[NumSizeClasses];
+
+	static int32 GetSlabCapacity(int32 SizeClass)
 	{
-		//Since the map is flat, box elements can appear in multiple cells, so we only actually visit it once when we hit the elements minimum cell that is within the query.
-		//We are guaranteed to hit the minimum cell of an element first.
-		FIntPoint MinCell = Map.GetCellGeometry(Box.Min).ComponentMax(QueryCellBox.Min);
+		return 1 << SizeClass;
+	}
 
-		return CurrentCell == MinCell && Box.Intersect(QueryBox);
+	void ResetFreeSlabs()
+	{
+		for (auto& FreeSlab : FreeSlabs)
+			FreeSlab = INDEX_NONE;
 	}
 
-	bool ShouldVisitElement(const FVector2D& Point) const
+	int32 FindSlot(FIntPoint Cell) const
 	{
-		//Point type can only ever appear in one cell
-		return QueryBox.IsInside(Point);
+		if (NumUsedSlots == 0)
+			return INDEX_NONE;
+
+		const int32 Mask = Slots.Num() - 1;
+
+		for (int32 SlotIndex = HashCell(Cell) & Mask; Slots[SlotIndex].IsUsed(); SlotIndex = (SlotIndex + 1) & Mask)
+			if (Slots[SlotIndex].Key == Cell)
+				return SlotIndex;
+
+		return INDEX_NONE;
 	}
 
-	void Advance()
+	int32 FindOrAddSlot(FIntPoint Cell)
 	{
-		while (true)
-		{
-			//First try advance current element if any
-			if (Elements)
-			{
-				++ElementIndex;
-				CurrentElement = nullptr;
+		//Keep the load factor at or below 1/2 so that probe sequences stay short
+		if ((NumUsedSlots + 1) * 2 > Slots.Num())
+			Rehash(FMath::Max(16, Slots.Num() * 2));
 
-				if (ElementIndex < Elements->Num())
-				{
-					auto ElementID = (*Elements)[ElementIndex];
-
-					auto& Element = Map.GetElement(ElementID);
-
-					if (ShouldVisitElement(Element.Geometry))
-					{
-						//Found an overlapping element, stop advancing
-						CurrentElement = &Element;
-						return;
-					}
-					else
-						//Element does not overlap or is already visited, go to the next one in the array
-						continue;
-				}
-			}
+		const int32 Mask = Slots.Num() - 1;
 
-			//Moving on to new cell
-			Elements = nullptr;
-			ElementIndex = -1;
+		int32 SlotIndex = HashCell(Cell) & Mask;
 
-			CurrentCell.X++;
+		for (; Slots[SlotIndex].IsUsed(); SlotIndex = (SlotIndex + 1) & Mask)
+			if (Slots[SlotIndex].Key == Cell)
+				return SlotIndex;
 
-			if (CurrentCell.X >= QueryCellBox.Max.X)
-			{
-				CurrentCell.Y++;
+		auto& Slot = Slots[SlotIndex];
 
-				if (CurrentCell.Y >= QueryCellBox.Max.Y)
-					//Reached end of rect
-					return;
+		Slot.Key = Cell;
+		Slot.Num = 0;
+		Slot.SizeClass = MinSizeClass;
+		Slot.Offset = AllocateSlab(Slot.SizeClass);
 
-				CurrentCell.X = QueryCellBox.Min.X;
-			}
+		++NumUsedSlots;
 
-			//Initialize element iteration in new current cell.
-			Elements = Map.GetCells().Find(CurrentCell);
-			ElementIndex = -1;
-		}
+		return SlotIndex;
 	}
 
-};
+	void RemoveSlot(int32 SlotIndex)
+	{
+		FreeSlab(Slots[SlotIndex].Offset, Slots[SlotIndex].SizeClass);
 
+		const int32 Mask = Slots.Num() - 1;
 
+		int32 Hole = SlotIndex;
 
-//Spatial hash map that maps a geometry to value and is spatially queryable
-//Currently only supports 2D point and box geometries.
-template <typename InGeometryType, typename InValueType>
-struct TSpatialHashMap : TSpatialHashMapGeometryType<InGeometryType, InValueType>
-{
-	using Super = TSpatialHashMapGeometryType<InGeometryType, InValueType>;
+		//Backward shift deletion: pull any later entries of the probe sequence back into the hole so that lookups never need tombstones
+		for (int32 Next = (Hole + 1) & Mask; Slots[Next].IsUsed(); Next = (Next + 1) & Mask)
+		{
+			int32 Ideal = HashCell(Slots[Next].Key) & Mask;
+
+			if (((Next - Ideal) & Mask) >= ((Next - Hole) & Mask))
+			{
+				Slots[Hole] = Slots[Next];
+				Hole = Next;
+			}
+		}
+
+		Slots[Hole] = FSlot{};
+
+		--NumUsedSlots;
+	}
+
+	void Rehash(int32 NewNumSlots)
+	{
+		check(FMath::IsPowerOfTwo(NewNumSlots));
+
+		auto OldSlots = MoveTemp(Slots);
+
+		Slots.SetNum(NewNumSlots);
+
+		const int32 Mask = NewNumSlots - 1;
+
+		for (auto& OldSlot : OldSlots)
+		{
+			if (!OldSlot.IsUsed())
+				continue;
+
+			int32 SlotIndex = HashCell(OldSlot.Key) & Mask;
+
+			while (Slots[SlotIndex].IsUsed())
+				SlotIndex = (SlotIndex + 1) & Mask;
+
+			Slots[SlotIndex] = OldSlot;
+		}
+	}
+
+	int32 AllocateSlab(int32 SizeClass)
+	{
+		check(SizeClass < NumSizeClasses);
+
+		int32 Offset = FreeSlabs[SizeClass];
+
+		if (Offset != INDEX_NONE)
+		{
+			FreeSlabs[SizeClass] = Pool[Offset];
+			return Offset;
+		}
+
+		return Pool.AddUninitialized(GetSlabCapacity(SizeClass));
+	}
+
+	void FreeSlab(int32 Offset, int32 SizeClass)
+	{
+		Pool[Offset] = FreeSlabs[SizeClass];
+		FreeSlabs[SizeClass] = Offset;
+	}
+
+	//Moves a slot into a slab that can hold at least MinCapacity element IDs
+	void GrowSlab(FSlot& Slot, int32 MinCapacity)
+	{
+		int32 NewSizeClass = Slot.SizeClass;
+
+		while (GetSlabCapacity(NewSizeClass) < MinCapacity)
+			++NewSizeClass;
+
+		if (NewSizeClass == Slot.SizeClass)
+			return;
+
+		//Allocating may reallocate the pool, so only take pointers into it afterwards
+		int32 NewOffset = AllocateSlab(NewSizeClass);
+
+		FMemory::Memcpy(Pool.GetData() + NewOffset, Pool.GetData() + Slot.Offset, Slot.Num * sizeof(int32));
+
+		FreeSlab(Slot.Offset, Slot.SizeClass);
+
+		Slot.Offset = NewOffset;
+		Slot.SizeClass = NewSizeClass;
+	}
+};
+
+//Cell storage policy for maps with known bounds. Cells live in a flat array indexed by X + Y * Width, so finding a cell needs no hashing at all.
+//Each cell is a singly linked list of element IDs through a shared link array, with removed links recycled through a free list.
+//Cells outside of the cell bounds are clamped onto the border cells, so elements outside the bounds are still found, just less efficiently.
+struct FSpatialHashMapDenseCells
+{
+	struct FLink
+	{
+		int32 ElementID;
+
+		//Next link in the same cell, or INDEX_NONE. For free links, the next free link.
+		int32 Next;
+	};
+
+	struct FCellIterator
+	{
+		FCellIterator() = default;
+
+		FCellIterator(const FLink* InLinks, int32 InCurrent) : Links(InLinks), Current(InCurrent) {}
+
+		explicit operator bool() const
+		{
+			return Current != INDEX_NONE;
+		}
+
+		int32 operator*() const
+		{
+			check(Current != INDEX_NONE);
+			return Links[Current].ElementID;
+		}
+
+		FCellIterator& operator++()
+		{
+			Current = Links[Current].Next;
+			return *this;
+		}
+
+	protected:
+
+		const FLink* Links = nullptr;
+
+		int32 Current = INDEX_NONE;
+	};
+
+	FSpatialHashMapDenseCells()
+	{
+		SetCellBounds(FIntRect{ 0, 0, 1, 1 });
+	}
+
+	//Resizes the grid to cover the given cells. Removes all element IDs.
+	void SetCellBounds(const FIntRect& InCellBounds)
+	{
+		check(InCellBounds.Width() > 0 && InCellBounds.Height() > 0);
+
+		CellBounds = InCellBounds;
+
+		Heads.Reset();
+		Heads.Init(INDEX_NONE, CellBounds.Width() * CellBounds.Height());
+
+		Empty();
+	}
+
+	const FIntRect& GetCellBounds() const
+	{
+		return CellBounds;
+	}
+
+	FIntPoint ClampCell(FIntPoint Cell) const
+	{
+		return FIntPoint{ FMath::Clamp(Cell.X, CellBounds.Min.X, CellBounds.Max.X - 1), FMath::Clamp(Cell.Y, CellBounds.Min.Y, CellBounds.Max.Y - 1) };
+	}
+
+	FCellIterator CreateCellIterator(FIntPoint Cell) const
+	{
+		if (!IsInBounds(Cell))
+			return FCellIterator{};
+
+		return FCellIterator{ Links.GetData(), Heads[GetCellIndex(Cell)] };
+	}
+
+	void Add(FIntPoint Cell, int32 ElementID)
+	{
+		check(IsInBounds(Cell));
+
+		int32& Head = Heads[GetCellIndex(Cell)];
+
+		int32 LinkIndex = FreeLinks;
+
+		if (LinkIndex != INDEX_NONE)
+			FreeLinks = Links[LinkIndex].Next;
+		else
+			LinkIndex = Links.AddUninitialized();
+
+		if (Head == INDEX_NONE)
+			++NumUsedCells;
+
+		Links[LinkIndex] = FLink{ ElementID, Head };
+
+		Head = LinkIndex;
+
+		OccupiedBounds.Add(Cell);
+	}
+
+	//Links are recycled through the free list, so bAllowShrinking is ignored.
+	void Remove(FIntPoint Cell, int32 ElementID, bool bAllowShrinking)
+	{
+		if (!IsInBounds(Cell))
+			return;
+
+		int32& Head = Heads[GetCellIndex(Cell)];
+
+		for (int32* Prev = &Head; *Prev != INDEX_NONE; Prev = &Links[*Prev].Next)
+		{
+			int32 LinkIndex = *Prev;
+
+			if (Links[LinkIndex].ElementID != ElementID)
+				continue;
+
+			*Prev = Links[LinkIndex].Next;
+
+			Links[LinkIndex].Next = FreeLinks;
+			FreeLinks = LinkIndex;
+
+			if (Head == INDEX_NONE)
+				--NumUsedCells;
+
+			return;
+		}
+	}
+
+	void Append(FIntPoint Cell, TArrayView<const int32> ElementIDs)
+	{
+		for (int32 ElementID : ElementIDs)
+			Add(Cell, ElementID);
+	}
+
+	//Removes every element ID in the cell that is set in Marked, which is indexed by element ID
+	void RemoveMarked(FIntPoint Cell, const TBitArray<>& Marked, bool bAllowShrinking)
+	{
+		if (!IsInBounds(Cell))
+			return;
+
+		int32& Head = Heads[GetCellIndex(Cell)];
+
+		if (Head == INDEX_NONE)
+			return;
+
+		for (int32* Prev = &Head; *Prev != INDEX_NONE;)
+		{
+			int32 LinkIndex = *Prev;
+
+			if (!Marked[Links[LinkIndex].ElementID])
+			{
+				Prev = &Links[LinkIndex].Next;
+				continue;
+			}
+
+			*Prev = Links[LinkIndex].Next;
+
+			Links[LinkIndex].Next = FreeLinks;
+			FreeLinks = LinkIndex;
+		}
+
+		if (Head == INDEX_NONE)
+			--NumUsedCells;
+	}
+
+	//Number of non empty cells
+	int32 Num() const
+	{
+		return NumUsedCells;
+	}
+
+	//Calls Func(FIntPoint Cell, int32 NumElementIDs) for each non empty cell
+	template <typename FuncType>
+	void ForEachCell(FuncType&& Func) const
+	{
+		for (int32 CellIndex = 0; CellIndex < Heads.Num(); ++CellIndex)
+		{
+			if (Heads[CellIndex] == INDEX_NONE)
+				continue;
+
+			int32 NumElementIDs = 0;
+
+			for (int32 LinkIndex = Heads[CellIndex]; LinkIndex != INDEX_NONE; LinkIndex = Links[LinkIndex].Next)
+				++NumElementIDs;
+
+			Func(FIntPoint{ CellBounds.Min.X + CellIndex % CellBounds.Width(), CellBounds.Min.Y + CellIndex / CellBounds.Width() }, NumElementIDs);
+		}
+	}
+
+	const FSpatialHashMapOccupiedBounds& GetOccupiedBounds() const
+	{
+		return OccupiedBounds;
+	}
+
+	//Removes all element IDs, but keeps the cell bounds
+	void Empty()
+	{
+		for (auto& Head : Heads)
+			Head = INDEX_NONE;
+
+		Links.Empty();
+		FreeLinks = INDEX_NONE;
+		NumUsedCells = 0;
+		OccupiedBounds.Reset();
+	}
+
+protected:
+
+	FIntRect CellBounds;
+
+	//First link of each cell, or INDEX_NONE if the cell is empty
+	TArray<int32> Heads;
+
+	TArray<FLink> Links;
+
+	int32 FreeLinks = INDEX_NONE;
+
+	int32 NumUsedCells = 0;
+
+	FSpatialHashMapOccupiedBounds OccupiedBounds;
+
+	bool IsInBounds(FIntPoint Cell) const
+	{
+		return Cell.X >= CellBounds.Min.X && Cell.Y >= CellBounds.Min.Y && Cell.X < CellBounds.Max.X && Cell.Y < CellBounds.Max.Y;
+	}
+
+	int32 GetCellIndex(FIntPoint Cell) const
+	{
+		return (Cell.X - CellBounds.Min.X) + (Cell.Y - CellBounds.Min.Y) * CellBounds.Width();
+	}
+};
+
+//Read only cell storage policy for snapshots, built in one go with ParallelFor.
+//Cells are a flat open addressing table (like FSpatialHashMapFlatCells) of ranges into a single compact array of element IDs.
+//Nothing is modified after building, so any number of threads can query it at once.
+struct FSpatialHashMapFrozenCells
+{
+	using FCellIterator = FSpatialHashMapCellRangeIterator;
+
+	FCellIterator CreateCellIterator(FIntPoint Cell) const
+	{
+		if (Slots.Num() == 0)
+			return FCellIterator{};
+
+		const int32 Mask = Slots.Num() - 1;
+
+		for (int32 SlotIndex = FSpatialHashMapFlatCells::HashCell(Cell) & Mask; Slots[SlotIndex].IsUsed(); SlotIndex = (SlotIndex + 1) & Mask)
+		{
+			auto& Slot = Slots[SlotIndex];
+
+			if (Slot.Key == Cell)
+				return FCellIterator{ ElementIDs.GetData() + Slot.Start, ElementIDs.GetData() + Slot.Start + Slot.Num };
+		}
+
+		return FCellIterator{};
+	}
+
+	//Unbounded, so every cell is valid
+	FIntPoint ClampCell(FIntPoint Cell) const
+	{
+		return Cell;
+	}
+
+	//Number of non empty cells
+	int32 Num() const
+	{
+		return NumUsedSlots;
+	}
+
+	//Calls Func(FIntPoint Cell, int32 NumElementIDs) for each non empty cell
+	template <typename FuncType>
+	void ForEachCell(FuncType&& Func) const
+	{
+		for (auto& Slot : Slots)
+			if (Slot.IsUsed())
+				Func(Slot.Key, Slot.Num);
+	}
+
+	const FSpatialHashMapOccupiedBounds& GetOccupiedBounds() const
+	{
+		return OccupiedBounds;
+	}
+
+	void Empty()
+	{
+		Slots.Empty();
+		ElementIDs.Empty();
+		NumUsedSlots = 0;
+		OccupiedBounds.Reset();
+	}
+
+	//Rebuilds all cells. GetCellRect(ElementID) returns the cells covered by each element, or an empty rect for unused element IDs.
+	//GetCellRect is called from multiple threads at once.
+	//Element IDs within each cell end up in ascending order, so results do not depend on thread timing.
+	template <typename CellRectFuncType>
+	void Build(int32 MaxElementID, CellRectFuncType GetCellRect)
+	{
+		Empty();
+
+		TArray<FIntRect> CellRects;
+		TArray<int32> EntryOffsets;
+
+		CellRects.SetNumUninitialized(MaxElementID);
+		EntryOffsets.SetNumUninitialized(MaxElementID + 1);
+
+		EntryOffsets[0] = 0;
+
+		ParallelFor(MaxElementID, [&](int32 ElementID)
+		{
+			CellRects[ElementID] = GetCellRect(ElementID);
+			EntryOffsets[ElementID + 1] = CellRects[ElementID].IsEmpty() ? 0 : CellRects[ElementID].Area();
+		});
+
+		for (int32 ElementID = 0; ElementID < MaxElementID; ++ElementID)
+			EntryOffsets[ElementID + 1] += EntryOffsets[ElementID];
+
+		const int32 NumEntries = EntryOffsets[MaxElementID];
+
+		if (NumEntries == 0)
+			return;
+
+		//Find the slot of every entry. Inserting into the table is the only serial part of the build.
+		TArray<int32> EntrySlots;
+
+		EntrySlots.SetNumUninitialized(NumEntries);
+
+		Slots.SetNum(FMath::RoundUpToPowerOfTwo(FMath::Max(16, NumEntries * 2)));
+
+		for (int32 ElementID = 0; ElementID < MaxElementID; ++ElementID)
+		{
+			const FIntRect& Rect = CellRects[ElementID];
+
+			int32 Entry = EntryOffsets[ElementID];
+
+			if (!Rect.IsEmpty())
+			{
+				OccupiedBounds.Add(Rect.Min);
+				OccupiedBounds.Add(Rect.Max - 1);
+			}
+
+			for (int32 Y = Rect.Min.Y; Y < Rect.Max.Y; ++Y)
+				for (int32 X = Rect.Min.X; X < Rect.Max.X; ++X)
+				{
+					int32 SlotIndex = FindOrAddSlot(FIntPoint{ X, Y });
+
+					++Slots[SlotIndex].Num;
+
+					EntrySlots[Entry++] = SlotIndex;
+				}
+		}
+
+		for (int32 SlotIndex = 0, Start = 0; SlotIndex < Slots.Num(); ++SlotIndex)
+		{
+			Slots[SlotIndex].Start = Start;
+			Start += Slots[SlotIndex].Num;
+		}
+
+		//Scatter element IDs into their cells. Each cell has its own cursor, so threads only contend when writing to the same cell.
+		TArray<int32> Cursors;
+
+		Cursors.SetNumZeroed(Slots.Num());
+
+		ElementIDs.SetNumUninitialized(NumEntries);
+
+		ParallelFor(MaxElementID, [&](int32 ElementID)
+		{
+			for (int32 Entry = EntryOffsets[ElementID]; Entry < EntryOffsets[ElementID + 1]; ++Entry)
+			{
+				const auto& Slot = Slots[EntrySlots[Entry]];
+
+				int32 Index = FPlatformAtomics::InterlockedIncrement(&Cursors[EntrySlots[Entry]]) - 1;
+
+				ElementIDs[Slot.Start + Index] = ElementID;
+			}
+		});
+
+		ParallelFor(Slots.Num(), [&](int32 SlotIndex)
+		{
+			const auto& Slot = Slots[SlotIndex];
+
+			if (Slot.Num > 1)
+			{
+				auto CellElementIDs = MakeArrayView(ElementIDs.GetData() + Slot.Start, Slot.Num);
+
+				Algo::Sort(CellElementIDs);
+			}
+		});
+	}
+
+protected:
+
+	struct FSlot
+	{
+		FIntPoint Key{ 0, 0 };
+
+		//Offset of this cells element IDs
+		int32 Start = INDEX_NONE;
+
+		//Number of element IDs in the cell, or 0 if the slot is unused
+		int32 Num = 0;
+
+		bool IsUsed() const { return Num > 0; }
+	};
+
+	//Power of two sized table of cells
+	TArray<FSlot> Slots;
+
+	int32 NumUsedSlots = 0;
+
+	FSpatialHashMapOccupiedBounds OccupiedBounds;
+
+	//Element IDs of every cell, stored contiguously per cell
+	TArray<int32> ElementIDs;
+
+	//Only used while building. Table is sized so that it is never more than half full.
+	int32 FindOrAddSlot(FIntPoint Cell)
+	{
+		const int32 Mask = Slots.Num() - 1;
+
+		int32 SlotIndex = FSpatialHashMapFlatCells::HashCell(Cell) & Mask;
+
+		for (; Slots[SlotIndex].IsUsed(); SlotIndex = (SlotIndex + 1) & Mask)
+			if (Slots[SlotIndex].Key == Cell)
+				return SlotIndex;
+
+		Slots[SlotIndex].Key = Cell;
+
+		++NumUsedSlots;
+
+		return SlotIndex;
+	}
+};
+
+//Shared by all cell storage policies, so elements can be copied between maps and snapshots
+template <typename GeometryType, typename ValueType>
+struct TSpatialHashMapElement
+{
+	GeometryType Geometry{ ForceInit };
+	ValueType Value;
+};
+
+//Base data for spatial hash maps
+//CellsType is the cell storage policy, e.g. FSpatialHashMapSparseCells, FSpatialHashMapFlatCells, FSpatialHashMapDenseCells or FSpatialHashMapFrozenCells
+template <typename InGeometryType, typename InValueType, typename InCellsType>
+struct TSpatialHashMapBase
+{
+	using GeometryType = InGeometryType;
+	using ValueType = InValueType;
+	using CellsType = InCellsType;
+	using FElement = TSpatialHashMapElement<InGeometryType, InValueType>;
+
+protected:
+
+	FVector2D Origin;
+	FVector2D CellSize;
+	FVector2D InvCellSize;
+
+	CellsType Cells;
+
+	TSparseArray<FElement> Elements;
+
+public:
+
+	TSpatialHashMapBase()
+	{
+		SetTransform(FVector2D::Zero(), FVector2D{ 500.0, 500.0 });
+	}
+
+	const auto& GetCells() const { return Cells; }
+
+	const auto& GetElements() const { return Elements; }
+
+	void SetTransform(FVector2D InOrigin, FVector2D InCellSize)
+	{
+		//modify transform on non-empty map is not supported
+		Empty();
+
+		Origin = InOrigin;
+		CellSize = InCellSize;
+		InvCellSize = { 1.0 / CellSize.X, 1.0 / CellSize.Y };
+	}
+
+	const FVector2D& GetOrigin() const { return Origin; }
+	const FVector2D& GetCellSize() const { return CellSize; }
+	const FVector2D& GetInvCellSize() const { return InvCellSize; }
+
+	FVector2D WorldToLocal(const FVector2D& Position) const
+	{
+		return (Position - Origin) * InvCellSize;
+	}
+
+	FBox2D WorldToLocal(const FBox2D& Box) const
+	{
+		return FBox2d{ WorldToLocal(Box.Min), WorldToLocal(Box.Max) };
+	}
+
+	FVector2D LocalToWorld(const FVector2D& Position) const
+	{
+		return Position * CellSize + Origin;
+	}
+
+	FBox2D LocalToWorld(const FBox2D& Box) const
+	{
+		return FBox2D{ LocalToWorld(Box.Min), LocalToWorld(Box.Max) };
+	}
+
+	//Bounded cell policies clamp the cell here, so queries and element cells always agree
+	FIntPoint GetCellGeometry(const FVector2D& LocalPosition) const
+	{
+		return Cells.ClampCell(FIntPoint{ FMath::FloorToInt32(LocalPosition.X), FMath::FloorToInt32(LocalPosition.Y) });
+	}
+
+	FIntRect GetCellGeometry(const FBox2D& LocalBox) const
+	{
+		return FIntRect{ GetCellGeometry(LocalBox.Min), GetCellGeometry(LocalBox.Max) + 1 };
+	}
+
+	FElement& GetElement(int32 ElementID)
+	{
+		return Elements[ElementID];
+	}
+
+	const FElement& GetElement(int32 ElementID) const
+	{
+		return Elements[ElementID];
+	}
+
+	ValueType& GetValue(int32 ElementID)
+	{
+		return Elements[ElementID].Value;
+	}
+
+	const ValueType& GetValue(int32 ElementID) const
+	{
+		return Elements[ElementID].Value;
+	}
+
+	const GeometryType& GetGeometry(int32 ElementID) const
+	{
+		return Elements[ElementID].Geometry;
+	}
+
+	FSpatialHashMapStats GetStats() const
+	{
+		FSpatialHashMapStats Stats;
+
+		Stats.NumElements = Elements.Num();
+
+		Cells.ForEachCell([&](FIntPoint Cell, int32 NumElementIDs) { Stats.AddCell(NumElementIDs); });
+
+		return Stats;
+	}
+
+	void Empty()
+	{
+		Elements.Empty();
+		Cells.Empty();
+	}
+};
+
+//Maps a geometry to the cells that it should appear in
+template <typename InGeometryType, typename InValueType, typename InCellsType>
+struct TSpatialHashMapGeometryType : public TSpatialHashMapBase<InGeometryType, InValueType, InCellsType>
+{
+protected:
+
+	//void AddElementID(const GeometryType& Geometry, int32 ElementID);
+
+	//void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking);
+
+};
+
+template <typename InValueType, typename InCellsType>
+struct TSpatialHashMapGeometryType<FVector2D, InValueType, InCellsType> : public TSpatialHashMapBase<FVector2D, InValueType, InCellsType>
+{
+	using Super = TSpatialHashMapBase<FVector2D, InValueType, InCellsType>;
+	using Super::GetCellGeometry;
+	using typename Super::GeometryType;
+
+	//True if MoveElementIDs would group a batch with this many cell changes by cell, rather than moving the elements one at a time
+	bool ShouldBatchCellChanges(int32 NumCellChanges) const
+	{
+		return NumCellChanges >= MinBatchedCellChanges && Elements.Num() >= Cells.Num() * MinBatchedCellOccupancy;
+	}
+
+protected:
+
+	using Super::Cells;
+	using Super::Elements;
+
+	void AddElementID(const GeometryType& Geometry, int32 ElementID)
+	{
+		InternalAddElementID(GetCellGeometry(Geometry), ElementID);
+	}
+
+	//Returns true if the element changed cell
+	bool MoveElementID(const GeometryType& OldGeometry, const GeometryType& NewGeometry, int32 ElementID, bool bAllowShrinking)
+	{
+		auto OldPoint = GetCellGeometry(OldGeometry);
+		auto NewPoint = GetCellGeometry(NewGeometry);
+
+		if (OldPoint == NewPoint)
+			//Same cell, do not need to do anything
+			return false;
+
+		InternalRemoveElementID(OldPoint, ElementID, bAllowShrinking);
+		InternalAddElementID(NewPoint, ElementID);
+
+		return true;
+	}
+
+	void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking)
+	{
+		InternalRemoveElementID(GetCellGeometry(Geometry), ElementID, bAllowShrinking);
+	}
+
+	//Below this many cell changes, moving elements one at a time is cheaper than grouping them by cell
+	static constexpr int32 MinBatchedCellChanges = 32;
+
+	//Grouping by cell only pays off once cells are crowded, otherwise removing from a cell is already cheap
+	static constexpr int32 MinBatchedCellOccupancy = 8;
+
+	//Moves many elements at once and updates their geometry. Returns the number of valid element IDs.
+	//When enough elements change cell, the leaving and arriving element IDs are grouped by cell with a sort,
+	//so each affected cell is visited once instead of doing a remove and add per element.
+	int32 MoveElementIDs(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewGeometries)
+	{
+		check(ElementIDs.Num() == NewGeometries.Num());
+
+		MoveBatch.IDs.Reset();
+		MoveBatch.OldCells.Reset();
+		MoveBatch.NewCells.Reset();
+
+		int32 NumValid = 0;
+
+		for (int32 Index = 0; Index < ElementIDs.Num(); ++Index)
+		{
+			int32 ElementID = ElementIDs[Index];
+
+			if (!Elements.IsValidIndex(ElementID))
+				continue;
+
+			++NumValid;
+
+			auto& Element = Elements[ElementID];
+
+			auto OldPoint = GetCellGeometry(Element.Geometry);
+			auto NewPoint = GetCellGeometry(NewGeometries[Index]);
+
+			Element.Geometry = NewGeometries[Index];
+
+			if (OldPoint == NewPoint)
+				//Same cell, do not need to do anything
+				continue;
+
+			MoveBatch.IDs.Add(ElementID);
+			MoveBatch.OldCells.Add(OldPoint);
+			MoveBatch.NewCells.Add(NewPoint);
+		}
+
+		INC_DWORD_STAT_BY(STAT_SpatialHashMoves, MoveBatch.IDs.Num());
+
+		//Batched moves are expected to happen every frame, so never shrink cells
+		if (!ShouldBatchCellChanges(MoveBatch.IDs.Num()))
+		{
+			for (int32 Index = 0; Index < MoveBatch.IDs.Num(); ++Index)
+			{
+				InternalRemoveElementID(MoveBatch.OldCells[Index], MoveBatch.IDs[Index], false);
+				InternalAddElementID(MoveBatch.NewCells[Index], MoveBatch.IDs[Index]);
+			}
+
+			return NumValid;
+		}
+
+		//Marked is kept all false between batches, so only the moved bits need touching
+		if (MoveBatch.Marked.Num() < Elements.GetMaxIndex())
+			MoveBatch.Marked.SetNum(Elements.GetMaxIndex(), false);
+
+		for (int32 ElementID : MoveBatch.IDs)
+		{
+			//Element IDs must be unique, otherwise the old cells would be wrong
+			checkSlow(!MoveBatch.Marked[ElementID]);
+			MoveBatch.Marked[ElementID] = true;
+		}
+
+		//Every marked element is in its old cell, so remove them from each old cell in a single pass
+		SortMoveBatchByCell(MoveBatch.OldCells);
+
+		for (int32 Start = 0, End = 0; Start < MoveBatch.SortedCells.Num(); Start = End)
+		{
+			End = FindCellRunEnd(Start);
+
+			Cells.RemoveMarked(MoveBatch.SortedCells[Start], MoveBatch.Marked, false);
+		}
+
+		for (int32 ElementID : MoveBatch.IDs)
+			MoveBatch.Marked[ElementID] = false;
+
+		//Then append the arriving element IDs, which are contiguous per cell after sorting
+		SortMoveBatchByCell(MoveBatch.NewCells);
+
+		for (int32 Start = 0, End = 0; Start < MoveBatch.SortedCells.Num(); Start = End)
+		{
+			End = FindCellRunEnd(Start);
+
+			Cells.Append(MoveBatch.SortedCells[Start], MakeArrayView(MoveBatch.SortedIDs.GetData() + Start, End - Start));
+		}
+
+		return NumValid;
+	}
+
+protected:
+
+	void InternalAddElementID(const FIntPoint& Point, int32 ElementID)
+	{
+		Cells.Add(Point, ElementID);
+	}
+
+	void InternalRemoveElementID(const FIntPoint& Point, int32 ElementID, bool bAllowShrinking)
+	{
+		Cells.Remove(Point, ElementID, bAllowShrinking);
+	}
+
+	//Scratch memory for batched moves, kept around so that they do not allocate once warmed up
+	struct FMoveBatch
+	{
+		TArray<int32> IDs;
+		TArray<FIntPoint> OldCells;
+		TArray<FIntPoint> NewCells;
+
+		//IDs and their cells, grouped by cell
+		TArray<int32> SortedIDs;
+		TArray<FIntPoint> SortedCells;
+
+		TArray<int32> Counts;
+		TArray<int32> Order;
+
+		//Indexed by element ID
+		TBitArray<> Marked;
+	};
+
+	FMoveBatch MoveBatch;
+
+	//Groups the batch IDs by the given cells into SortedIDs and SortedCells
+	void SortMoveBatchByCell(const TArray<FIntPoint>& BatchCells)
+	{
+		const int32 Num = BatchCells.Num();
+
+		MoveBatch.SortedIDs.SetNumUninitialized(Num, false);
+		MoveBatch.SortedCells.SetNumUninitialized(Num, false);
+
+		FIntPoint Min = BatchCells[0];
+		FIntPoint Max = BatchCells[0];
+
+		for (auto& Cell : BatchCells)
+		{
+			Min = Min.ComponentMin(Cell);
+			Max = Max.ComponentMax(Cell);
+		}
+
+		const int64 Width = (int64)Max.X - Min.X + 1;
+		const int64 NumKeys = Width * ((int64)Max.Y - Min.Y + 1);
+
+		if (NumKeys <= (int64)Num * 4)
+		{
+			//Moved cells are tightly packed, which is the usual case with lots of units in a level, so use a counting sort
+			auto GetKey = [&](FIntPoint Cell) { return (int32)((Cell.X - Min.X) + (Cell.Y - Min.Y) * Width); };
+
+			MoveBatch.Counts.Reset();
+			MoveBatch.Counts.AddZeroed((int32)NumKeys + 1);
+
+			for (auto& Cell : BatchCells)
+				++MoveBatch.Counts[GetKey(Cell) + 1];
+
+			for (int32 Key = 1; Key <= NumKeys; ++Key)
+				MoveBatch.Counts[Key] += MoveBatch.Counts[Key - 1];
+
+			for (int32 Index = 0; Index < Num; ++Index)
+			{
+				int32 SortedIndex = MoveBatch.Counts[GetKey(BatchCells[Index])]++;
+
+				MoveBatch.SortedIDs[SortedIndex] = MoveBatch.IDs[Index];
+				MoveBatch.SortedCells[SortedIndex] = BatchCells[Index];
+			}
+
+			return;
+		}
+
+		//Cells are too spread out for a counting sort
+		MoveBatch.Order.SetNumUninitialized(Num, false);
+
+		for (int32 Index = 0; Index < Num; ++Index)
+			MoveBatch.Order[Index] = Index;
+
+		Algo::Sort(MoveBatch.Order, [&](int32 A, int32 B)
+		{
+			return BatchCells[A].Y != BatchCells[B].Y ? BatchCells[A].Y < BatchCells[B].Y : BatchCells[A].X < BatchCells[B].X;
+		});
+
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			MoveBatch.SortedIDs[Index] = MoveBatch.IDs[MoveBatch.Order[Index]];
+			MoveBatch.SortedCells[Index] = BatchCells[MoveBatch.Order[Index]];
+		}
+	}
+
+	//End of the run of equal cells in SortedCells that starts at Start
+	int32 FindCellRunEnd(int32 Start) const
+	{
+		int32 End = Start + 1;
+
+		while (End < MoveBatch.SortedCells.Num() && MoveBatch.SortedCells[End] == MoveBatch.SortedCells[Start])
+			++End;
+
+		return End;
+	}
+
+
+};
+
+template <typename InValueType, typename InCellsType>
+struct TSpatialHashMapGeometryType<FBox2D, InValueType, InCellsType> : public TSpatialHashMapBase<FBox2D, InValueType, InCellsType>
+{
+	using Super = TSpatialHashMapBase<FBox2D, InValueType, InCellsType>;
+	using Super::GetCellGeometry;
+	using typename Super::GeometryType;
+
+protected:
+
+	using Super::Cells;
+	using Super::Elements;
+
+	void AddElementID(const GeometryType& Geometry, int32 ElementID)
+	{
+		InternalAddElementID(GetCellGeometry(Geometry), ElementID);
+	}
+
+	//Returns true if the element changed cells
+	bool MoveElementID(const GeometryType& OldGeometry, const GeometryType& NewGeometry, int32 ElementID, bool bAllowShrinking)
+	{
+		auto OldBox = GetCellGeometry(OldGeometry);
+		auto NewBox = GetCellGeometry(NewGeometry);
+
+		if (OldBox == NewBox)
+			//Could possibly be optimised further by doing a set intersection of covered cells instead of simple equality
+			return false;
+
+		InternalRemoveElementID(OldBox, ElementID, bAllowShrinking);
+		InternalAddElementID(NewBox, ElementID);
+
+		return true;
+	}
+
+	void RemoveElementID(const GeometryType& Geometry, int32 ElementID, bool bAllowShrinking)
+	{
+		InternalRemoveElementID(GetCellGeometry(Geometry), ElementID, bAllowShrinking);
+	}
+
+	//Moves many elements at once and updates their geometry. Returns the number of valid element IDs.
+	//Boxes are not grouped by cell, since they can cover many cells, so this just moves them one at a time.
+	int32 MoveElementIDs(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewGeometries)
+	{
+		check(ElementIDs.Num() == NewGeometries.Num());
+
+		int32 NumValid = 0;
+
+		for (int32 Index = 0; Index < ElementIDs.Num(); ++Index)
+		{
+			if (!Elements.IsValidIndex(ElementIDs[Index]))
+				continue;
+
+			++NumValid;
+
+			auto& Element = Elements[ElementIDs[Index]];
+
+			if (MoveElementID(Element.Geometry, NewGeometries[Index], ElementIDs[Index], false))
+				INC_DWORD_STAT(STAT_SpatialHashMoves);
+
+			Element.Geometry = NewGeometries[Index];
+		}
+
+		return NumValid;
+	}
+
+protected:
+
+	void InternalAddElementID(const FIntRect& Box, int32 ElementID)
+	{
+		for (int32 Y = Box.Min.Y; Y < Box.Max.Y; ++Y)
+			for (int32 X = Box.Min.X; X < Box.Max.X; ++X)
+				Cells.Add(FIntPoint{ X,Y }, ElementID);
+	}
+
+	void InternalRemoveElementID(const FIntRect& Box, int32 ElementID, bool bAllowShrinking)
+	{
+		for (int32 Y = Box.Min.Y; Y < Box.Max.Y; ++Y)
+			for (int32 X = Box.Min.X; X < Box.Max.X; ++X)
+				Cells.Remove(FIntPoint{ X,Y }, ElementID, bAllowShrinking);
+	}
+};
+
+
+//UE style iterator
+//Each element is reported exactly once, even if it is a box that was inserted into several of the cells being queried.
+//Duplicates are rejected with the "reference cell" trick: a box is only reported from the first of its cells that lies inside the query,
+//so no per query visited set or epoch stamp needs to be allocated or cleared.
+template <typename MapType>
+struct TSpatialHashMapBoxQuery
+{
+	template <typename T>
+	using ChooseConstType = typename TChooseClass<TIsConst<MapType>::Value, const T, T>::Result;
+
+	using IteratorMapType = MapType;
+
+	using IteratorCellIteratorType = typename MapType::CellsType::FCellIterator;
+
+	using IteratorElementType = ChooseConstType<typename MapType::FElement>;
+
+	using IteratorValueType = ChooseConstType<typename MapType::ValueType>;
+
+	using IteratorGeometryType = typename MapType::GeometryType;
+
+	TSpatialHashMapBoxQuery(IteratorMapType& InMap, const FBox2D& InQueryBox) : Map(InMap), QueryBox(InQueryBox), QueryCellBox(InMap.GetCellGeometry(InQueryBox))
+	{
+		//Start one to the left so that Advance() will advance to the first valid element
+		CurrentCell.X = QueryCellBox.Min.X - 1;
+		CurrentCell.Y = QueryCellBox.Min.Y;
+
+		Advance();
+	};
+
+	~TSpatialHashMapBoxQuery()
+	{
+		SpatialHashMapUtils::RecordQueryStats(NumVisitedCellEntries, NumAcceptedElements);
+	}
+
+	operator bool() const
+	{
+		return CurrentCell.X < QueryCellBox.Max.X && CurrentCell.Y < QueryCellBox.Max.Y;
+	}
+
+	TSpatialHashMapBoxQuery& operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	IteratorValueType& operator*() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Value;
+	}
+
+	IteratorValueType* operator->() const
+	{
+		check(CurrentElement);
+		return &CurrentElement->Value;
+	}
+
+	const IteratorGeometryType& GetLocalGeometry() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Geometry;
+	}
+
+	IteratorGeometryType GetWorldGeometry() const
+	{
+		return Map.LocalToWorld(GetLocalGeometry());
+	}
+
+	//Number of cell entries this query has walked so far, including the ones rejected as duplicates or as not overlapping the query.
+	//Compare against the number of elements reported to see how much duplicate work the deduplication is saving.
+	int32 GetNumVisitedCellEntries() const { return NumVisitedCellEntries; }
+
+	//Number of cells of the query that the given box element was inserted into, ie. how many times a non deduplicating query would have reported it.
+	int32 GetNumCellsOverlapping(const FBox2D& LocalBox) const
+	{
+		FIntRect Overlap = Map.GetCellGeometry(LocalBox);
+
+		Overlap.Clip(QueryCellBox);
+
+		return FMath::Max(Overlap.Area(), 1);
+	}
+
+protected:
+
+	IteratorMapType& Map;
+
+	FBox2D QueryBox;
+
+	FIntRect QueryCellBox;
+
+	int32 NumVisitedCellEntries = 0;
+
+	int32 NumAcceptedElements = 0;
+
+	FIntPoint CurrentCell;
+
+	IteratorElementType* CurrentElement = nullptr;
+
+	//Remaining element IDs of the current cell
+	IteratorCellIteratorType CellIterator;
+
+	//Technically these overloads should be specialized template structs to allow further extension
+	bool ShouldVisitElement(const FBox2D& Box) const
+	{
+		//Since the map is flat, box elements can appear in multiple cells, so we only actually visit it once when we hit the elements minimum cell that is within the query.
+		//We are guaranteed to hit the minimum cell of an element first.
+		FIntPoint MinCell = Map.GetCellGeometry(Box.Min).ComponentMax(QueryCellBox.Min);
+
+		return CurrentCell == MinCell && Box.Intersect(QueryBox);
+	}
+
+	bool ShouldVisitElement(const FVector2D& Point) const
+	{
+		//Point type can only ever appear in one cell
+		return QueryBox.IsInside(Point);
+	}
+
+	void Advance()
+	{
+		while (true)
+		{
+			CurrentElement = nullptr;
+
+			//First try advance through the remaining elements in the current cell, if any
+			while (CellIterator)
+			{
+				auto& Element = Map.GetElement(*CellIterator);
+
+				++CellIterator;
+
+				++NumVisitedCellEntries;
+
+				if (ShouldVisitElement(Element.Geometry))
+				{
+					//Found an overlapping element, stop advancing
+					CurrentElement = &Element;
+					++NumAcceptedElements;
+					return;
+				}
+
+				//Element does not overlap or is already visited, go to the next one in the cell
+			}
+
+			//Moving on to new cell
+			CurrentCell.X++;
+
+			if (CurrentCell.X >= QueryCellBox.Max.X)
+			{
+				CurrentCell.Y++;
+
+				if (CurrentCell.Y >= QueryCellBox.Max.Y)
+					//Reached end of rect
+					return;
+
+				CurrentCell.X = QueryCellBox.Min.X;
+			}
+
+			//Initialize element iteration in new current cell.
+			CellIterator = Map.GetCells().CreateCellIterator(CurrentCell);
+		}
+	}
+
+};
+
+
+namespace SpatialHashMapUtils
+{
+	//Slab test of the segment starting at From, where InvDirection is the reciprocal of (To - From), or zero on axes the segment does not move along
+	inline bool SegmentIntersectsBox(const FVector2D& From, const FVector2D& InvDirection, const FBox2D& Box)
+	{
+		double TMin = 0.0;
+		double TMax = 1.0;
+
+		for (int32 Axis = 0; Axis < 2; ++Axis)
+		{
+			if (InvDirection[Axis] == 0.0)
+			{
+				if (From[Axis] < Box.Min[Axis] || From[Axis] > Box.Max[Axis])
+					return false;
+
+				continue;
+			}
+
+			double T0 = (Box.Min[Axis] - From[Axis]) * InvDirection[Axis];
+			double T1 = (Box.Max[Axis] - From[Axis]) * InvDirection[Axis];
+
+			TMin = FMath::Max(TMin, FMath::Min(T0, T1));
+			TMax = FMath::Min(TMax, FMath::Max(T0, T1));
+
+			if (TMin > TMax)
+				return false;
+		}
+
+		return true;
+	}
+}
+
+//UE style iterator that walks the cells crossed by a line segment in order, using a grid DDA.
+//Elements are visited roughly in order along the segment, so stopping at the first hit is cheap,
+//and the cost scales with the length of the segment instead of the area of its bounding box.
+template <typename MapType>
+struct TSpatialHashMapSegmentQuery
+{
+	template <typename T>
+	using ChooseConstType = typename TChooseClass<TIsConst<MapType>::Value, const T, T>::Result;
+
+	using IteratorMapType = MapType;
+
+	using IteratorCellIteratorType = typename MapType::CellsType::FCellIterator;
+
+	using IteratorElementType = ChooseConstType<typename MapType::FElement>;
+
+	using IteratorValueType = ChooseConstType<typename MapType::ValueType>;
+
+	using IteratorGeometryType = typename MapType::GeometryType;
+
+	TSpatialHashMapSegmentQuery(IteratorMapType& InMap, const FVector2D& InFrom, const FVector2D& InTo) : Map(InMap), From(InFrom), To(InTo)
+	{
+		FVector2D Direction = To - From;
+
+		Cell = FIntPoint{ FMath::FloorToInt32(From.X), FMath::FloorToInt32(From.Y) };
+		EndCell = FIntPoint{ FMath::FloorToInt32(To.X), FMath::FloorToInt32(To.Y) };
+
+		Step = FIntPoint{ Direction.X >= 0.0 ? 1 : -1, Direction.Y >= 0.0 ? 1 : -1 };
+
+		//Distance along the segment (0 -> 1) between cell boundaries, and to the first boundary on each axis
+		TDelta.X = Direction.X != 0.0 ? FMath::Abs(1.0 / Direction.X) : UE_DOUBLE_BIG_NUMBER;
+		TDelta.Y = Direction.Y != 0.0 ? FMath::Abs(1.0 / Direction.Y) : UE_DOUBLE_BIG_NUMBER;
+
+		TMax.X = Direction.X != 0.0 ? ((Step.X > 0 ? Cell.X + 1.0 - From.X : From.X - Cell.X) * TDelta.X) : UE_DOUBLE_BIG_NUMBER;
+		TMax.Y = Direction.Y != 0.0 ? ((Step.Y > 0 ? Cell.Y + 1.0 - From.Y : From.Y - Cell.Y) * TDelta.Y) : UE_DOUBLE_BIG_NUMBER;
+
+		InvDirection.X = Direction.X != 0.0 ? 1.0 / Direction.X : 0.0;
+		InvDirection.Y = Direction.Y != 0.0 ? 1.0 / Direction.Y : 0.0;
+
+		CurrentCell = Map.GetCellGeometry(From);
+
+		CellIterator = Map.GetCells().CreateCellIterator(CurrentCell);
+
+		Advance();
+	}
+
+	~TSpatialHashMapSegmentQuery()
+	{
+		SpatialHashMapUtils::RecordQueryStats(NumVisitedCellEntries, NumAcceptedElements);
+	}
+
+	operator bool() const
+	{
+		return CurrentElement != nullptr;
+	}
+
+	TSpatialHashMapSegmentQuery& operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	IteratorValueType& operator*() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Value;
+	}
+
+	IteratorValueType* operator->() const
+	{
+		check(CurrentElement);
+		return &CurrentElement->Value;
+	}
+
+	const IteratorGeometryType& GetLocalGeometry() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Geometry;
+	}
+
+	IteratorGeometryType GetWorldGeometry() const
+	{
+		return Map.LocalToWorld(GetLocalGeometry());
+	}
+
+protected:
+
+	IteratorMapType& Map;
+
+	FVector2D From;
+
+	FVector2D To;
+
+	FVector2D InvDirection;
+
+	//Unclamped DDA state
+	FIntPoint Cell;
+	FIntPoint EndCell;
+	FIntPoint Step;
+	FVector2D TMax;
+	FVector2D TDelta;
+
+	//Cell being iterated, and the one before it, as clamped by the map
+	FIntPoint CurrentCell;
+	FIntPoint PreviousCell;
+	bool bHasPreviousCell = false;
+
+	IteratorElementType* CurrentElement = nullptr;
+
+	int32 NumVisitedCellEntries = 0;
+
+	int32 NumAcceptedElements = 0;
+
+	//Remaining element IDs of the current cell
+	IteratorCellIteratorType CellIterator;
+
+	bool ShouldVisitElement(const FBox2D& Box) const
+	{
+		//Cells along the segment that are covered by a box are always consecutive, so the box was already visited if it also covers the previous cell
+		if (bHasPreviousCell && Map.GetCellGeometry(Box).Contains(PreviousCell))
+			return false;
+
+		return SpatialHashMapUtils::SegmentIntersectsBox(From, InvDirection, Box);
+	}
+
+	bool ShouldVisitElement(const FVector2D& Point) const
+	{
+		//Points have no area and can only appear in one cell, so report every point in each crossed cell
+		return true;
+	}
+
+	//Steps the DDA to the next cell. Returns false once the end cell has been passed.
+	bool StepCell()
+	{
+		if (Cell == EndCell)
+			return false;
+
+		//Always head towards the end cell, so that floating point error can never make the walk overshoot
+		bool bStepX = Cell.Y == EndCell.Y || (Cell.X != EndCell.X && TMax.X < TMax.Y);
+
+		if (bStepX)
+		{
+			Cell.X += Step.X;
+			TMax.X += TDelta.X;
+		}
+		else
+		{
+			Cell.Y += Step.Y;
+			TMax.Y += TDelta.Y;
+		}
+
+		return true;
+	}
+
+	void Advance()
+	{
+		while (true)
+		{
+			CurrentElement = nullptr;
+
+			while (CellIterator)
+			{
+				auto& Element = Map.GetElement(*CellIterator);
+
+				++CellIterator;
+
+				++NumVisitedCellEntries;
+
+				if (ShouldVisitElement(Element.Geometry))
+				{
+					CurrentElement = &Element;
+					++NumAcceptedElements;
+					return;
+				}
+			}
+
+			//Bounded maps clamp cells, so several DDA cells can map to the same map cell. Only iterate each one once.
+			FIntPoint NextCell = CurrentCell;
+
+			while (NextCell == CurrentCell)
+			{
+				if (!StepCell())
+					return;
+
+				NextCell = Map.GetCells().ClampCell(Cell);
+			}
+
+			PreviousCell = CurrentCell;
+			bHasPreviousCell = true;
+
+			CurrentCell = NextCell;
+
+			CellIterator = Map.GetCells().CreateCellIterator(CurrentCell);
+		}
+	}
+};
+
+namespace SpatialHashMapUtils
+{
+	inline double DistanceSquared(const FVector2D& Point, const FVector2D& Center)
+	{
+		return FVector2D::DistSquared(Point, Center);
+	}
+
+	inline double DistanceSquared(const FBox2D& Box, const FVector2D& Center)
+	{
+		return Box.ComputeSquaredDistanceToPoint(Center);
+	}
+
+	//Boxes can be in many cells, so nearest queries only visit them in the cell of their cell rect that is closest to the center cell, which is always reached first
+	template <typename MapType>
+	bool ShouldVisitNearestElement(const MapType& Map, const FBox2D& Box, FIntPoint Cell, FIntPoint CenterCell)
+	{
+		FIntRect Rect = Map.GetCellGeometry(Box);
+
+		return Cell == CenterCell.ComponentMax(Rect.Min).ComponentMin(Rect.Max - 1);
+	}
+
+	template <typename MapType>
+	bool ShouldVisitNearestElement(const MapType& Map, const FVector2D& Point, FIntPoint Cell, FIntPoint CenterCell)
+	{
+		//Point type can only ever appear in one cell
+		return true;
+	}
+}
+
+//UE style iterator over the elements within a world space radius. A box query over the bounds of the circle, with elements outside of the circle skipped.
+//Distances are measured in world space, since cells do not have to be square.
+template <typename MapType, typename BoxQueryType = TSpatialHashMapBoxQuery<MapType>>
+struct TSpatialHashMapRadiusQuery
+{
+	using IteratorBoxQueryType = BoxQueryType;
+
+	using IteratorValueType = typename IteratorBoxQueryType::IteratorValueType;
+
+	using IteratorGeometryType = typename IteratorBoxQueryType::IteratorGeometryType;
+
+	TSpatialHashMapRadiusQuery(MapType& InMap, const FVector2D& InWorldCenter, double InWorldRadius) : 
+		BoxQuery(InMap, InMap.WorldToLocal(FBox2D{ InWorldCenter - InWorldRadius, InWorldCenter + InWorldRadius })), 
+		WorldCenter(InWorldCenter), 
+		WorldRadiusSquared(FMath::Square(InWorldRadius))
+	{
+		SkipOutsideRadius();
+	}
+
+	operator bool() const
+	{
+		return (bool)BoxQuery;
+	}
+
+	TSpatialHashMapRadiusQuery& operator++()
+	{
+		++BoxQuery;
+		SkipOutsideRadius();
+		return *this;
+	}
+
+	IteratorValueType& operator*() const
+	{
+		return *BoxQuery;
+	}
+
+	IteratorValueType* operator->() const
+	{
+		return &*BoxQuery;
+	}
+
+	const IteratorGeometryType& GetLocalGeometry() const
+	{
+		return BoxQuery.GetLocalGeometry();
+	}
+
+	IteratorGeometryType GetWorldGeometry() const
+	{
+		return BoxQuery.GetWorldGeometry();
+	}
+
+	//World space squared distance from the center to the current element
+	double GetDistanceSquared() const
+	{
+		return SpatialHashMapUtils::DistanceSquared(GetWorldGeometry(), WorldCenter);
+	}
+
+protected:
+
+	IteratorBoxQueryType BoxQuery;
+
+	FVector2D WorldCenter;
+
+	double WorldRadiusSquared;
+
+	void SkipOutsideRadius()
+	{
+		while (BoxQuery && GetDistanceSquared() > WorldRadiusSquared)
+			++BoxQuery;
+	}
+};
+
+struct FSpatialHashMapNearestElement
+{
+	int32 ElementID;
+
+	//World space
+	double DistanceSquared;
+};
+
+namespace SpatialHashMapUtils
+{
+	//Finds the K elements closest to a world space center, within MaxRadius, that pass the filter, nearest first.
+	//Rings of cells are expanded outward from the center cell, keeping the best K found so far in a bounded max heap,
+	//and the search stops as soon as the next ring cannot contain anything closer than the worst of them.
+	template <typename MapType, typename FilterFuncType>
+	int32 NearestK(const MapType& Map, const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest, FilterFuncType&& Filter)
+	{
+		OutNearest.Reset();
+
+		if (K <= 0 || MaxRadius < 0.0)
+			return 0;
+
+		//The max heap is kept in OutNearest, with the furthest of the best K at the top
+		auto FurthestFirst = [](const FSpatialHashMapNearestElement& A, const FSpatialHashMapNearestElement& B) { return A.DistanceSquared > B.DistanceSquared; };
+
+		const auto& Cells = Map.GetCells();
+
+		const FVector2D LocalCenter = Map.WorldToLocal(WorldCenter);
+
+		const FIntPoint CenterCell = Map.GetCellGeometry(LocalCenter);
+
+		const double MaxRadiusSquared = FMath::Square(MaxRadius);
+
+		const auto& OccupiedBounds = Cells.GetOccupiedBounds();
+
+		if (OccupiedBounds.IsEmpty())
+			return 0;
+
+		//Rings past this one are entirely outside of every cell that has held an element, so there is nothing left to find in them
+		const int32 MaxUsefulRing = FMath::Max(
+			FMath::Max(CenterCell.X - OccupiedBounds.Rect.Min.X, OccupiedBounds.Rect.Max.X - 1 - CenterCell.X),
+			FMath::Max(CenterCell.Y - OccupiedBounds.Rect.Min.Y, OccupiedBounds.Rect.Max.Y - 1 - CenterCell.Y));
+
+		int32 NumVisited = 0;
+
+		//World space squared distance from the center to the area covered by a cell.
+		//Border cells of bounded maps also hold everything clamped into them, so they extend out to infinity.
+		auto GetCellDistanceSquared = [&](FIntPoint Cell)
+		{
+			double MinX = Cells.ClampCell(Cell - FIntPoint{ 1, 0 }) == Cell ? -UE_DOUBLE_BIG_NUMBER : Cell.X;
+			double MaxX = Cells.ClampCell(Cell + FIntPoint{ 1, 0 }) == Cell ? UE_DOUBLE_BIG_NUMBER : Cell.X + 1.0;
+			double MinY = Cells.ClampCell(Cell - FIntPoint{ 0, 1 }) == Cell ? -UE_DOUBLE_BIG_NUMBER : Cell.Y;
+			double MaxY = Cells.ClampCell(Cell + FIntPoint{ 0, 1 }) == Cell ? UE_DOUBLE_BIG_NUMBER : Cell.Y + 1.0;
+
+			double DX = FMath::Max3(MinX - LocalCenter.X, 0.0, LocalCenter.X - MaxX) * Map.GetCellSize().X;
+			double DY = FMath::Max3(MinY - LocalCenter.Y, 0.0, LocalCenter.Y - MaxY) * Map.GetCellSize().Y;
+
+			return DX * DX + DY * DY;
+		};
+
+		auto ForEachRingCell = [&](int32 Ring, auto&& Func)
+		{
+			if (Ring == 0)
+			{
+				Func(CenterCell);
+				return;
+			}
+
+			for (int32 X = CenterCell.X - Ring; X <= CenterCell.X + Ring; ++X)
+			{
+				Func(FIntPoint{ X, CenterCell.Y - Ring });
+				Func(FIntPoint{ X, CenterCell.Y + Ring });
+			}
+
+			for (int32 Y = CenterCell.Y - Ring + 1; Y < CenterCell.Y + Ring; ++Y)
+			{
+				Func(FIntPoint{ CenterCell.X - Ring, Y });
+				Func(FIntPoint{ CenterCell.X + Ring, Y });
+			}
+		};
+
+		for (int32 Ring = 0; Ring <= MaxUsefulRing; ++Ring)
+		{
+			double RingDistanceSquared = UE_DOUBLE_BIG_NUMBER;
+
+			bool bRingHasCells = false;
+
+			ForEachRingCell(Ring, [&](FIntPoint Cell)
+			{
+				//Cells outside of bounded maps do not exist, their elements are found in the border cells instead
+				if (Cells.ClampCell(Cell) != Cell)
+					return;
+
+				bRingHasCells = true;
+
+				RingDistanceSquared = FMath::Min(RingDistanceSquared, GetCellDistanceSquared(Cell));
+			});
+
+			//The center cell is always inside the map, so once a ring is fully outside every larger ring is too
+			if (!bRingHasCells)
+				break;
+
+			if (RingDistanceSquared > MaxRadiusSquared)
+				break;
+
+			if (OutNearest.Num() == K && RingDistanceSquared >= OutNearest.HeapTop().DistanceSquared)
+				break;
+
+			ForEachRingCell(Ring, [&](FIntPoint Cell)
+			{
+				if (Cells.ClampCell(Cell) != Cell)
+					return;
+
+				for (auto It = Cells.CreateCellIterator(Cell); It; ++It)
+				{
+					int32 ElementID = *It;
+
+					const auto& Element = Map.GetElement(ElementID);
+
+					++NumVisited;
+
+					if (!SpatialHashMapUtils::ShouldVisitNearestElement(Map, Element.Geometry, Cell, CenterCell))
+						continue;
+
+					double DistanceSquared = SpatialHashMapUtils::DistanceSquared(Map.LocalToWorld(Element.Geometry), WorldCenter);
+
+					if (DistanceSquared > MaxRadiusSquared)
+						continue;
+
+					if (OutNearest.Num() == K && DistanceSquared >= OutNearest.HeapTop().DistanceSquared)
+						continue;
+
+					if (!Filter(Element.Value))
+						continue;
+
+					if (OutNearest.Num() == K)
+						OutNearest.HeapPopDiscard(FurthestFirst, false);
+
+					OutNearest.HeapPush(FSpatialHashMapNearestElement{ ElementID, DistanceSquared }, FurthestFirst);
+				}
+			});
+		}
+
+		SpatialHashMapUtils::RecordQueryStats(NumVisited, OutNearest.Num());
+
+		Algo::SortBy(OutNearest, &FSpatialHashMapNearestElement::DistanceSquared);
+
+		return OutNearest.Num();
+	}
+}
+
+
+//Spatial hash map that maps a geometry to value and is spatially queryable
+//Currently only supports 2D point and box geometries.
+//The cell storage can be swapped out with InCellsType, e.g. FSpatialHashMapFlatCells for maps with a lot of element churn.
+template <typename InGeometryType, typename InValueType, typename InCellsType = FSpatialHashMapSparseCells>
+struct TSpatialHashMap : TSpatialHashMapGeometryType<InGeometryType, InValueType, InCellsType>
+{
+	using Super = TSpatialHashMapGeometryType<InGeometryType, InValueType, InCellsType>;
+	using Super::WorldToLocal;
+	using Super::LocalToWorld;
+	using Super::GetCellGeometry;
+	using typename Super::GeometryType;
+	using typename Super::ValueType;
+	using typename Super::FElement;
+	using Super::GetElement;
+	using Super::GetValue;
+
+protected:
+
+	using Super::Elements;
+	using Super::AddElementID;
+	using Super::MoveElementID;
+	using Super::MoveElementIDs;
+	using Super::RemoveElementID;
+
+	//Scratch memory for converting batched moves to local space
+	TArray<GeometryType> LocalGeometryScratch;
+
+public:
+
+	template <typename ...ArgTypes>
+	int32 AddElementWorldSpace(const GeometryType& WorldGeometry, ArgTypes&& ... Args)
+	{
+		return AddElementLocalSpace(WorldToLocal(WorldGeometry), Forward<ArgTypes>(Args)...);
+	}
+
+	template <typename ...ArgTypes>
+	int32 AddElementLocalSpace(const GeometryType& LocalGeometry, ArgTypes&& ... Args)
+	{
+		int32 SearchIndex = 0;
+
+		auto InsertResult = Elements.EmplaceAtLowestFreeIndex(SearchIndex, FElement{ LocalGeometry, ValueType{ Forward<ArgTypes>(Args)... } });
+
+		AddElementID(LocalGeometry, InsertResult);
+
+		INC_DWORD_STAT(STAT_SpatialHashAdds);
+
+		return InsertResult;
+	}
+
+	bool MoveElementWorldSpace(int32 ElementID, const GeometryType& NewWorldGeometry)
+	{
+		return MoveElementLocalSpace(ElementID, WorldToLocal(NewWorldGeometry));
+	}
+
+	bool MoveElementLocalSpace(int32 ElementID, const GeometryType& NewLocalGeometry)
+	{
+		if (!Elements.IsValidIndex(ElementID))
+			return false;
+
+		auto& Element = Elements[ElementID];
+
+		if (Element.Geometry == NewLocalGeometry)
+			return true;
+
+		if (MoveElementID(Element.Geometry, NewLocalGeometry, ElementID, true))
+			INC_DWORD_STAT(STAT_SpatialHashMoves);
+
+		Element.Geometry = NewLocalGeometry;
+
+		return true;
+	}
+
+	//Moves many elements at once. For point elements this is much faster than moving them one at a time when lots of them change cell.
+	//Element IDs must be unique. Returns the number of element IDs that were valid.
+	int32 MoveElementsWorldSpace(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewWorldGeometries)
+	{
+		LocalGeometryScratch.Reset(NewWorldGeometries.Num());
+
+		for (auto& NewWorldGeometry : NewWorldGeometries)
+			LocalGeometryScratch.Add(WorldToLocal(NewWorldGeometry));
+
+		return MoveElementsLocalSpace(ElementIDs, LocalGeometryScratch);
+	}
+
+	int32 MoveElementsLocalSpace(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewLocalGeometries)
+	{
+		return MoveElementIDs(ElementIDs, NewLocalGeometries);
+	}
+
+	bool RemoveElement(int32 ElementID)
+	{
+		if (!Elements.IsValidIndex(ElementID))
+			return false;
+
+		RemoveElementID(Elements[ElementID].Geometry, ElementID, true);
+
+		Elements.RemoveAt(ElementID);
+
+		INC_DWORD_STAT(STAT_SpatialHashRemoves);
+
+		return true;
+	}
+
+
+	using TBoxQuery = TSpatialHashMapBoxQuery<TSpatialHashMap>;
+
+	using TConstBoxQuery = TSpatialHashMapBoxQuery<const TSpatialHashMap>;
+
+	TConstBoxQuery LocalBoxQuery(const FBox2D& LocalBox) const
+	{
+		return TConstBoxQuery{ *this, LocalBox };
+	}
+
+	TBoxQuery LocalBoxQuery(const FBox2D& LocalBox)
+	{
+		return TBoxQuery{ *this, LocalBox };
+	}
+
+	TConstBoxQuery WorldBoxQuery(const FBox2D& WorldBox) const
+	{
+		return TConstBoxQuery{ *this, WorldToLocal(WorldBox) };
+	}
+
+	TBoxQuery WorldBoxQuery(const FBox2D& WorldBox)
+	{
+		return TBoxQuery{ *this, WorldToLocal(WorldBox) };
+	}
+
+	using TSegmentQuery = TSpatialHashMapSegmentQuery<TSpatialHashMap>;
+
+	using TConstSegmentQuery = TSpatialHashMapSegmentQuery<const TSpatialHashMap>;
+
+	TConstSegmentQuery LocalSegmentQuery(const FVector2D& LocalFrom, const FVector2D& LocalTo) const
+	{
+		return TConstSegmentQuery{ *this, LocalFrom, LocalTo };
+	}
+
+	TSegmentQuery LocalSegmentQuery(const FVector2D& LocalFrom, const FVector2D& LocalTo)
+	{
+		return TSegmentQuery{ *this, LocalFrom, LocalTo };
+	}
+
+	TConstSegmentQuery WorldSegmentQuery(const FVector2D& WorldFrom, const FVector2D& WorldTo) const
+	{
+		return TConstSegmentQuery{ *this, WorldToLocal(WorldFrom), WorldToLocal(WorldTo) };
+	}
+
+	TSegmentQuery WorldSegmentQuery(const FVector2D& WorldFrom, const FVector2D& WorldTo)
+	{
+		return TSegmentQuery{ *this, WorldToLocal(WorldFrom), WorldToLocal(WorldTo) };
+	}
+
+	using TRadiusQuery = TSpatialHashMapRadiusQuery<TSpatialHashMap>;
+
+	using TConstRadiusQuery = TSpatialHashMapRadiusQuery<const TSpatialHashMap>;
+
+	TConstRadiusQuery WorldRadiusQuery(const FVector2D& WorldCenter, double WorldRadius) const
+	{
+		return TConstRadiusQuery{ *this, WorldCenter, WorldRadius };
+	}
+
+	TRadiusQuery WorldRadiusQuery(const FVector2D& WorldCenter, double WorldRadius)
+	{
+		return TRadiusQuery{ *this, WorldCenter, WorldRadius };
+	}
+
+	//Finds up to K elements closest to the world space center within MaxRadius, nearest first. Returns the number found.
+	template <typename FilterFuncType>
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest, FilterFuncType&& Filter) const
+	{
+		return SpatialHashMapUtils::NearestK(*this, WorldCenter, K, MaxRadius, OutNearest, Forward<FilterFuncType>(Filter));
+	}
+
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest) const
+	{
+		return WorldNearestK(WorldCenter, K, MaxRadius, OutNearest, [](const ValueType&) { return true; });
+	}
+
+};
+
+
+//Spatial grid map for levels with known bounds, using dense cells instead of hashing cell coordinates.
+//Geometry outside of the bounds is still supported, but piles up in the border cells.
+template <typename InGeometryType, typename InValueType>
+struct TDenseSpatialGridMap : TSpatialHashMap<InGeometryType, InValueType, FSpatialHashMapDenseCells>
+{
+	using Super = TSpatialHashMap<InGeometryType, InValueType, FSpatialHashMapDenseCells>;
+	using Super::SetTransform;
+
+protected:
+
+	using Super::Cells;
+
+public:
+
+	//Sets the world space area covered by the grid, and the size of each cell. Empties the map.
+	void SetBounds(const FBox2D& WorldBounds, FVector2D InCellSize)
+	{
+		SetTransform(WorldBounds.Min, InCellSize);
+
+		FVector2D Size = WorldBounds.GetSize();
+
+		FIntPoint NumCells{ FMath::Max(1, FMath::CeilToInt32(Size.X / InCellSize.X)), FMath::Max(1, FMath::CeilToInt32(Size.Y / InCellSize.Y)) };
+
+		Cells.SetCellBounds(FIntRect{ FIntPoint::ZeroValue, NumCells });
+	}
+
+	const FIntRect& GetCellBounds() const
+	{
+		return Cells.GetCellBounds();
+	}
+};
+
+
+//Read only copy of a spatial hash map that can be queried from any number of threads at once.
+//Element IDs match the map it was built from, or the index of each element when built from an array.
+//Building copies values on the calling thread, so values that are not thread safe to copy (like TFogOfWarSharedPtr) are fine,
+//as long as the snapshot is also released on that thread.
+template <typename InGeometryType, typename InValueType>
+struct TSpatialHashMapSnapshot : TSpatialHashMapBase<InGeometryType, InValueType, FSpatialHashMapFrozenCells>
+{
+	using Super = TSpatialHashMapBase<InGeometryType, InValueType, FSpatialHashMapFrozenCells>;
 	using Super::WorldToLocal;
-	using Super::LocalToWorld;
 	using Super::GetCellGeometry;
+	using Super::SetTransform;
 	using typename Super::GeometryType;
 	using typename Super::ValueType;
-	using Super::GetElement;
-	using Super::GetValue;
-	//using typename Super::FElement;
+	using typename Super::FElement;
+
+protected:
+
+	using Super::Cells;
+	using Super::Elements;
+
+public:
+
+	//Builds from an existing map, keeping its transform and element IDs
+	template <typename MapCellsType>
+	void Build(const TSpatialHashMap<GeometryType, ValueType, MapCellsType>& Map)
+	{
+		SetTransform(Map.GetOrigin(), Map.GetCellSize());
+
+		Elements = Map.GetElements();
+
+		BuildCells();
+	}
+
+	//Builds from world space geometry and value pairs using the current transform. Element IDs are the indices into WorldElements.
+	void BuildWorldSpace(TArray<FElement>&& WorldElements)
+	{
+		ParallelFor(WorldElements.Num(), [&](int32 Index)
+		{
+			WorldElements[Index].Geometry = WorldToLocal(WorldElements[Index].Geometry);
+		});
+
+		BuildLocalSpace(MoveTemp(WorldElements));
+	}
+
+	//Builds from local space geometry and value pairs using the current transform. Element IDs are the indices into LocalElements.
+	void BuildLocalSpace(TArray<FElement>&& LocalElements)
+	{
+		Elements.Empty(LocalElements.Num());
+
+		for (auto& Element : LocalElements)
+			Elements.Add(MoveTemp(Element));
+
+		LocalElements.Empty();
+
+		BuildCells();
+	}
+
+	//Replaces the geometry and value of an element without rebuilding the cells, which is only possible while it covers the same cells as before.
+	//Returns false and leaves the element alone otherwise, in which case the snapshot needs building again.
+	bool PatchElement(int32 ElementID, const FElement& Element)
+	{
+		if (!Elements.IsValidIndex(ElementID) || GetCellRect(Elements[ElementID].Geometry) != GetCellRect(Element.Geometry))
+			return false;
+
+		Elements[ElementID] = Element;
+
+		return true;
+	}
+
+	using TConstBoxQuery = TSpatialHashMapBoxQuery<const TSpatialHashMapSnapshot>;
+
+	TConstBoxQuery LocalBoxQuery(const FBox2D& LocalBox) const
+	{
+		return TConstBoxQuery{ *this, LocalBox };
+	}
+
+	TConstBoxQuery WorldBoxQuery(const FBox2D& WorldBox) const
+	{
+		return TConstBoxQuery{ *this, WorldToLocal(WorldBox) };
+	}
+
+	using TConstSegmentQuery = TSpatialHashMapSegmentQuery<const TSpatialHashMapSnapshot>;
+
+	TConstSegmentQuery LocalSegmentQuery(const FVector2D& LocalFrom, const FVector2D& LocalTo) const
+	{
+		return TConstSegmentQuery{ *this, LocalFrom, LocalTo };
+	}
+
+	TConstSegmentQuery WorldSegmentQuery(const FVector2D& WorldFrom, const FVector2D& WorldTo) const
+	{
+		return TConstSegmentQuery{ *this, WorldToLocal(WorldFrom), WorldToLocal(WorldTo) };
+	}
+
+	using TConstRadiusQuery = TSpatialHashMapRadiusQuery<const TSpatialHashMapSnapshot>;
+
+	TConstRadiusQuery WorldRadiusQuery(const FVector2D& WorldCenter, double WorldRadius) const
+	{
+		return TConstRadiusQuery{ *this, WorldCenter, WorldRadius };
+	}
+
+	//Finds up to K elements closest to the world space center within MaxRadius, nearest first. Returns the number found.
+	template <typename FilterFuncType>
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest, FilterFuncType&& Filter) const
+	{
+		return SpatialHashMapUtils::NearestK(*this, WorldCenter, K, MaxRadius, OutNearest, Forward<FilterFuncType>(Filter));
+	}
+
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest) const
+	{
+		return WorldNearestK(WorldCenter, K, MaxRadius, OutNearest, [](const ValueType&) { return true; });
+	}
+
+protected:
+
+	FIntRect GetCellRect(const FVector2D& LocalPosition) const
+	{
+		auto Cell = GetCellGeometry(LocalPosition);
+
+		return FIntRect{ Cell, Cell + 1 };
+	}
+
+	FIntRect GetCellRect(const FBox2D& LocalBox) const
+	{
+		return GetCellGeometry(LocalBox);
+	}
+
+	void BuildCells()
+	{
+		Cells.Build(Elements.GetMaxIndex(), [this](int32 ElementID)
+		{
+			if (!Elements.IsAllocated(ElementID))
+				return FIntRect{};
+
+			return GetCellRect(Elements[ElementID].Geometry);
+		});
+	}
+};
+
+
+namespace SpatialHashMapUtils
+{
+	inline FVector2D GetCenter(const FVector2D& Point)
+	{
+		return Point;
+	}
+
+	inline FVector2D GetCenter(const FBox2D& Box)
+	{
+		return Box.GetCenter();
+	}
+
+	//Largest distance from the center of the geometry to its edge along either axis
+	inline double GetHalfExtent(const FVector2D& Point)
+	{
+		return 0.0;
+	}
+
+	inline double GetHalfExtent(const FBox2D& Box)
+	{
+		return Box.GetExtent().GetMax();
+	}
+}
+
+//Box shape for THierarchicalSpatialHashMapQuery, in local space of the finest level
+struct FHierarchicalSpatialHashMapBoxShape
+{
+	FHierarchicalSpatialHashMapBoxShape(const FBox2D& InBox) : Box(InBox) {}
+
+	FBox2D GetBounds() const
+	{
+		return Box;
+	}
+
+	//Horizontal extent of the shape within a row of cells, in cell space of a level where everything has been scaled by Scale.
+	//Returns false if the shape does not reach the row, with the row grown by Margin on each side.
+	bool GetRowSpan(double Scale, double Margin, int32 Row, double& OutMinX, double& OutMaxX) const
+	{
+		OutMinX = Box.Min.X * Scale;
+		OutMaxX = Box.Max.X * Scale;
+		return true;
+	}
+
+	bool Intersects(const FBox2D& Other) const
+	{
+		return Box.Intersect(Other);
+	}
+
+	bool Intersects(const FVector2D& Point) const
+	{
+		return Box.IsInside(Point);
+	}
+
+protected:
+
+	FBox2D Box;
+};
+
+//Line segment shape for THierarchicalSpatialHashMapQuery, in local space of the finest level
+struct FHierarchicalSpatialHashMapSegmentShape
+{
+	FHierarchicalSpatialHashMapSegmentShape(const FVector2D& InFrom, const FVector2D& InTo) : From(InFrom), To(InTo)
+	{
+		FVector2D Direction = To - From;
+
+		InvDirection.X = Direction.X != 0.0 ? 1.0 / Direction.X : 0.0;
+		InvDirection.Y = Direction.Y != 0.0 ? 1.0 / Direction.Y : 0.0;
+	}
+
+	FBox2D GetBounds() const
+	{
+		return FBox2D{ From.ComponentMin(To), From.ComponentMax(To) };
+	}
+
+	bool GetRowSpan(double Scale, double Margin, int32 Row, double& OutMinX, double& OutMaxX) const
+	{
+		FVector2D A = From * Scale;
+		FVector2D B = To * Scale;
+
+		double SlabMin = Row - Margin;
+		double SlabMax = Row + 1.0 + Margin;
+
+		double TMin = 0.0;
+		double TMax = 1.0;
+
+		if (A.Y == B.Y)
+		{
+			if (A.Y < SlabMin || A.Y > SlabMax)
+				return false;
+		}
+		else
+		{
+			double T0 = (SlabMin - A.Y) / (B.Y - A.Y);
+			double T1 = (SlabMax - A.Y) / (B.Y - A.Y);
+
+			TMin = FMath::Max(TMin, FMath::Min(T0, T1));
+			TMax = FMath::Min(TMax, FMath::Max(T0, T1));
+
+			if (TMin > TMax)
+				return false;
+		}
+
+		double X0 = FMath::Lerp(A.X, B.X, TMin);
+		double X1 = FMath::Lerp(A.X, B.X, TMax);
+
+		OutMinX = FMath::Min(X0, X1);
+		OutMaxX = FMath::Max(X0, X1);
+		return true;
+	}
+
+	bool Intersects(const FBox2D& Box) const
+	{
+		return SpatialHashMapUtils::SegmentIntersectsBox(From, InvDirection, Box);
+	}
+
+	bool Intersects(const FVector2D& Point) const
+	{
+		//Same as the flat maps, points are reported if the finest cell they are in is crossed by the segment
+		FVector2D Cell{ FMath::Floor(Point.X), FMath::Floor(Point.Y) };
+
+		return SpatialHashMapUtils::SegmentIntersectsBox(From, InvDirection, FBox2D{ Cell, Cell + 1.0 });
+	}
+
+protected:
+
+	FVector2D From;
+
+	FVector2D To;
+
+	FVector2D InvDirection;
+};
+
+//UE style iterator over the elements of a THierarchicalSpatialHashMap that overlap a shape.
+//Every level is searched in turn, only visiting the loose cells that the shape reaches.
+//Elements are only stored in one cell, so they are never reported more than once.
+template <typename MapType, typename ShapeType>
+struct THierarchicalSpatialHashMapQuery
+{
+	template <typename T>
+	using ChooseConstType = typename TChooseClass<TIsConst<MapType>::Value, const T, T>::Result;
+
+	using IteratorMapType = MapType;
+
+	using IteratorCellIteratorType = typename MapType::CellsType::FCellIterator;
+
+	using IteratorElementType = ChooseConstType<typename MapType::FElement>;
+
+	using IteratorValueType = ChooseConstType<typename MapType::ValueType>;
+
+	using IteratorGeometryType = typename MapType::GeometryType;
+
+	THierarchicalSpatialHashMapQuery(IteratorMapType& InMap, const ShapeType& InShape) : Map(InMap), Shape(InShape), ShapeBounds(InShape.GetBounds())
+	{
+		Advance();
+	}
+
+	~THierarchicalSpatialHashMapQuery()
+	{
+		SpatialHashMapUtils::RecordQueryStats(NumVisitedCellEntries, NumAcceptedElements);
+	}
+
+	operator bool() const
+	{
+		return Level < Map.GetNumLevels();
+	}
+
+	THierarchicalSpatialHashMapQuery& operator++()
+	{
+		Advance();
+		return *this;
+	}
+
+	IteratorValueType& operator*() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Value;
+	}
+
+	IteratorValueType* operator->() const
+	{
+		check(CurrentElement);
+		return &CurrentElement->Value;
+	}
+
+	int32 GetElementID() const
+	{
+		check(CurrentElement);
+		return CurrentElementID;
+	}
+
+	const IteratorGeometryType& GetLocalGeometry() const
+	{
+		check(CurrentElement);
+		return CurrentElement->Geometry;
+	}
+
+	IteratorGeometryType GetWorldGeometry() const
+	{
+		return Map.LocalToWorld(GetLocalGeometry());
+	}
+
+protected:
+
+	IteratorMapType& Map;
+
+	ShapeType Shape;
+
+	FBox2D ShapeBounds;
+
+	//Starts before the first level, so that Advance() will advance to the first valid element
+	int32 Level = -1;
+
+	//Cell space of the current level
+	double LevelScale = 1.0;
+	double LevelMargin = 0.0;
+
+	//Cells of the current level that hold elements, inclusive
+	FIntRect LevelCellBounds;
+
+	//Inclusive ranges of cells left to visit on the current level
+	int32 Row = 0;
+	int32 MaxRow = 0;
+	int32 Column = 0;
+	int32 MaxColumn = 0;
+
+	IteratorElementType* CurrentElement = nullptr;
+
+	int32 CurrentElementID = INDEX_NONE;
+
+	int32 NumVisitedCellEntries = 0;
+
+	int32 NumAcceptedElements = 0;
+
+	//Remaining element IDs of the current cell
+	IteratorCellIteratorType CellIterator;
+
+	//Shape bounds can be huge, so clamp to just outside of the cells in use before converting to cell coordinates
+	static double ClampToCells(double Value, int32 Min, int32 Max)
+	{
+		return FMath::Clamp(Value, Min - 2.0, Max + 2.0);
+	}
+
+	void BeginLevel()
+	{
+		const auto& LevelData = Map.GetLevel(Level);
+
+		//Leave the row range empty if there is nothing to visit
+		Row = MaxRow = 0;
+
+		if (LevelData.NumElements == 0)
+			return;
+
+		LevelScale = Map.GetLevelScale(Level);
+
+		//A cell of the level is loose, so it can hold elements that reach up to the margin outside of it
+		LevelMargin = LevelData.Margin * LevelScale;
+
+		LevelCellBounds.Min = FIntPoint{ FMath::FloorToInt32(LevelData.CenterBounds.Min.X * LevelScale), FMath::FloorToInt32(LevelData.CenterBounds.Min.Y * LevelScale) };
+		LevelCellBounds.Max = FIntPoint{ FMath::FloorToInt32(LevelData.CenterBounds.Max.X * LevelScale), FMath::FloorToInt32(LevelData.CenterBounds.Max.Y * LevelScale) };
+
+		int32 MinRow = FMath::Max(FMath::CeilToInt32(ClampToCells(ShapeBounds.Min.Y * LevelScale - LevelMargin, LevelCellBounds.Min.Y, LevelCellBounds.Max.Y)) - 1, LevelCellBounds.Min.Y);
+
+		MaxRow = FMath::Min(FMath::FloorToInt32(ClampToCells(ShapeBounds.Max.Y * LevelScale + LevelMargin, LevelCellBounds.Min.Y, LevelCellBounds.Max.Y)), LevelCellBounds.Max.Y);
+
+		Row = MinRow - 1;
+	}
+
+	//Finds the columns of the current row to visit. Returns false if there are none.
+	bool BeginRow()
+	{
+		double MinX, MaxX;
+
+		if (!Shape.GetRowSpan(LevelScale, LevelMargin, Row, MinX, MaxX))
+			return false;
+
+		Column = FMath::Max(FMath::CeilToInt32(ClampToCells(MinX - LevelMargin, LevelCellBounds.Min.X, LevelCellBounds.Max.X)) - 1, LevelCellBounds.Min.X);
+
+		MaxColumn = FMath::Min(FMath::FloorToInt32(ClampToCells(MaxX + LevelMargin, LevelCellBounds.Min.X, LevelCellBounds.Max.X)), LevelCellBounds.Max.X);
+
+		return Column <= MaxColumn;
+	}
+
+	//Moves to the next cell to visit. Returns false once all levels are done.
+	bool NextCell()
+	{
+		if (Column < MaxColumn)
+		{
+			++Column;
+			return true;
+		}
+
+		while (true)
+		{
+			if (Row < MaxRow)
+			{
+				++Row;
+
+				if (BeginRow())
+					return true;
+
+				continue;
+			}
+
+			if (++Level >= Map.GetNumLevels())
+				return false;
+
+			BeginLevel();
+		}
+	}
+
+	void Advance()
+	{
+		while (true)
+		{
+			CurrentElement = nullptr;
+
+			//First try advance through the remaining elements in the current cell, if any
+			while (CellIterator)
+			{
+				int32 ElementID = *CellIterator;
+
+				auto& Element = Map.GetElement(ElementID);
+
+				++CellIterator;
+
+				++NumVisitedCellEntries;
+
+				if (Shape.Intersects(Element.Geometry))
+				{
+					//Found an overlapping element, stop advancing
+					CurrentElement = &Element;
+					CurrentElementID = ElementID;
+					++NumAcceptedElements;
+					return;
+				}
+			}
+
+			if (!NextCell())
+				//Reached the end of the last level
+				return;
+
+			//Initialize element iteration in new current cell.
+			CellIterator = Map.GetLevel(Level).Cells.CreateCellIterator(FIntPoint{ Column, Row });
+		}
+	}
+};
+
+//Loose multi level spatial hash map, for elements of very mixed sizes like large walls and dense crowds of small actors.
+//Each level has cells twice the size of the level below. An element is stored in exactly one cell, the one containing its center
+//on the finest level whose cells are at least as big as the element. Cells are loose, ie. they can hold elements that stick out of them
+//by up to the largest half extent of the elements on that level, which queries account for by searching a little further on each level.
+//Insertion cost is bounded to a single cell regardless of element size, so the finest cells can be kept small enough to bound
+//the occupancy of crowded cells without huge elements being copied into lots of cells.
+//Has the same public API as TSpatialHashMap. Points are always stored on the finest level.
+//The cell storage can be swapped out with InCellsType, but only unbounded policies (sparse and flat) are supported.
+template <typename InGeometryType, typename InValueType, typename InCellsType = FSpatialHashMapSparseCells>
+struct THierarchicalSpatialHashMap
+{
+	using GeometryType = InGeometryType;
+	using ValueType = InValueType;
+	using CellsType = InCellsType;
+	using FElement = TSpatialHashMapElement<InGeometryType, InValueType>;
+
+	struct FLevel
+	{
+		CellsType Cells;
+
+		//Largest half extent of the elements on this level, in local space.
+		//Only ever grows until the level becomes empty.
+		double Margin = 0.0;
+
+		//Bounds of the centers of the elements on this level, in local space.
+		//Only ever grows until the level becomes empty.
+		FBox2D CenterBounds{ ForceInit };
+
+		int32 NumElements = 0;
+	};
+
+protected:
+
+	FVector2D Origin;
+	FVector2D CellSize;
+	FVector2D InvCellSize;
+
+	TArray<FLevel> Levels;
+
+	TSparseArray<FElement> Elements;
+
+	//Scratch memory for converting batched moves to local space
+	TArray<GeometryType> LocalGeometryScratch;
+
+public:
+
+	THierarchicalSpatialHashMap()
+	{
+		SetTransform(FVector2D::Zero(), FVector2D{ 500.0, 500.0 });
+	}
+
+	//InCellSize is the size of the cells on the finest level. Empties the map.
+	void SetTransform(FVector2D InOrigin, FVector2D InCellSize, int32 NumLevels = 8)
+	{
+		//modify transform on non-empty map is not supported
+		Levels.SetNum(FMath::Clamp(NumLevels, 1, 30));
+
+		Empty();
+
+		Origin = InOrigin;
+		CellSize = InCellSize;
+		InvCellSize = { 1.0 / CellSize.X, 1.0 / CellSize.Y };
+	}
+
+	const FVector2D& GetOrigin() const { return Origin; }
+	const FVector2D& GetCellSize() const { return CellSize; }
+	const FVector2D& GetInvCellSize() const { return InvCellSize; }
+
+	int32 GetNumLevels() const { return Levels.Num(); }
+
+	const FLevel& GetLevel(int32 LevelIndex) const { return Levels[LevelIndex]; }
+
+	//Converts local space to the cell space of a level
+	double GetLevelScale(int32 LevelIndex) const { return 1.0 / double(1 << LevelIndex); }
+
+	const auto& GetElements() const { return Elements; }
+
+	FVector2D WorldToLocal(const FVector2D& Position) const
+	{
+		return (Position - Origin) * InvCellSize;
+	}
+
+	FBox2D WorldToLocal(const FBox2D& Box) const
+	{
+		return FBox2d{ WorldToLocal(Box.Min), WorldToLocal(Box.Max) };
+	}
+
+	FVector2D LocalToWorld(const FVector2D& Position) const
+	{
+		return Position * CellSize + Origin;
+	}
+
+	FBox2D LocalToWorld(const FBox2D& Box) const
+	{
+		return FBox2D{ LocalToWorld(Box.Min), LocalToWorld(Box.Max) };
+	}
+
+	//Finest level whose cells are at least as big as the geometry
+	int32 GetElementLevel(const GeometryType& LocalGeometry) const
+	{
+		double Size = SpatialHashMapUtils::GetHalfExtent(LocalGeometry) * 2.0;
+
+		int32 LevelIndex = Size > 1.0 ? FMath::CeilToInt32(FMath::Log2(Size)) : 0;
+
+		return FMath::Min(LevelIndex, Levels.Num() - 1);
+	}
+
+	FIntPoint GetElementCell(int32 LevelIndex, const GeometryType& LocalGeometry) const
+	{
+		FVector2D Center = SpatialHashMapUtils::GetCenter(LocalGeometry) * GetLevelScale(LevelIndex);
+
+		return FIntPoint{ FMath::FloorToInt32(Center.X), FMath::FloorToInt32(Center.Y) };
+	}
+
+	FElement& GetElement(int32 ElementID)
+	{
+		return Elements[ElementID];
+	}
+
+	const FElement& GetElement(int32 ElementID) const
+	{
+		return Elements[ElementID];
+	}
+
+	ValueType& GetValue(int32 ElementID)
+	{
+		return Elements[ElementID].Value;
+	}
+
+	const ValueType& GetValue(int32 ElementID) const
+	{
+		return Elements[ElementID].Value;
+	}
+
+	const GeometryType& GetGeometry(int32 ElementID) const
+	{
+		return Elements[ElementID].Geometry;
+	}
+
+	//Cells of every level are counted together
+	FSpatialHashMapStats GetStats() const
+	{
+		FSpatialHashMapStats Stats;
+
+		Stats.NumElements = Elements.Num();
+
+		for (const auto& Level : Levels)
+			Level.Cells.ForEachCell([&](FIntPoint Cell, int32 NumElementIDs) { Stats.AddCell(NumElementIDs); });
+
+		return Stats;
+	}
+
+	void Empty()
+	{
+		Elements.Empty();
+
+		for (auto& Level : Levels)
+		{
+			Level.Cells.Empty();
+			Level.Margin = 0.0;
+			Level.CenterBounds = FBox2D{ ForceInit };
+			Level.NumElements = 0;
+		}
+	}
 
 	template <typename ...ArgTypes>
 	int32 AddElementWorldSpace(const GeometryType& WorldGeometry, ArgTypes&& ... Args)
@@ -423,6 +2987,8 @@ struct TSpatialHashMap : TSpatialHashMapGeometryType<InGeometryType, InValueType
 
 		AddElementID(LocalGeometry, InsertResult);
 
+		INC_DWORD_STAT(STAT_SpatialHashAdds);
+
 		return InsertResult;
 	}
 
@@ -441,29 +3007,68 @@ struct TSpatialHashMap : TSpatialHashMapGeometryType<InGeometryType, InValueType
 		if (Element.Geometry == NewLocalGeometry)
 			return true;
 
-		MoveElementID(Element.Geometry, NewLocalGeometry, ElementID, true);
+		int32 OldLevel = GetElementLevel(Element.Geometry);
+		int32 NewLevel = GetElementLevel(NewLocalGeometry);
+
+		if (OldLevel == NewLevel && GetElementCell(OldLevel, Element.Geometry) == GetElementCell(NewLevel, NewLocalGeometry))
+			//Same cell, only the loose bounds of the level might need to grow
+			GrowLevel(Levels[NewLevel], NewLocalGeometry);
+		else
+		{
+			INC_DWORD_STAT(STAT_SpatialHashMoves);
+
+			RemoveElementID(Element.Geometry, ElementID);
+			AddElementID(NewLocalGeometry, ElementID);
+		}
 
 		Element.Geometry = NewLocalGeometry;
 
 		return true;
 	}
 
+	//Moves many elements at once. Element IDs must be unique. Returns the number of element IDs that were valid.
+	//Each element only ever changes a single cell, so this simply moves them one at a time.
+	int32 MoveElementsWorldSpace(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewWorldGeometries)
+	{
+		LocalGeometryScratch.Reset(NewWorldGeometries.Num());
+
+		for (auto& NewWorldGeometry : NewWorldGeometries)
+			LocalGeometryScratch.Add(WorldToLocal(NewWorldGeometry));
+
+		return MoveElementsLocalSpace(ElementIDs, LocalGeometryScratch);
+	}
+
+	int32 MoveElementsLocalSpace(TArrayView<const int32> ElementIDs, TArrayView<const GeometryType> NewLocalGeometries)
+	{
+		check(ElementIDs.Num() == NewLocalGeometries.Num());
+
+		int32 NumMoved = 0;
+
+		for (int32 Index = 0; Index < ElementIDs.Num(); ++Index)
+			if (MoveElementLocalSpace(ElementIDs[Index], NewLocalGeometries[Index]))
+				++NumMoved;
+
+		return NumMoved;
+	}
+
 	bool RemoveElement(int32 ElementID)
 	{
 		if (!Elements.IsValidIndex(ElementID))
 			return false;
 
-		RemoveElementID(Elements[ElementID].Geometry, ElementID, true);
+		RemoveElementID(Elements[ElementID].Geometry, ElementID);
 
 		Elements.RemoveAt(ElementID);
 
+		INC_DWORD_STAT(STAT_SpatialHashRemoves);
+
 		return true;
 	}
 
 
-	using TBoxQuery = TSpatialHashMapBoxQuery<TSpatialHashMap>;
+	using TBoxQuery = THierarchicalSpatialHashMapQuery<THierarchicalSpatialHashMap, FHierarchicalSpatialHashMapBoxShape>;
 
-	using TConstBoxQuery = TSpatialHashMapBoxQuery<const TSpatialHashMap>;
+	using TConstBoxQuery = THierarchicalSpatialHashMapQuery<const THierarchicalSpatialHashMap, FHierarchicalSpatialHashMapBoxShape>;
 
 	TConstBoxQuery LocalBoxQuery(const FBox2D& LocalBox) const
 	{
@@ -485,6 +3090,149 @@ struct TSpatialHashMap : TSpatialHashMapGeometryType<InGeometryType, InValueType
 		return TBoxQuery{ *this, WorldToLocal(WorldBox) };
 	}
 
+	using TSegmentQuery = THierarchicalSpatialHashMapQuery<THierarchicalSpatialHashMap, FHierarchicalSpatialHashMapSegmentShape>;
+
+	using TConstSegmentQuery = THierarchicalSpatialHashMapQuery<const THierarchicalSpatialHashMap, FHierarchicalSpatialHashMapSegmentShape>;
+
+	TConstSegmentQuery LocalSegmentQuery(const FVector2D& LocalFrom, const FVector2D& LocalTo) const
+	{
+		return TConstSegmentQuery{ *this, FHierarchicalSpatialHashMapSegmentShape{ LocalFrom, LocalTo } };
+	}
+
+	TSegmentQuery LocalSegmentQuery(const FVector2D& LocalFrom, const FVector2D& LocalTo)
+	{
+		return TSegmentQuery{ *this, FHierarchicalSpatialHashMapSegmentShape{ LocalFrom, LocalTo } };
+	}
+
+	TConstSegmentQuery WorldSegmentQuery(const FVector2D& WorldFrom, const FVector2D& WorldTo) const
+	{
+		return LocalSegmentQuery(WorldToLocal(WorldFrom), WorldToLocal(WorldTo));
+	}
+
+	TSegmentQuery WorldSegmentQuery(const FVector2D& WorldFrom, const FVector2D& WorldTo)
+	{
+		return LocalSegmentQuery(WorldToLocal(WorldFrom), WorldToLocal(WorldTo));
+	}
+
+	using TRadiusQuery = TSpatialHashMapRadiusQuery<THierarchicalSpatialHashMap, TBoxQuery>;
+
+	using TConstRadiusQuery = TSpatialHashMapRadiusQuery<const THierarchicalSpatialHashMap, TConstBoxQuery>;
+
+	TConstRadiusQuery WorldRadiusQuery(const FVector2D& WorldCenter, double WorldRadius) const
+	{
+		return TConstRadiusQuery{ *this, WorldCenter, WorldRadius };
+	}
+
+	TRadiusQuery WorldRadiusQuery(const FVector2D& WorldCenter, double WorldRadius)
+	{
+		return TRadiusQuery{ *this, WorldCenter, WorldRadius };
+	}
+
+	//Finds up to K elements closest to the world space center within MaxRadius, nearest first. Returns the number found.
+	//Searches a radius that doubles every pass, starting at the finest cell size, and only considers elements beyond the previous radius on each pass.
+	template <typename FilterFuncType>
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest, FilterFuncType&& Filter) const
+	{
+		OutNearest.Reset();
+
+		if (K <= 0 || MaxRadius < 0.0 || Elements.Num() == 0)
+			return 0;
+
+		//The max heap is kept in OutNearest, with the furthest of the best K at the top
+		auto FurthestFirst = [](const FSpatialHashMapNearestElement& A, const FSpatialHashMapNearestElement& B) { return A.DistanceSquared > B.DistanceSquared; };
+
+		//Once the search radius covers every element there is no point growing it any further
+		FBox2D LocalBounds{ ForceInit };
+
+		for (const auto& Level : Levels)
+			if (Level.NumElements > 0)
+				LocalBounds += Level.CenterBounds.ExpandBy(Level.Margin);
+
+		FBox2D WorldBounds = LocalToWorld(LocalBounds);
+
+		double MaxUsefulRadiusSquared = FVector2D{ FMath::Max(FMath::Abs(WorldBounds.Min.X - WorldCenter.X), FMath::Abs(WorldBounds.Max.X - WorldCenter.X)), FMath::Max(FMath::Abs(WorldBounds.Min.Y - WorldCenter.Y), FMath::Abs(WorldBounds.Max.Y - WorldCenter.Y)) }.SizeSquared();
+
+		double PreviousRadiusSquared = -1.0;
+
+		for (double Radius = FMath::Min(CellSize.GetMin(), MaxRadius);; Radius = FMath::Min(Radius * 2.0, MaxRadius))
+		{
+			double RadiusSquared = FMath::Square(Radius);
+
+			//Grown a little so that points exactly on the radius are not missed by both this pass and the next
+			for (auto It = WorldBoxQuery(FBox2D{ WorldCenter - Radius, WorldCenter + Radius }.ExpandBy(KINDA_SMALL_NUMBER)); It; ++It)
+			{
+				double DistanceSquared = SpatialHashMapUtils::DistanceSquared(It.GetWorldGeometry(), WorldCenter);
+
+				//Outside this pass, or already found by the previous one
+				if (DistanceSquared > RadiusSquared || DistanceSquared <= PreviousRadiusSquared)
+					continue;
+
+				if (OutNearest.Num() == K && DistanceSquared >= OutNearest.HeapTop().DistanceSquared)
+					continue;
+
+				if (!Filter(*It))
+					continue;
+
+				if (OutNearest.Num() == K)
+					OutNearest.HeapPopDiscard(FurthestFirst, false);
+
+				OutNearest.HeapPush(FSpatialHashMapNearestElement{ It.GetElementID(), DistanceSquared }, FurthestFirst);
+			}
+
+			//Anything not found yet is further away than everything found so far
+			if (OutNearest.Num() == K || Radius >= MaxRadius || RadiusSquared >= MaxUsefulRadiusSquared)
+				break;
+
+			PreviousRadiusSquared = RadiusSquared;
+		}
+
+		Algo::SortBy(OutNearest, &FSpatialHashMapNearestElement::DistanceSquared);
+
+		return OutNearest.Num();
+	}
+
+	int32 WorldNearestK(const FVector2D& WorldCenter, int32 K, double MaxRadius, TArray<FSpatialHashMapNearestElement>& OutNearest) const
+	{
+		return WorldNearestK(WorldCenter, K, MaxRadius, OutNearest, [](const ValueType&) { return true; });
+	}
+
+protected:
+
+	void GrowLevel(FLevel& Level, const GeometryType& LocalGeometry)
+	{
+		Level.Margin = FMath::Max(Level.Margin, SpatialHashMapUtils::GetHalfExtent(LocalGeometry));
+
+		Level.CenterBounds += SpatialHashMapUtils::GetCenter(LocalGeometry);
+	}
+
+	void AddElementID(const GeometryType& LocalGeometry, int32 ElementID)
+	{
+		int32 LevelIndex = GetElementLevel(LocalGeometry);
+
+		auto& Level = Levels[LevelIndex];
+
+		Level.Cells.Add(GetElementCell(LevelIndex, LocalGeometry), ElementID);
+
+		++Level.NumElements;
+
+		GrowLevel(Level, LocalGeometry);
+	}
+
+	void RemoveElementID(const GeometryType& LocalGeometry, int32 ElementID)
+	{
+		int32 LevelIndex = GetElementLevel(LocalGeometry);
+
+		auto& Level = Levels[LevelIndex];
+
+		Level.Cells.Remove(GetElementCell(LevelIndex, LocalGeometry), ElementID, true);
+
+		if (--Level.NumElements == 0)
+		{
+			//The loose bounds can only be shrunk back down once nothing is left on the level
+			Level.Margin = 0.0;
+			Level.CenterBounds = FBox2D{ ForceInit };
+		}
+	}
 };
 
 
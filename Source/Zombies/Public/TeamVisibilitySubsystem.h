@@ -0,0 +1,90 @@
+//Copyright Jarrad Alexander 2022
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "GenericTeamAgentInterface.h"
+#include "TeamVisibilitySubsystem.generated.h"
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FTeamActorVisibilityChanged, FGenericTeamId, Team, AActor*, Actor, bool, bIsVisible);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FTeamVisibleActorsUpdated, FGenericTeamId, Team, const TArray<AActor*>&, AddedActors, const TArray<AActor*>&, RemovedActors);
+
+USTRUCT()
+struct ZOMBIES_API FTeamVisibleActors
+{
+	GENERATED_BODY()
+
+	//Actors that at least one of the team's vision components can see
+	UPROPERTY(Transient)
+	TSet<AActor*> Actors;
+
+	//How many of the team's vision components can see each actor in Actors
+	TMap<TObjectKey<AActor>, int32> VisionCounts;
+
+	//Changes to Actors since OnVisibleActorsUpdated was last broadcast for this team. An actor that was added and removed again in between is in neither.
+	//Removed actors may have ended play, so check they are valid before using them.
+	UPROPERTY(Transient)
+	TArray<AActor*> AddedActors;
+
+	UPROPERTY(Transient)
+	TArray<AActor*> RemovedActors;
+
+	//Whether a vision component on the team has ever belonged to a player, so what the team sees is shown to the player
+	bool bHasPlayerVision = false;
+
+	void RecordChange(AActor* Actor, bool bIsVisible);
+};
+
+/**
+ * Combines what every vision component on a team can see, so that the team shares one set of visible actors.
+ * Visibility is reference counted per team and actor, so actors are only notified when the team as a whole starts or stops seeing them.
+ */
+UCLASS()
+class ZOMBIES_API UTeamVisibilitySubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+
+	virtual void Tick(float DeltaTime) override;
+
+	FORCEINLINE virtual TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(UTeamVisibilitySubsystem, STATGROUP_Tickables); };
+
+	//Moves what a vision component can see from OldVisible counted for OldTeam, to NewVisible counted for NewTeam
+	void UpdateVisionComponent(class UFogOfWarVisionComponent* Component, FGenericTeamId OldTeam, const TSet<AActor*>& OldVisible, FGenericTeamId NewTeam, const TSet<AActor*>& NewVisible);
+
+	//Actors that at least one vision component on the team can see. Shared by everything on the team, so read it in place instead of copying it.
+	const TSet<AActor*>& GetVisibleActors(FGenericTeamId Team) const;
+
+	UFUNCTION(BlueprintCallable, Category = FogOfWar)
+	bool IsVisibleToTeam(FGenericTeamId Team, AActor* Actor) const;
+
+	//True once a vision component on the team has belonged to a unit owned by a player controlled pawn
+	UFUNCTION(BlueprintCallable, Category = FogOfWar)
+	bool HasPlayerVision(FGenericTeamId Team) const;
+
+	//Called when the first vision component on a team sees an actor, and when the last one stops seeing it
+	UPROPERTY(BlueprintAssignable, Category = FogOfWar)
+	FTeamActorVisibilityChanged OnActorVisibilityChanged;
+
+	//Called at most once per frame for each team whose visible actors changed, with the actors the team started and stopped seeing since the last call
+	UPROPERTY(BlueprintAssignable, Category = FogOfWar)
+	FTeamVisibleActorsUpdated OnVisibleActorsUpdated;
+
+protected:
+
+	void AddVisibleActor(FGenericTeamId Team, AActor* Actor);
+
+	void RemoveVisibleActor(FGenericTeamId Team, AActor* Actor);
+
+	bool IsVisibleToAnyTeam(AActor* Actor) const;
+
+	//Actors that end play are removed from every team straight away, since vision components only let go of them on their next update
+	UFUNCTION()
+	void OnVisibleActorEndPlay(AActor* Actor, EEndPlayReason::Type EndPlayReason);
+
+	//Indexed by FGenericTeamId::GetId()
+	UPROPERTY(Transient)
+	TMap<uint8, FTeamVisibleActors> Teams;
+};
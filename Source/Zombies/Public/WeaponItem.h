@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "EquippableItem.h"
+#include "GenericTeamAgentInterface.h"
 #include "WeaponItem.generated.h"
 
 /**
@@ -46,9 +47,15 @@ public:
 	void NotifyRelevantActorsUpdated();
 
 	//Actors that are relevant to the weapons logic, such as enemies or friendlies.
-	//Typically this is the set of actors visible to the owning unit.
-	UPROPERTY(BlueprintReadWrite, Category = Item)
-	TSet<AActor*> RelevantActors;
+	//This is the set of actors visible to the relevant team, shared with everything else on the team, so it is read only.
+	UFUNCTION(BlueprintPure, Category = Item)
+	const TSet<AActor*>& GetRelevantActors() const;
+
+	//Use the actors visible to this team as the relevant actors. Call NotifyRelevantActorsUpdated after.
+	UFUNCTION(BlueprintCallable, Category = Item)
+	void SetRelevantTeam(FGenericTeamId NewRelevantTeam);
+
+	FORCEINLINE FGenericTeamId GetRelevantTeam() const { return RelevantTeam; }
 
 protected:
 
@@ -65,6 +72,10 @@ protected:
 
 	void UpdateUtilityTaskComponent();
 
+	//Team whose visible actors are relevant to this weapon. No team has no relevant actors.
+	UPROPERTY(Transient, BlueprintReadOnly, Category = Item, Meta = (AllowPrivateAccess = "True"))
+	FGenericTeamId RelevantTeam = FGenericTeamId::NoTeam;
+
 
 
 };